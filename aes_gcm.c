@@ -0,0 +1,406 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * AES-GCM (NIST SP 800-38D) with 96-bit nonces, streaming.
+ *
+ * Text is handled in slices: each slice is run through CTR and then hashed
+ * while still in L1, so the data goes through memory once. CTR uses aes_hw
+ * when the CPU has it, trezor-crypto otherwise. Its 128-bit counter step
+ * only differs from GCM's 32-bit one past 2^32 blocks, more than GCM allows
+ * per nonce.
+ *
+ * GHASH uses PCLMULQDQ on x86-64 (four blocks per reduction), or Shoup's
+ * 4-bit tables: 256 bytes per key and no big tables in flash.
+ *
+ */
+
+#include <string.h>
+
+#include "aes_gcm.h"
+
+#if defined(AES_HW) && defined(__x86_64__)
+#define GHASH_CLMUL
+#include <immintrin.h>
+#endif
+
+// bytes of text per CTR + GHASH step
+#define GCM_SLICE 512
+
+static inline uint64_t get_be64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 0; i < 8; i++) v = (v << 8) | p[i];
+    return v;
+}
+
+static inline void put_be64(uint8_t *p, uint64_t v)
+{
+    for (int i = 7; i >= 0; i--, v >>= 8) p[i] = (uint8_t)v;
+}
+
+// reduction of the 4 bits shifted out at each step
+static const uint16_t last4[16] = {
+    0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+    0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0,
+};
+
+// hl/hh[i] = i * H, where bit 3 of i is the first bit of the field element
+static void ghash_table_init(aes_gcm_ctx *ctx, const uint8_t h[16])
+{
+    uint64_t vh = get_be64(h);
+    uint64_t vl = get_be64(h + 8);
+
+    ctx->hh[0] = ctx->hl[0] = 0;
+    ctx->hh[8] = vh;
+    ctx->hl[8] = vl;
+    for (int i = 4; i > 0; i >>= 1) {
+        uint64_t t = (vl & 1) * 0xe100000000000000ULL;
+        vl = (vh << 63) | (vl >> 1);
+        vh = (vh >> 1) ^ t;
+        ctx->hh[i] = vh;
+        ctx->hl[i] = vl;
+    }
+    for (int i = 2; i <= 8; i *= 2) {
+        for (int j = 1; j < i; j++) {
+            ctx->hh[i + j] = ctx->hh[i] ^ ctx->hh[j];
+            ctx->hl[i + j] = ctx->hl[i] ^ ctx->hl[j];
+        }
+    }
+}
+
+static void ghash_blocks_table(aes_gcm_ctx *ctx, const uint8_t *data, size_t nblocks)
+{
+    uint8_t *x = ctx->x;
+
+    for (; nblocks; nblocks--, data += 16) {
+        uint64_t zh = 0, zl = 0;
+
+        for (int i = 0; i < 16; i++) x[i] ^= data[i];
+
+        // x = x * H, four bits at a time from the end
+        for (int i = 15; i >= 0; i--) {
+            for (int half = 0; half < 2; half++) {
+                uint8_t nib = half ? (x[i] >> 4) : (x[i] & 0xf);
+                if (i != 15 || half) {
+                    uint8_t rem = zl & 0xf;
+                    zl = (zh << 60) | (zl >> 4);
+                    zh = (zh >> 4) ^ ((uint64_t)last4[rem] << 48);
+                }
+                zh ^= ctx->hh[nib];
+                zl ^= ctx->hl[nib];
+            }
+        }
+        put_be64(x, zh);
+        put_be64(x + 8, zl);
+    }
+}
+
+#ifdef GHASH_CLMUL
+
+#define GHASH_TARGET __attribute__((target("pclmul,ssse3")))
+
+GHASH_TARGET
+static inline __m128i bswap128(__m128i v)
+{
+    return _mm_shuffle_epi8(v, _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15));
+}
+
+// (lo, hi) ^= a * b, unreduced
+GHASH_TARGET
+static inline void clmul_acc(__m128i a, __m128i b, __m128i *lo, __m128i *hi)
+{
+    __m128i t0 = _mm_clmulepi64_si128(a, b, 0x00);
+    __m128i t1 = _mm_clmulepi64_si128(a, b, 0x10);
+    __m128i t2 = _mm_clmulepi64_si128(a, b, 0x01);
+    __m128i t3 = _mm_clmulepi64_si128(a, b, 0x11);
+
+    t1 = _mm_xor_si128(t1, t2);
+    *lo = _mm_xor_si128(*lo, _mm_xor_si128(t0, _mm_slli_si128(t1, 8)));
+    *hi = _mm_xor_si128(*hi, _mm_xor_si128(t3, _mm_srli_si128(t1, 8)));
+}
+
+// reduce a 256-bit product of bit-reflected values; see Gueron & Kounavis,
+// "Intel Carry-Less Multiplication Instruction and its Usage for Computing
+// the GCM Mode", algorithms 4 and 5
+GHASH_TARGET
+static inline __m128i clmul_reduce(__m128i lo, __m128i hi)
+{
+    __m128i t7, t8, t9, t2;
+
+    // shift (hi:lo) left by one
+    t7 = _mm_srli_epi32(lo, 31);
+    t8 = _mm_srli_epi32(hi, 31);
+    lo = _mm_slli_epi32(lo, 1);
+    hi = _mm_slli_epi32(hi, 1);
+    t9 = _mm_srli_si128(t7, 12);
+    t8 = _mm_slli_si128(t8, 4);
+    t7 = _mm_slli_si128(t7, 4);
+    lo = _mm_or_si128(lo, t7);
+    hi = _mm_or_si128(hi, t8);
+    hi = _mm_or_si128(hi, t9);
+
+    // modulo x^128 + x^7 + x^2 + x + 1
+    t7 = _mm_slli_epi32(lo, 31);
+    t8 = _mm_slli_epi32(lo, 30);
+    t9 = _mm_slli_epi32(lo, 25);
+    t7 = _mm_xor_si128(t7, t8);
+    t7 = _mm_xor_si128(t7, t9);
+    t8 = _mm_srli_si128(t7, 4);
+    t7 = _mm_slli_si128(t7, 12);
+    lo = _mm_xor_si128(lo, t7);
+
+    t2 = _mm_srli_epi32(lo, 1);
+    t2 = _mm_xor_si128(t2, _mm_srli_epi32(lo, 2));
+    t2 = _mm_xor_si128(t2, _mm_srli_epi32(lo, 7));
+    t2 = _mm_xor_si128(t2, t8);
+    lo = _mm_xor_si128(lo, t2);
+
+    return _mm_xor_si128(hi, lo);
+}
+
+GHASH_TARGET
+static inline __m128i gfmul(__m128i a, __m128i b)
+{
+    __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+    clmul_acc(a, b, &lo, &hi);
+    return clmul_reduce(lo, hi);
+}
+
+GHASH_TARGET
+static void ghash_clmul_init(aes_gcm_ctx *ctx, const uint8_t h[16])
+{
+    __m128i h1 = bswap128(_mm_loadu_si128((const __m128i *)h));
+    __m128i hn = h1;
+
+    _mm_storeu_si128((__m128i *)ctx->hpow[0], h1);
+    for (int i = 1; i < 4; i++) {
+        hn = gfmul(hn, h1);
+        _mm_storeu_si128((__m128i *)ctx->hpow[i], hn);
+    }
+}
+
+GHASH_TARGET
+static void ghash_blocks_clmul(aes_gcm_ctx *ctx, const uint8_t *data, size_t nblocks)
+{
+    const __m128i h1 = _mm_loadu_si128((const __m128i *)ctx->hpow[0]);
+    const __m128i h2 = _mm_loadu_si128((const __m128i *)ctx->hpow[1]);
+    const __m128i h3 = _mm_loadu_si128((const __m128i *)ctx->hpow[2]);
+    const __m128i h4 = _mm_loadu_si128((const __m128i *)ctx->hpow[3]);
+    __m128i x = bswap128(_mm_loadu_si128((const __m128i *)ctx->x));
+
+    // x = (x + d0) H^4 + d1 H^3 + d2 H^2 + d3 H, with one reduction
+    for (; nblocks >= 4; nblocks -= 4, data += 64) {
+        __m128i lo = _mm_setzero_si128(), hi = _mm_setzero_si128();
+        __m128i d0 = bswap128(_mm_loadu_si128((const __m128i *)data));
+        clmul_acc(_mm_xor_si128(x, d0), h4, &lo, &hi);
+        clmul_acc(bswap128(_mm_loadu_si128((const __m128i *)(data + 16))), h3, &lo, &hi);
+        clmul_acc(bswap128(_mm_loadu_si128((const __m128i *)(data + 32))), h2, &lo, &hi);
+        clmul_acc(bswap128(_mm_loadu_si128((const __m128i *)(data + 48))), h1, &lo, &hi);
+        x = clmul_reduce(lo, hi);
+    }
+    for (; nblocks; nblocks--, data += 16) {
+        x = gfmul(_mm_xor_si128(x, bswap128(_mm_loadu_si128((const __m128i *)data))), h1);
+    }
+
+    _mm_storeu_si128((__m128i *)ctx->x, bswap128(x));
+}
+
+#endif // GHASH_CLMUL
+
+static void ghash_blocks(aes_gcm_ctx *ctx, const uint8_t *data, size_t nblocks)
+{
+#ifdef GHASH_CLMUL
+    if (ctx->use_clmul) {
+        ghash_blocks_clmul(ctx, data, nblocks);
+        return;
+    }
+#endif
+    ghash_blocks_table(ctx, data, nblocks);
+}
+
+// hash any length, keeping a partial block for next time
+static void ghash_update(aes_gcm_ctx *ctx, const uint8_t *data, size_t len)
+{
+    if (ctx->buf_len) {
+        size_t take = 16 - ctx->buf_len;
+        if (take > len) take = len;
+        memcpy(ctx->buf + ctx->buf_len, data, take);
+        ctx->buf_len += take;
+        data += take;
+        len -= take;
+        if (ctx->buf_len < 16) {
+            return;
+        }
+        ghash_blocks(ctx, ctx->buf, 1);
+        ctx->buf_len = 0;
+    }
+
+    ghash_blocks(ctx, data, len / 16);
+    data += len & ~(size_t)15;
+    len &= 15;
+
+    memcpy(ctx->buf, data, len);
+    ctx->buf_len = len;
+}
+
+// zero-pad and hash the partial block, at the end of the AAD or text
+static void ghash_pad(aes_gcm_ctx *ctx)
+{
+    if (ctx->buf_len) {
+        memset(ctx->buf + ctx->buf_len, 0, 16 - ctx->buf_len);
+        ghash_blocks(ctx, ctx->buf, 1);
+        ctx->buf_len = 0;
+    }
+}
+
+static void encrypt_block(aes_gcm_ctx *ctx, const uint8_t *in, uint8_t *out)
+{
+#ifdef AES_HW
+    if (ctx->use_hw) {
+        aes_hw_ecb_encrypt(&ctx->hw, in, out, 16);
+        return;
+    }
+#endif
+    aes_encrypt(in, out, &ctx->sw);
+}
+
+static void ctr_crypt(aes_gcm_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+#ifdef AES_HW
+    if (ctx->use_hw) {
+        aes_hw_ctr_crypt(&ctx->hw, in, out, len, ctx->ctr);
+        return;
+    }
+#endif
+    aes_ctr_crypt(in, out, (int)len, ctx->ctr, aes_ctr_cbuf_inc, &ctx->sw);
+}
+
+bool aes_gcm_init(aes_gcm_ctx *ctx, const uint8_t *key, size_t key_len, const uint8_t nonce[12])
+{
+    uint8_t h[16];
+
+    memset(ctx, 0, sizeof(*ctx));
+
+#ifdef AES_HW
+    ctx->use_hw = aes_hw_init(&ctx->hw, key, key_len);
+    if (!ctx->use_hw)
+#endif
+    {
+        switch (key_len) {
+#ifdef AES_128
+            case 16:
+                aes_encrypt_key128(key, &ctx->sw);
+                break;
+#endif
+#ifdef AES_192
+            case 24:
+                aes_encrypt_key192(key, &ctx->sw);
+                break;
+#endif
+#ifdef AES_256
+            case 32:
+                aes_encrypt_key256(key, &ctx->sw);
+                break;
+#endif
+            default:
+                return false;
+        }
+    }
+
+    // H = E(K, 0)
+    memset(h, 0, sizeof(h));
+    encrypt_block(ctx, h, h);
+    ghash_table_init(ctx, h);
+#ifdef GHASH_CLMUL
+    ctx->use_clmul = __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("ssse3");
+    if (ctx->use_clmul) {
+        ghash_clmul_init(ctx, h);
+    }
+#endif
+    memset(h, 0, sizeof(h));
+
+    // J0 = nonce || 1 masks the tag; the text starts at J0 + 1
+    memcpy(ctx->ctr, nonce, 12);
+    ctx->ctr[15] = 1;
+    encrypt_block(ctx, ctx->ctr, ctx->ek0);
+    ctx->ctr[15] = 2;
+
+    return true;
+}
+
+void aes_gcm_auth(aes_gcm_ctx *ctx, const uint8_t *data, size_t len)
+{
+    ghash_update(ctx, data, len);
+    ctx->alen += len;
+}
+
+static void start_text(aes_gcm_ctx *ctx)
+{
+    if (!ctx->in_text) {
+        ghash_pad(ctx);
+        ctx->in_text = true;
+    }
+}
+
+void aes_gcm_encrypt(aes_gcm_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+    start_text(ctx);
+    ctx->plen += len;
+    while (len) {
+        size_t n = len < GCM_SLICE ? len : GCM_SLICE;
+        ctr_crypt(ctx, in, out, n);
+        ghash_update(ctx, out, n);
+        in += n;
+        out += n;
+        len -= n;
+    }
+}
+
+void aes_gcm_decrypt(aes_gcm_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+    start_text(ctx);
+    ctx->plen += len;
+    while (len) {
+        size_t n = len < GCM_SLICE ? len : GCM_SLICE;
+        ghash_update(ctx, in, n);
+        ctr_crypt(ctx, in, out, n);
+        in += n;
+        out += n;
+        len -= n;
+    }
+}
+
+void aes_gcm_finish(aes_gcm_ctx *ctx, uint8_t tag[16])
+{
+    uint8_t lens[16];
+
+    if (!ctx->finished) {
+        start_text(ctx);
+        ghash_pad(ctx);
+        put_be64(lens, ctx->alen * 8);
+        put_be64(lens + 8, ctx->plen * 8);
+        ghash_blocks(ctx, lens, 1);
+
+        for (int i = 0; i < 16; i++) {
+            ctx->tag[i] = ctx->x[i] ^ ctx->ek0[i];
+        }
+        ctx->finished = true;
+    }
+    memcpy(tag, ctx->tag, 16);
+}
+
+bool aes_gcm_verify(aes_gcm_ctx *ctx, const uint8_t tag[16])
+{
+    uint8_t mine[16], diff = 0;
+
+    aes_gcm_finish(ctx, mine);
+    for (int i = 0; i < 16; i++) {
+        diff |= mine[i] ^ tag[i];
+    }
+    memset(mine, 0, sizeof(mine));
+    return diff == 0;
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * AES-GCM (NIST SP 800-38D) with 96-bit nonces, streaming.
+ *
+ */
+
+#ifndef __AES_GCM_H__
+#define __AES_GCM_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "aes/aes.h"
+#include "aes_hw.h"
+
+typedef struct {
+#ifdef AES_HW
+    aes_hw_ctx hw;
+    bool use_hw;
+    bool use_clmul;
+    uint8_t hpow[4][16];        // H^1..H^4, byte-reversed, for PCLMULQDQ
+#endif
+    aes_encrypt_ctx sw;
+    uint64_t hl[16], hh[16];    // 4-bit multiplication table of H
+    uint8_t ctr[16];
+    uint8_t ek0[16];            // E(K, J0), masks the tag
+    uint8_t x[16];              // GHASH accumulator
+    uint8_t buf[16];            // partial block not yet hashed
+    uint8_t buf_len;
+    bool in_text;               // past the AAD
+    bool finished;              // tag is final
+    uint8_t tag[16];
+    uint64_t alen, plen;
+} aes_gcm_ctx;
+
+// returns false for a key length other than 16, 24 or 32
+bool aes_gcm_init(aes_gcm_ctx *ctx, const uint8_t *key, size_t key_len, const uint8_t nonce[12]);
+
+// additional data, any chunking, all of it before the text
+void aes_gcm_auth(aes_gcm_ctx *ctx, const uint8_t *data, size_t len);
+
+// any chunking; in == out is fine
+void aes_gcm_encrypt(aes_gcm_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len);
+void aes_gcm_decrypt(aes_gcm_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len);
+
+// the tag is worked out once; later calls return the same one
+void aes_gcm_finish(aes_gcm_ctx *ctx, uint8_t tag[16]);
+
+// finish, and compare with tag in constant time
+bool aes_gcm_verify(aes_gcm_ctx *ctx, const uint8_t tag[16]);
+
+#endif
@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * AES using the CPU's instructions: AES-NI on x86-64 (checked at runtime),
+ * or the ARMv8 crypto extensions when the compiler targets them.
+ *
+ * The key schedule is plain C and done once per key. ECB, CTR and CBC
+ * decryption keep eight blocks in flight, so the latency of each round
+ * instruction is hidden; CBC encryption is serial by nature.
+ *
+ */
+
+#include "aes_hw.h"
+
+#ifdef AES_HW
+
+#include <string.h>
+
+// the 8-block loops must be unrolled to keep the blocks in registers, even at -Os
+#if defined(__clang__)
+#define AES_HW_UNROLL   _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define AES_HW_UNROLL   _Pragma("GCC unroll 8")
+#else
+#define AES_HW_UNROLL
+#endif
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+typedef __m128i block_t;
+
+#define AES_HW_TARGET   __attribute__((target("aes,sse2")))
+#define LOAD(p)         _mm_loadu_si128((const __m128i *)(p))
+#define STORE(p, v)     _mm_storeu_si128((__m128i *)(p), (v))
+#define XOR(a, b)       _mm_xor_si128((a), (b))
+#define SET64(w0, w1)   _mm_set_epi64x((long long)(w1), (long long)(w0))
+
+AES_HW_TARGET
+static inline __attribute__((always_inline)) void enc_blocks(const aes_hw_ctx *ctx, block_t *b, int n)
+{
+    block_t k = LOAD(ctx->ek[0]);
+    AES_HW_UNROLL
+    for (int j = 0; j < n; j++) b[j] = XOR(b[j], k);
+    for (int r = 1; r < ctx->rounds; r++) {
+        k = LOAD(ctx->ek[r]);
+        AES_HW_UNROLL
+        for (int j = 0; j < n; j++) b[j] = _mm_aesenc_si128(b[j], k);
+    }
+    k = LOAD(ctx->ek[ctx->rounds]);
+    AES_HW_UNROLL
+    for (int j = 0; j < n; j++) b[j] = _mm_aesenclast_si128(b[j], k);
+}
+
+AES_HW_TARGET
+static inline __attribute__((always_inline)) void dec_blocks(const aes_hw_ctx *ctx, block_t *b, int n)
+{
+    block_t k = LOAD(ctx->dk[0]);
+    AES_HW_UNROLL
+    for (int j = 0; j < n; j++) b[j] = XOR(b[j], k);
+    for (int r = 1; r < ctx->rounds; r++) {
+        k = LOAD(ctx->dk[r]);
+        AES_HW_UNROLL
+        for (int j = 0; j < n; j++) b[j] = _mm_aesdec_si128(b[j], k);
+    }
+    k = LOAD(ctx->dk[ctx->rounds]);
+    AES_HW_UNROLL
+    for (int j = 0; j < n; j++) b[j] = _mm_aesdeclast_si128(b[j], k);
+}
+
+static bool cpu_has_aes(void)
+{
+    return __builtin_cpu_supports("aes");
+}
+
+#else // aarch64
+
+#include <arm_neon.h>
+
+typedef uint8x16_t block_t;
+
+#define AES_HW_TARGET
+#define LOAD(p)         vld1q_u8(p)
+#define STORE(p, v)     vst1q_u8((p), (v))
+#define XOR(a, b)       veorq_u8((a), (b))
+#define SET64(w0, w1)   vreinterpretq_u8_u64(vcombine_u64(vcreate_u64(w0), vcreate_u64(w1)))
+
+// AESE/AESD add the round key first, so the last key is a plain XOR
+static inline __attribute__((always_inline)) void enc_blocks(const aes_hw_ctx *ctx, block_t *b, int n)
+{
+    block_t k;
+    for (int r = 0; r < ctx->rounds - 1; r++) {
+        k = LOAD(ctx->ek[r]);
+        AES_HW_UNROLL
+        for (int j = 0; j < n; j++) b[j] = vaesmcq_u8(vaeseq_u8(b[j], k));
+    }
+    k = LOAD(ctx->ek[ctx->rounds - 1]);
+    AES_HW_UNROLL
+    for (int j = 0; j < n; j++) b[j] = vaeseq_u8(b[j], k);
+    k = LOAD(ctx->ek[ctx->rounds]);
+    AES_HW_UNROLL
+    for (int j = 0; j < n; j++) b[j] = XOR(b[j], k);
+}
+
+static inline __attribute__((always_inline)) void dec_blocks(const aes_hw_ctx *ctx, block_t *b, int n)
+{
+    block_t k;
+    for (int r = 0; r < ctx->rounds - 1; r++) {
+        k = LOAD(ctx->dk[r]);
+        AES_HW_UNROLL
+        for (int j = 0; j < n; j++) b[j] = vaesimcq_u8(vaesdq_u8(b[j], k));
+    }
+    k = LOAD(ctx->dk[ctx->rounds - 1]);
+    AES_HW_UNROLL
+    for (int j = 0; j < n; j++) b[j] = vaesdq_u8(b[j], k);
+    k = LOAD(ctx->dk[ctx->rounds]);
+    AES_HW_UNROLL
+    for (int j = 0; j < n; j++) b[j] = XOR(b[j], k);
+}
+
+static bool cpu_has_aes(void)
+{
+    // compiler was told the target has it
+    return true;
+}
+
+#endif
+
+static const uint8_t sbox[256] = {
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16,
+};
+
+static inline uint8_t xtime(uint8_t a)
+{
+    return (a << 1) ^ ((a & 0x80) ? 0x1b : 0);
+}
+
+static uint8_t gmul(uint8_t a, uint8_t b)
+{
+    uint8_t r = 0;
+    while (b) {
+        if (b & 1) r ^= a;
+        a = xtime(a);
+        b >>= 1;
+    }
+    return r;
+}
+
+bool aes_hw_init(aes_hw_ctx *ctx, const uint8_t *key, size_t key_len)
+{
+    if ((key_len != 16 && key_len != 24 && key_len != 32) || !cpu_has_aes()) {
+        return false;
+    }
+
+    // FIPS-197 key expansion, as bytes; ek[][] is one contiguous array
+    const int nk = key_len / 4;
+    const int rounds = nk + 6;
+    uint8_t *w = &ctx->ek[0][0];
+    uint8_t rcon = 1;
+
+    memcpy(w, key, key_len);
+    for (int i = nk; i < 4 * (rounds + 1); i++) {
+        uint8_t t[4];
+        memcpy(t, w + 4 * (i - 1), 4);
+        if (i % nk == 0) {
+            uint8_t t0 = t[0];
+            t[0] = sbox[t[1]] ^ rcon;
+            t[1] = sbox[t[2]];
+            t[2] = sbox[t[3]];
+            t[3] = sbox[t0];
+            rcon = xtime(rcon);
+        } else if (nk > 6 && i % nk == 4) {
+            for (int b = 0; b < 4; b++) t[b] = sbox[t[b]];
+        }
+        for (int b = 0; b < 4; b++) {
+            w[4 * i + b] = w[4 * (i - nk) + b] ^ t[b];
+        }
+    }
+
+    // decryption keys: reversed, with InvMixColumns on the inner ones
+    memcpy(ctx->dk[0], ctx->ek[rounds], 16);
+    memcpy(ctx->dk[rounds], ctx->ek[0], 16);
+    for (int r = 1; r < rounds; r++) {
+        const uint8_t *s = ctx->ek[rounds - r];
+        uint8_t *d = ctx->dk[r];
+        for (int c = 0; c < 16; c += 4) {
+            uint8_t a0 = s[c], a1 = s[c + 1], a2 = s[c + 2], a3 = s[c + 3];
+            d[c]     = gmul(a0, 14) ^ gmul(a1, 11) ^ gmul(a2, 13) ^ gmul(a3, 9);
+            d[c + 1] = gmul(a0, 9) ^ gmul(a1, 14) ^ gmul(a2, 11) ^ gmul(a3, 13);
+            d[c + 2] = gmul(a0, 13) ^ gmul(a1, 9) ^ gmul(a2, 14) ^ gmul(a3, 11);
+            d[c + 3] = gmul(a0, 11) ^ gmul(a1, 13) ^ gmul(a2, 9) ^ gmul(a3, 14);
+        }
+    }
+
+    ctx->rounds = rounds;
+    ctx->ks_pos = 0;
+    return true;
+}
+
+AES_HW_TARGET
+void aes_hw_ecb_encrypt(const aes_hw_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+    block_t b[8];
+
+    for (; len >= 128; len -= 128, in += 128, out += 128) {
+        AES_HW_UNROLL
+        for (int j = 0; j < 8; j++) b[j] = LOAD(in + 16 * j);
+        enc_blocks(ctx, b, 8);
+        AES_HW_UNROLL
+        for (int j = 0; j < 8; j++) STORE(out + 16 * j, b[j]);
+    }
+    for (; len >= 16; len -= 16, in += 16, out += 16) {
+        b[0] = LOAD(in);
+        enc_blocks(ctx, b, 1);
+        STORE(out, b[0]);
+    }
+}
+
+AES_HW_TARGET
+void aes_hw_ecb_decrypt(const aes_hw_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+    block_t b[8];
+
+    for (; len >= 128; len -= 128, in += 128, out += 128) {
+        AES_HW_UNROLL
+        for (int j = 0; j < 8; j++) b[j] = LOAD(in + 16 * j);
+        dec_blocks(ctx, b, 8);
+        AES_HW_UNROLL
+        for (int j = 0; j < 8; j++) STORE(out + 16 * j, b[j]);
+    }
+    for (; len >= 16; len -= 16, in += 16, out += 16) {
+        b[0] = LOAD(in);
+        dec_blocks(ctx, b, 1);
+        STORE(out, b[0]);
+    }
+}
+
+AES_HW_TARGET
+void aes_hw_cbc_encrypt(const aes_hw_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len, uint8_t iv[16])
+{
+    block_t b = LOAD(iv);
+
+    for (; len >= 16; len -= 16, in += 16, out += 16) {
+        b = XOR(b, LOAD(in));
+        enc_blocks(ctx, &b, 1);
+        STORE(out, b);
+    }
+    STORE(iv, b);
+}
+
+// ciphertext is read before the output is written, so in == out is fine
+AES_HW_TARGET
+void aes_hw_cbc_decrypt(const aes_hw_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len, uint8_t iv[16])
+{
+    block_t b[8], c[8];
+    block_t prev = LOAD(iv);
+
+    for (; len >= 128; len -= 128, in += 128, out += 128) {
+        AES_HW_UNROLL
+        for (int j = 0; j < 8; j++) b[j] = c[j] = LOAD(in + 16 * j);
+        dec_blocks(ctx, b, 8);
+        STORE(out, XOR(b[0], prev));
+        AES_HW_UNROLL
+        for (int j = 1; j < 8; j++) STORE(out + 16 * j, XOR(b[j], c[j - 1]));
+        prev = c[7];
+    }
+    for (; len >= 16; len -= 16, in += 16, out += 16) {
+        b[0] = c[0] = LOAD(in);
+        dec_blocks(ctx, b, 1);
+        STORE(out, XOR(b[0], prev));
+        prev = c[0];
+    }
+    STORE(iv, prev);
+}
+
+static inline uint64_t load_be64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
+
+static inline void store_be64(uint8_t *p, uint64_t v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    memcpy(p, &v, 8);
+}
+
+// counter block for (hi, lo), then step the 128-bit counter
+AES_HW_TARGET
+static inline block_t next_counter(uint64_t *hi, uint64_t *lo)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    block_t b = SET64(__builtin_bswap64(*hi), __builtin_bswap64(*lo));
+#else
+    uint8_t cb[16];
+    store_be64(cb, *hi);
+    store_be64(cb + 8, *lo);
+    block_t b = LOAD(cb);
+#endif
+    if (++*lo == 0) ++*hi;
+    return b;
+}
+
+AES_HW_TARGET
+void aes_hw_ctr_crypt(aes_hw_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len, uint8_t ctr[16])
+{
+    block_t b[8];
+    uint64_t hi = load_be64(ctr), lo = load_be64(ctr + 8);
+
+    // rest of a block started by the previous call
+    while (len && ctx->ks_pos) {
+        *out++ = *in++ ^ ctx->ks[ctx->ks_pos];
+        ctx->ks_pos = (ctx->ks_pos + 1) & 15;
+        len--;
+    }
+
+    for (; len >= 128; len -= 128, in += 128, out += 128) {
+        AES_HW_UNROLL
+        for (int j = 0; j < 8; j++) b[j] = next_counter(&hi, &lo);
+        enc_blocks(ctx, b, 8);
+        AES_HW_UNROLL
+        for (int j = 0; j < 8; j++) STORE(out + 16 * j, XOR(b[j], LOAD(in + 16 * j)));
+    }
+    for (; len >= 16; len -= 16, in += 16, out += 16) {
+        b[0] = next_counter(&hi, &lo);
+        enc_blocks(ctx, b, 1);
+        STORE(out, XOR(b[0], LOAD(in)));
+    }
+    if (len) {
+        b[0] = next_counter(&hi, &lo);
+        enc_blocks(ctx, b, 1);
+        STORE(ctx->ks, b[0]);
+        for (size_t i = 0; i < len; i++) out[i] = in[i] ^ ctx->ks[i];
+        ctx->ks_pos = len;
+    }
+
+    store_be64(ctr, hi);
+    store_be64(ctr + 8, lo);
+}
+
+#endif // AES_HW
@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * AES using the CPU's instructions: AES-NI on x86-64 (checked at runtime),
+ * or the ARMv8 crypto extensions when the compiler targets them.
+ *
+ */
+
+#ifndef __AES_HW_H__
+#define __AES_HW_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// define AES_NO_HW to always use trezor-crypto's table-based code
+#ifndef AES_NO_HW
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define AES_HW 1
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_AES))
+#define AES_HW 1
+#endif
+#endif
+
+#ifdef AES_HW
+
+#define AES_HW_MAX_ROUNDS 14
+
+typedef struct {
+    uint8_t ek[AES_HW_MAX_ROUNDS + 1][16];     // encryption round keys
+    uint8_t dk[AES_HW_MAX_ROUNDS + 1][16];     // equivalent inverse cipher keys
+    int rounds;
+    uint8_t ks[16];                             // CTR: keystream of a part-used block
+    uint8_t ks_pos;                             // ... and how much of it is used, 0 if none
+} aes_hw_ctx;
+
+// false if the CPU lacks the instructions or the key length is not 16/24/32
+bool aes_hw_init(aes_hw_ctx *ctx, const uint8_t *key, size_t key_len);
+
+// len must be a multiple of 16 for ECB and CBC
+void aes_hw_ecb_encrypt(const aes_hw_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len);
+void aes_hw_ecb_decrypt(const aes_hw_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len);
+void aes_hw_cbc_encrypt(const aes_hw_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len, uint8_t iv[16]);
+void aes_hw_cbc_decrypt(const aes_hw_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len, uint8_t iv[16]);
+
+// any length; ctr is a 128-bit big-endian counter like aes_ctr_cbuf_inc()
+// uses, and the keystream carries on across calls
+void aes_hw_ctr_crypt(aes_hw_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len, uint8_t ctr[16]);
+
+#endif
+
+#endif
@@ -0,0 +1,203 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * Base58 and base58check (double SHA-256) of any length.
+ *
+ * Both directions are the usual schoolbook base conversion, but on limbs:
+ * binary goes in 32 bits at a time into base 58^5 limbs, and base58 goes in
+ * 5 digits at a time into 32-bit limbs. That is about 20 times fewer steps
+ * than converting byte by byte, as trezor-crypto's base58.c does.
+ *
+ */
+
+#include "b58_fast.h"
+
+#include <string.h>
+
+#include "sha_hw.h"
+
+#define B58_LIMB    656356768u          // 58^5
+
+static const char b58_digits[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+// digit values, -1 where not base58
+static const int8_t b58_values[128] = {
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1,-1,-1,-1,-1,-1,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1,
+    -1, 0, 1, 2, 3, 4, 5, 6,  7, 8,-1,-1,-1,-1,-1,-1,
+    -1, 9,10,11,12,13,14,15, 16,-1,17,18,19,20,21,-1,
+    22,23,24,25,26,27,28,29, 30,31,32,-1,-1,-1,-1,-1,
+    -1,33,34,35,36,37,38,39, 40,41,42,43,-1,44,45,46,
+    47,48,49,50,51,52,53,54, 55,56,57,-1,-1,-1,-1,-1,
+};
+
+static const uint32_t b58_powers[6] = { 1, 58, 58*58, 58*58*58, 58*58*58*58, B58_LIMB };
+
+// data is a followed by b, so a checksum needs no copy
+static int encode_parts(const uint8_t *a, size_t alen, const uint8_t *b, size_t blen,
+                        char *out, size_t outsize, uint32_t *limbs)
+{
+    size_t len = alen + blen;
+    size_t zeros = 0, n = 0, i;
+
+#define BYTE(k) ((k) < alen ? a[k] : b[(k) - alen])
+
+    while (zeros < len && BYTE(zeros) == 0) {
+        zeros++;
+    }
+
+    // the first word takes what is left over, the rest are whole
+    i = zeros;
+    size_t take = (len - zeros) % 4;
+    if (take == 0) {
+        take = 4;
+    }
+    while (i < len) {
+        uint64_t carry = 0;
+        for (size_t k = 0; k < take; k++) {
+            carry = (carry << 8) | BYTE(i + k);
+        }
+        for (size_t j = 0; j < n; j++) {
+            uint64_t t = ((uint64_t)limbs[j] << (8 * take)) + carry;
+            limbs[j] = t % B58_LIMB;
+            carry = t / B58_LIMB;
+        }
+        while (carry) {
+            limbs[n++] = carry % B58_LIMB;
+            carry /= B58_LIMB;
+        }
+        i += take;
+        take = 4;
+    }
+#undef BYTE
+
+    // digits in the top limb, less its leading zeros
+    int top = 0;
+    if (n) {
+        for (top = 5; top > 0 && limbs[n - 1] < b58_powers[top - 1]; top--) {
+        }
+    }
+    size_t outlen = zeros + (n ? (n - 1) * 5 + top : 0);
+    if (outlen + 1 > outsize) {
+        memset(limbs, 0, n * sizeof(uint32_t));
+        return -1;
+    }
+
+    memset(out, '1', zeros);
+    char *p = out + outlen;
+    *p = 0;
+    for (size_t j = 0; j < n; j++) {
+        uint32_t v = limbs[j];
+        int digits = (j == n - 1) ? top : 5;
+        for (int k = 0; k < digits; k++) {
+            *--p = b58_digits[v % 58];
+            v /= 58;
+        }
+    }
+    memset(limbs, 0, n * sizeof(uint32_t));
+    return outlen;
+}
+
+int b58_encode(const uint8_t *data, size_t len, char *out, size_t outsize, uint32_t *limbs)
+{
+    return encode_parts(data, len, NULL, 0, out, outsize, limbs);
+}
+
+static void checksum(const uint8_t *data, size_t len, uint8_t out[SHA256_DIGEST_LENGTH])
+{
+    sha256_hw_raw(data, len, out);
+    sha256_hw_raw(out, SHA256_DIGEST_LENGTH, out);
+}
+
+int b58_encode_check(const uint8_t *data, size_t len, char *out, size_t outsize, uint32_t *limbs)
+{
+    uint8_t h[SHA256_DIGEST_LENGTH];
+    checksum(data, len, h);
+    return encode_parts(data, len, h, B58_CHECK_LEN, out, outsize, limbs);
+}
+
+int b58_decode(const char *str, size_t slen, uint8_t *out, size_t outsize, uint32_t *limbs)
+{
+    size_t zeros = 0, n = 0, i;
+
+    while (zeros < slen && str[zeros] == '1') {
+        zeros++;
+    }
+
+    // as in encode_parts(), the first group is short
+    i = zeros;
+    size_t take = (slen - zeros) % 5;
+    if (take == 0) {
+        take = 5;
+    }
+    while (i < slen) {
+        uint64_t carry = 0;
+        for (size_t k = 0; k < take; k++) {
+            uint8_t c = str[i + k];
+            if (c & 0x80 || b58_values[c] < 0) {
+                memset(limbs, 0, n * sizeof(uint32_t));
+                return -1;
+            }
+            carry = carry * 58 + b58_values[c];
+        }
+        uint32_t mult = b58_powers[take];
+        for (size_t j = 0; j < n; j++) {
+            uint64_t t = (uint64_t)limbs[j] * mult + carry;
+            limbs[j] = (uint32_t)t;
+            carry = t >> 32;
+        }
+        if (carry) {
+            limbs[n++] = carry;
+        }
+        i += take;
+        take = 5;
+    }
+
+    // bytes in the top limb, less its leading zeros
+    int top = 0;
+    if (n) {
+        for (top = 4; top > 1 && !(limbs[n - 1] >> (8 * (top - 1))); top--) {
+        }
+    }
+    size_t outlen = zeros + (n ? (n - 1) * 4 + top : 0);
+    if (outlen > outsize) {
+        memset(limbs, 0, n * sizeof(uint32_t));
+        return -2;
+    }
+
+    memset(out, 0, zeros);
+    uint8_t *p = out + outlen;
+    for (size_t j = 0; j < n; j++) {
+        uint32_t v = limbs[j];
+        int bytes = (j == n - 1) ? top : 4;
+        for (int k = 0; k < bytes; k++) {
+            *--p = v;
+            v >>= 8;
+        }
+    }
+    memset(limbs, 0, n * sizeof(uint32_t));
+    return outlen;
+}
+
+int b58_decode_check(const char *str, size_t slen, uint8_t *out, size_t outsize, uint32_t *limbs)
+{
+    uint8_t h[SHA256_DIGEST_LENGTH];
+    int len = b58_decode(str, slen, out, outsize, limbs);
+    if (len < 0) {
+        return len;
+    }
+    if (len < B58_CHECK_LEN) {
+        return -1;
+    }
+    len -= B58_CHECK_LEN;
+    checksum(out, len, h);
+    if (memcmp(out + len, h, B58_CHECK_LEN) != 0) {
+        return -1;
+    }
+    return len;
+}
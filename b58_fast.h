@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * Base58 and base58check (double SHA-256) of any length, converting 32 bits
+ * of binary or 5 base58 digits per step.
+ *
+ */
+
+#ifndef __B58_FAST_H__
+#define __B58_FAST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Room needed for len bytes, or a string of len characters. Encoded sizes
+// include the NUL; the _check forms need B58_CHECK_LEN more in the input.
+#define B58_CHECK_LEN           4
+#define B58_ENCODED_MAX(len)    ((len) * 138 / 100 + 2)
+#define B58_DECODED_MAX(len)    (len)           // leading 1s are a byte each
+
+// Scratch, in 32-bit words, for encoding len bytes / decoding len characters.
+#define B58_ENCODE_LIMBS(len)   ((len) * 8 / 29 + 2)
+#define B58_DECODE_LIMBS(len)   ((len) * 3 / 16 + 2)
+
+// Write the NUL-terminated encoding of data into out (outsize bytes, with
+// limbs as scratch); returns the string length, or -1 if out is too small.
+int b58_encode(const uint8_t *data, size_t len, char *out, size_t outsize, uint32_t *limbs);
+int b58_encode_check(const uint8_t *data, size_t len, char *out, size_t outsize, uint32_t *limbs);
+
+// Decode str (slen characters) into out; returns the number of bytes, -1
+// for a bad character or checksum, or -2 if out is too small. The _check
+// form needs B58_CHECK_LEN bytes more room in out than it returns.
+int b58_decode(const char *str, size_t slen, uint8_t *out, size_t outsize, uint32_t *limbs);
+int b58_decode_check(const char *str, size_t slen, uint8_t *out, size_t outsize, uint32_t *limbs);
+
+#endif
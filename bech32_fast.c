@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * Bech32 (BIP173) and bech32m (BIP350) in fixed-size buffers.
+ *
+ * The checksum takes each 5-bit value with one table lookup, rather than
+ * five conditional XORs, and 8/5-bit regrouping moves 40 bits at a time.
+ *
+ */
+
+#include "bech32_fast.h"
+
+#include <stdbool.h>
+#include <string.h>
+
+#define BECH32_CONST    1
+#define BECH32M_CONST   0x2bc830a3
+
+static const char charset[] = "qpzry9x8gf2tvdw0s3jn54khce6mua7l";
+
+// value of each character, -1 if not in charset (either case)
+static const int8_t charset_rev[128] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    15, -1, 10, 17, 21, 20, 26, 30,  7,  5, -1, -1, -1, -1, -1, -1,
+    -1, 29, -1, 24, 13, 25,  9,  8, 23, -1, 18, 22, 31, 27, 19, -1,
+     1,  0,  3, 16, 11, 28, 12, 14,  6,  4,  2, -1, -1, -1, -1, -1,
+    -1, 29, -1, 24, 13, 25,  9,  8, 23, -1, 18, 22, 31, 27, 19, -1,
+     1,  0,  3, 16, 11, 28, 12, 14,  6,  4,  2, -1, -1, -1, -1, -1
+};
+
+// XOR of the generators selected by each value of the top 5 bits
+static const uint32_t polymod_table[32] = {
+    0x00000000, 0x3b6a57b2, 0x26508e6d, 0x1d3ad9df, 0x1ea119fa, 0x25cb4e48, 0x38f19797, 0x039bc025,
+    0x3d4233dd, 0x0628646f, 0x1b12bdb0, 0x2078ea02, 0x23e32a27, 0x18897d95, 0x05b3a44a, 0x3ed9f3f8,
+    0x2a1462b3, 0x117e3501, 0x0c44ecde, 0x372ebb6c, 0x34b57b49, 0x0fdf2cfb, 0x12e5f524, 0x298fa296,
+    0x1756516e, 0x2c3c06dc, 0x3106df03, 0x0a6c88b1, 0x09f74894, 0x329d1f26, 0x2fa7c6f9, 0x14cd914b,
+};
+
+static inline uint32_t polymod_step(uint32_t c, uint8_t v)
+{
+    return ((c & 0x1ffffff) << 5) ^ v ^ polymod_table[c >> 25];
+}
+
+// checksum state after the (lowercase) hrp
+static uint32_t polymod_hrp(const char *hrp, size_t hrp_len)
+{
+    uint32_t c = 1;
+    for (size_t i = 0; i < hrp_len; i++) {
+        c = polymod_step(c, (uint8_t)hrp[i] >> 5);
+    }
+    c = polymod_step(c, 0);
+    for (size_t i = 0; i < hrp_len; i++) {
+        c = polymod_step(c, hrp[i] & 31);
+    }
+    return c;
+}
+
+int bech32_fast_encode(char *out, const char *hrp, size_t hrp_len, const uint8_t *data, size_t data_len, int variant)
+{
+    if (hrp_len < 1 || hrp_len + 1 + data_len + 6 > BECH32_MAX_LEN) {
+        return -1;
+    }
+
+    char *p = out;
+    for (size_t i = 0; i < hrp_len; i++) {
+        char ch = hrp[i];
+        if (ch < 33 || ch > 126) {
+            return -1;
+        }
+        if (ch >= 'A' && ch <= 'Z') {
+            ch += 'a' - 'A';
+        }
+        *p++ = ch;
+    }
+    uint32_t c = polymod_hrp(out, hrp_len);
+    *p++ = '1';
+    for (size_t i = 0; i < data_len; i++) {
+        if (data[i] >> 5) {
+            return -1;
+        }
+        c = polymod_step(c, data[i]);
+        *p++ = charset[data[i]];
+    }
+    for (int i = 0; i < 6; i++) {
+        c = polymod_step(c, 0);
+    }
+    c ^= (variant == BECH32_FAST_BECH32M) ? BECH32M_CONST : BECH32_CONST;
+    for (int i = 0; i < 6; i++) {
+        *p++ = charset[(c >> (5 * (5 - i))) & 31];
+    }
+    *p = 0;
+    return p - out;
+}
+
+int bech32_fast_decode(const char *str, size_t len, char *hrp, uint8_t *data, size_t *data_len)
+{
+    bool lower = false, upper = false;
+    size_t sep = 0;
+
+    if (len < 8 || len > BECH32_MAX_LEN) {
+        return BECH32_FAST_NONE;
+    }
+    for (size_t i = 0; i < len; i++) {
+        char ch = str[i];
+        if (ch < 33 || ch > 126) {
+            return BECH32_FAST_NONE;
+        }
+        lower |= (ch >= 'a' && ch <= 'z');
+        upper |= (ch >= 'A' && ch <= 'Z');
+        if (ch == '1') {
+            sep = i;
+        }
+    }
+    if ((lower && upper) || sep < 1 || sep + 7 > len) {
+        return BECH32_FAST_NONE;
+    }
+
+    for (size_t i = 0; i < sep; i++) {
+        char ch = str[i];
+        hrp[i] = (ch >= 'A' && ch <= 'Z') ? ch + ('a' - 'A') : ch;
+    }
+    hrp[sep] = 0;
+
+    uint32_t c = polymod_hrp(hrp, sep);
+    size_t n = 0;
+    for (size_t i = sep + 1; i < len; i++) {
+        int8_t v = charset_rev[(uint8_t)str[i]];
+        if (v < 0) {
+            return BECH32_FAST_NONE;
+        }
+        c = polymod_step(c, v);
+        data[n++] = v;
+    }
+    *data_len = n - 6;
+
+    if (c == BECH32_CONST) {
+        return BECH32_FAST_BECH32;
+    }
+    if (c == BECH32M_CONST) {
+        return BECH32_FAST_BECH32M;
+    }
+    return BECH32_FAST_NONE;
+}
+
+// 8-bit bytes to 5-bit values, zero-padded; 5 bytes make 8 values
+static size_t regroup_8to5(const uint8_t *in, size_t len, uint8_t *out)
+{
+    size_t n = 0;
+    for (; len >= 5; in += 5, len -= 5) {
+        uint64_t w = ((uint64_t)in[0] << 32) | ((uint32_t)in[1] << 24) | (in[2] << 16) | (in[3] << 8) | in[4];
+        for (int k = 7; k >= 0; k--) {
+            out[n++] = (w >> (5 * k)) & 31;
+        }
+    }
+    if (len) {
+        uint64_t w = 0;
+        for (size_t i = 0; i < len; i++) {
+            w = (w << 8) | in[i];
+        }
+        int groups = (len * 8 + 4) / 5;
+        w <<= groups * 5 - len * 8;
+        for (int k = groups - 1; k >= 0; k--) {
+            out[n++] = (w >> (5 * k)) & 31;
+        }
+    }
+    return n;
+}
+
+// 5-bit values to bytes; -1 if the padding is more than 4 bits, or not zero
+static int regroup_5to8(const uint8_t *in, size_t len, uint8_t *out)
+{
+    int n = 0;
+    for (; len >= 8; in += 8, len -= 8) {
+        uint64_t w = 0;
+        for (int k = 0; k < 8; k++) {
+            w = (w << 5) | in[k];
+        }
+        for (int k = 4; k >= 0; k--) {
+            out[n++] = w >> (8 * k);
+        }
+    }
+    if (len) {
+        uint64_t w = 0;
+        for (size_t i = 0; i < len; i++) {
+            w = (w << 5) | in[i];
+        }
+        int bytes = len * 5 / 8;
+        int pad = len * 5 - bytes * 8;
+        if (pad >= 5 || (w & ((1u << pad) - 1))) {
+            return -1;
+        }
+        w >>= pad;
+        for (int k = bytes - 1; k >= 0; k--) {
+            out[n++] = w >> (8 * k);
+        }
+    }
+    return n;
+}
+
+int bech32_fast_segwit_encode(char *out, const char *hrp, size_t hrp_len, int version, const uint8_t *prog, size_t prog_len)
+{
+    uint8_t data[BECH32_MAX_LEN];
+
+    // version and program must fit, with hrp, separator and checksum
+    if (version < 0 || version > 31 || prog_len > (BECH32_MAX_LEN - 8) * 5 / 8) {
+        return -1;
+    }
+    data[0] = version;
+    size_t data_len = 1 + regroup_8to5(prog, prog_len, data + 1);
+    return bech32_fast_encode(out, hrp, hrp_len, data, data_len,
+                              version ? BECH32_FAST_BECH32M : BECH32_FAST_BECH32);
+}
+
+int bech32_fast_segwit_decode(const char *str, size_t len, char *hrp, int *version, uint8_t *prog)
+{
+    uint8_t data[BECH32_MAX_LEN];
+    size_t data_len;
+
+    int variant = bech32_fast_decode(str, len, hrp, data, &data_len);
+    if (variant == BECH32_FAST_NONE) {
+        return -1;
+    }
+    if (data_len <= 1) {
+        return -2;
+    }
+    if (variant != (data[0] ? BECH32_FAST_BECH32M : BECH32_FAST_BECH32)) {
+        return -1;
+    }
+    int n = regroup_5to8(data + 1, data_len - 1, prog);
+    if (n < 0) {
+        return -3;
+    }
+    // BIP141: versions 0..16, programs of 2..40 bytes, and v0 is P2WPKH/P2WSH only
+    if (data[0] > 16 || n < 2 || n > 40 || (data[0] == 0 && n != 20 && n != 32)) {
+        return -4;
+    }
+    *version = data[0];
+    return n;
+}
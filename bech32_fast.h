@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * Bech32 (BIP173) and bech32m (BIP350) in fixed-size buffers, for segwit
+ * addresses.
+ *
+ */
+
+#ifndef __BECH32_FAST_H__
+#define __BECH32_FAST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+// longest string, as BIP173 allows
+#ifndef BECH32_MAX_LEN
+#define BECH32_MAX_LEN 90
+#endif
+
+// checksum variants
+#define BECH32_FAST_NONE        0
+#define BECH32_FAST_BECH32      1
+#define BECH32_FAST_BECH32M     2
+
+// Encode hrp (hrp_len characters, lowercased) and 5-bit values into out,
+// which needs BECH32_MAX_LEN + 1 bytes; returns the string length, or -1 if
+// the hrp is invalid or it all would not fit.
+int bech32_fast_encode(char *out, const char *hrp, size_t hrp_len, const uint8_t *data, size_t data_len, int variant);
+
+// Decode str into hrp (BECH32_MAX_LEN + 1 bytes, lowercased, NUL-terminated)
+// and 5-bit values (BECH32_MAX_LEN bytes); returns the checksum variant
+// found, or BECH32_FAST_NONE if str is invalid.
+int bech32_fast_decode(const char *str, size_t len, char *hrp, uint8_t *data, size_t *data_len);
+
+// Segwit address for version and program: bech32 for version 0, bech32m
+// after (BIP350). Returns the length, or -1 as bech32_fast_encode().
+int bech32_fast_segwit_encode(char *out, const char *hrp, size_t hrp_len, int version, const uint8_t *prog, size_t prog_len);
+
+// The reverse, into hrp (as above), version and prog (BECH32_MAX_LEN bytes).
+// Returns the program length; -1 if str is invalid, or uses the other
+// checksum variant than its version calls for; -2 if there is no version or
+// no program; -3 if the program's padding is wrong; -4 if the version or
+// program length isn't one segwit allows (BIP141).
+int bech32_fast_segwit_decode(const char *str, size_t len, char *hrp, int *version, uint8_t *prog);
+
+#endif
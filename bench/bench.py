@@ -0,0 +1,445 @@
+#
+# Benchmarks for the tcc module, run under the MicroPython unix port:
+#
+#   micropython bench/bench.py [--mhz N] [name ...]
+#
+# Reports ops/sec for every case, plus MB/s and cycles/byte for those that
+# consume data. Cycles are estimated from the CPU clock, which is read from
+# /proc/cpuinfo unless --mhz is given. Names select a subset by prefix.
+#
+import sys, time
+import tcc
+
+RUN_US = 500000         # time spent on each case
+
+def cpu_mhz():
+    try:
+        with open('/proc/cpuinfo') as fd:
+            for ln in fd:
+                if ln.startswith('cpu MHz'):
+                    return float(ln.split(':')[1])
+    except OSError:
+        pass
+    return 0
+
+def measure(fn):
+    # warm up, then repeat until RUN_US has passed
+    fn()
+    n = 0
+    t0 = time.ticks_us()
+    while 1:
+        fn()
+        n += 1
+        dt = time.ticks_diff(time.ticks_us(), t0)
+        if dt >= RUN_US:
+            return n, dt
+
+def report(name, n, dt, nbytes, mhz):
+    ops = n * 1000000 / dt
+    ln = '%-32s %12.1f ops/s' % (name, ops)
+    if nbytes:
+        ln += ' %10.2f MB/s' % (ops * nbytes / 1000000)
+        if mhz:
+            ln += ' %10.2f cyc/B' % (mhz * dt / (n * nbytes))
+    elif mhz:
+        ln += ' %14d cyc/op' % int(mhz * dt / n)
+    print(ln)
+
+#
+# cases: (name, setup) where setup() returns (fn, bytes per call)
+#
+
+def hasher(cls, size):
+    def setup():
+        msg = bytes(size)
+        def fn():
+            cls(msg).digest()
+        return fn, size
+    return setup
+
+def hasher_reuse(cls, size):
+    def setup():
+        msg = bytes(size)
+        h = cls()
+        out = bytearray(h.digest_size)
+        def fn():
+            h.reset()
+            h.update(msg)
+            h.digest_into(out)
+        return fn, size
+    return setup
+
+def oneshot(fn, size):
+    def setup():
+        msg = bytes(size)
+        def f():
+            fn(msg)
+        return f, size
+    return setup
+
+def hash_many(fn, count, size):
+    def setup():
+        items = [bytes(size)] * count
+        def f():
+            fn(items)
+        return f, count * size
+    return setup
+
+def aes(mode, size, direction=tcc.AES.Encrypt):
+    def setup():
+        key = bytes(range(32))
+        a = tcc.AES(mode | direction, key, bytes(16))
+        msg = bytes(size)
+        def fn():
+            a.update(msg)
+        return fn, size
+    return setup
+
+def aes_into(mode, size):
+    def setup():
+        a = tcc.AES(mode | tcc.AES.Encrypt, bytes(range(32)), bytes(16))
+        buf = bytearray(size)
+        def fn():
+            a.update_into(buf, buf)
+        return fn, size
+    return setup
+
+def aesgcm(size):
+    def setup():
+        g = tcc.AESGCM(bytes(32), bytes(12))
+        buf = bytearray(size)
+        def fn():
+            g.encrypt_into(buf, buf)
+        return fn, size
+    return setup
+
+def chacha(size):
+    def setup():
+        c = tcc.chacha20poly1305(bytes(32), bytes(12))
+        msg = bytes(size)
+        def fn():
+            c.encrypt(msg)
+        return fn, size
+    return setup
+
+def chacha_into(size):
+    def setup():
+        c = tcc.chacha20poly1305(bytes(32), bytes(12))
+        buf = bytearray(size)
+        def fn():
+            c.encrypt_into(buf, buf)
+        return fn, size
+    return setup
+
+def chacha_seal(size, opening=False):
+    def setup():
+        c = tcc.chacha20poly1305(bytes(32), bytes(12))
+        nonce = bytes(12)
+        sealed = c.seal(nonce, b'hdr', bytes(size))
+        if opening:
+            return (lambda: c.open(nonce, b'hdr', sealed)), size
+        msg = bytes(size)
+        return (lambda: c.seal(nonce, b'hdr', msg)), size
+    return setup
+
+def chacha_stream(size, segment, threads=0):
+    def setup():
+        c = tcc.chacha20poly1305(bytes(32), bytes(24))
+        prefix = bytes(19)
+        msg = bytes(size)
+        def fn():
+            c.stream_encrypt(prefix, msg, segment, 0, True, threads)
+        return fn, size
+    return setup
+
+def crc32(size):
+    def setup():
+        msg = bytes(size)
+        def fn():
+            tcc.crc.crc32(msg)
+        return fn, size
+    return setup
+
+SK = b'\x01' * 32
+DIGEST = b'\x02' * 32
+
+def secp_sign():
+    def fn():
+        tcc.secp256k1.sign(SK, DIGEST)
+    return fn, 0
+
+def secp_verify():
+    pk = tcc.secp256k1.publickey(SK)
+    sig = tcc.secp256k1.sign(SK, DIGEST)
+    def fn():
+        tcc.secp256k1.verify(pk, sig, DIGEST)
+    return fn, 0
+
+def secp_verify_batch(count):
+    def setup():
+        pk = tcc.secp256k1.publickey(SK)
+        sig = tcc.secp256k1.sign(SK, DIGEST)
+        items = [(pk, sig, DIGEST)] * count
+        def fn():
+            tcc.secp256k1.verify_batch(items)
+        return fn, 0
+    return setup
+
+def secp_pubkey():
+    def fn():
+        tcc.secp256k1.publickey(SK)
+    return fn, 0
+
+def ed25519_signed(count):
+    sks = [bytes([i + 1]) * 32 for i in range(count)]
+    pks = [tcc.ed25519.publickey(sk) for sk in sks]
+    msgs = [DIGEST + bytes([i]) for i in range(count)]
+    sigs = [tcc.ed25519.sign(sk, m) for sk, m in zip(sks, msgs)]
+    return pks, sigs, msgs
+
+def ed25519_verify(count, batch):
+    def setup():
+        pks, sigs, msgs = ed25519_signed(count)
+        if batch:
+            return (lambda: tcc.ed25519.verify_batch(pks, sigs, msgs)), 0
+        def fn():
+            for i in range(count):
+                tcc.ed25519.verify(pks[i], sigs[i], msgs[i])
+        return fn, 0
+    return setup
+
+def ed25519_sign(count, keyed):
+    def setup():
+        sk = bytes(range(32))
+        msgs = [DIGEST + bytes([i]) for i in range(count)]
+        if keyed:
+            key = tcc.ed25519.SigningKey(sk)
+            return (lambda: key.sign_many(msgs)), 0
+        def fn():
+            for m in msgs:
+                tcc.ed25519.sign(sk, m)
+        return fn, 0
+    return setup
+
+def secp_precomputed(level, setup):
+    def wrapped():
+        tcc.secp256k1.precompute(level)
+        return setup()
+    return wrapped
+
+def hd_derive(public):
+    def setup():
+        root = tcc.bip32.from_seed(bytes(64), 'secp256k1')
+        if public:
+            root = tcc.bip32.deserialize(root.serialize_public(0x0488B21E), 0x0488B21E, 0x0488ADE4)
+        idx = [0]
+        def fn():
+            n = root.clone()
+            n.derive(idx[0])
+            idx[0] = (idx[0] + 1) & 0x7fffffff
+        return fn, 0
+    return setup
+
+def hd_scan(cache_size):
+    # receive addresses m/84'/0'/0'/0/i, each from the root
+    H = 0x80000000
+    def setup():
+        tcc.bip32.cache_clear()
+        tcc.bip32.cache_configure(cache_size)
+        root = tcc.bip32.from_seed(bytes(64), 'secp256k1')
+        idx = [0]
+        def fn():
+            n = root.clone()
+            n.derive_path([84|H, 0|H, 0|H, 0, idx[0]])
+            idx[0] = (idx[0] + 1) & 0x7fffffff
+        return fn, 0
+    return setup
+
+def hd_range(kind, count):
+    def setup():
+        root = tcc.bip32.from_seed(bytes(64), 'secp256k1')
+        def fn():
+            root.derive_range(0, count, kind)
+        return fn, 0
+    return setup
+
+def hd_bulk_scan(count, threads):
+    def setup():
+        root = tcc.bip32.from_seed(bytes(64), 'secp256k1')
+        targets = bytes(20 * 20)
+        def fn():
+            tcc.bip32.scan(root, [0], 0, count, targets, threads)
+        return fn, 0
+    return setup
+
+def hd_restore(binary):
+    def setup():
+        root = tcc.bip32.from_seed(bytes(64), 'secp256k1')
+        root.derive_path([84|0x80000000, 0x80000000, 0x80000000])
+        if binary:
+            data = root.to_bytes(True)
+            def fn():
+                tcc.bip32.from_bytes(data)
+        else:
+            data = root.serialize_private(0x0488ADE4)
+            def fn():
+                tcc.bip32.deserialize(data, 0x0488B21E, 0x0488ADE4)
+        return fn, 0
+    return setup
+
+def hd_describe():
+    # pubkey, fingerprint and address of a fresh child, back to back
+    def setup():
+        root = tcc.bip32.from_seed(bytes(64), 'secp256k1')
+        idx = [0]
+        def fn():
+            n = root.clone()
+            n.derive(idx[0])
+            n.public_key()
+            n.my_fingerprint()
+            n.address(0)
+            idx[0] = (idx[0] + 1) & 0x7fffffff
+        return fn, 0
+    return setup
+
+def b58(decode, count=0):
+    # xpub-sized: 78 bytes and checksum
+    def setup():
+        data = bytes(range(1, 79))
+        enc = tcc.codecs.b58_encode(data)
+        if count:
+            if decode:
+                items = [enc] * count
+                fn = lambda: tcc.codecs.b58_decode_many(items)
+            else:
+                items = [data] * count
+                fn = lambda: tcc.codecs.b58_encode_many(items)
+            return fn, 78 * count
+        if decode:
+            return (lambda: tcc.codecs.b58_decode(enc)), 78
+        return (lambda: tcc.codecs.b58_encode(data)), 78
+    return setup
+
+def bech32(version, decode, count=0):
+    # p2wpkh for version 0, p2tr after
+    def setup():
+        prog = bytes(range(20 if version == 0 else 32))
+        if count:
+            items = [prog] * count
+            return (lambda: tcc.codecs.bech32_encode_many('bc', version, items)), len(prog) * count
+        if decode:
+            enc = tcc.codecs.bech32_encode('bc', version, prog)
+            return (lambda: tcc.codecs.bech32_decode(enc)), len(prog)
+        return (lambda: tcc.codecs.bech32_encode('bc', version, prog)), len(prog)
+    return setup
+
+def pbkdf2(prf, iters):
+    def setup():
+        def fn():
+            tcc.pbkdf2(prf, b'password', b'salt', iters).key()
+        return fn, 0
+    return setup
+
+def bip39_words(fn_name):
+    def setup():
+        words = tcc.bip39.from_data(bytes(range(32)))
+        if fn_name == 'decode_words':
+            return (lambda: tcc.bip39.decode_words(words)), 0
+        last = words.split()[-1]
+        return (lambda: tcc.bip39.lookup_word(last)), 0
+    return setup
+
+def bip39_seed_many(count):
+    def setup():
+        words = tcc.bip39.from_data(bytes(16))
+        phrases = ['pass%d' % i for i in range(count)]
+        def fn():
+            tcc.bip39.seed_many(words, phrases)
+        return fn, 0
+    return setup
+
+CASES = [
+    ('sha256 64B', hasher(tcc.sha256, 64)),
+    ('sha256 4KiB', hasher(tcc.sha256, 4096)),
+    ('sha256 64B reset/digest_into', hasher_reuse(tcc.sha256, 64)),
+    ('sha1 4KiB', hasher(tcc.sha1, 4096)),
+    ('sha512 64B', hasher(tcc.sha512, 64)),
+    ('sha512 4KiB', hasher(tcc.sha512, 4096)),
+    ('hash160 33B', oneshot(tcc.hash160, 33)),
+    ('sha256d 64B', oneshot(tcc.sha256d, 64)),
+    ('sha256 hash_many 64x64B', hash_many(tcc.sha256.hash_many, 64, 64)),
+    ('sha256d hash_many 64x32B', hash_many(tcc.Sha256d.hash_many, 64, 32)),
+    ('sha512 hash_many 64x64B', hash_many(tcc.sha512.hash_many, 64, 64)),
+    ('blake2b 64B', hasher(tcc.blake2b, 64)),
+    ('blake2b 4KiB', hasher(tcc.blake2b, 4096)),
+    ('ripemd160 64B', hasher(tcc.ripemd160, 64)),
+    ('aes-ecb 4KiB', aes(tcc.AES.ECB, 4096)),
+    ('aes-cbc 4KiB', aes(tcc.AES.CBC, 4096)),
+    ('aes-cbc-decrypt 4KiB', aes(tcc.AES.CBC, 4096, tcc.AES.Decrypt)),
+    ('aes-ctr 4KiB', aes(tcc.AES.CTR, 4096)),
+    ('aes-ctr 4KiB in-place', aes_into(tcc.AES.CTR, 4096)),
+    ('aes-gcm 4KiB in-place', aesgcm(4096)),
+    ('chacha20poly1305 4KiB', chacha(4096)),
+    ('chacha20poly1305 4KiB in-place', chacha_into(4096)),
+    ('chacha20poly1305 64KiB in-place', chacha_into(65536)),
+    ('chacha20poly1305 256B', chacha(256)),
+    ('chacha20poly1305 seal 256B', chacha_seal(256)),
+    ('chacha20poly1305 open 256B', chacha_seal(256, True)),
+    ('chacha20poly1305 stream 1MiB/64KiB 1 thread', chacha_stream(1 << 20, 65536, 1)),
+    ('chacha20poly1305 stream 1MiB/64KiB', chacha_stream(1 << 20, 65536)),
+    ('crc32 4KiB', crc32(4096)),
+    ('secp256k1 publickey', secp_pubkey),
+    ('secp256k1 sign', secp_sign),
+    ('secp256k1 verify', secp_verify),
+    ('secp256k1 verify_batch x64', secp_verify_batch(64)),
+    ('ed25519 sign x64', ed25519_sign(64, False)),
+    ('ed25519 SigningKey.sign_many x64', ed25519_sign(64, True)),
+    ('ed25519 verify x64', ed25519_verify(64, False)),
+    ('ed25519 verify_batch x64', ed25519_verify(64, True)),
+    ('hdnode derive private', hd_derive(False)),
+    ('hdnode derive public', hd_derive(True)),
+    ('hdnode derive+describe', hd_describe()),
+    ('hdnode derive_range x100 pubkey', hd_range(tcc.bip32.HDNode.PUBKEY, 100)),
+    ('hdnode derive_range x100 hash160', hd_range(tcc.bip32.HDNode.HASH160, 100)),
+    ('hdnode deserialize', hd_restore(False)),
+    ('hdnode from_bytes', hd_restore(True)),
+    ('bip32 scan x1000 1 thread', hd_bulk_scan(1000, 1)),
+    ('bip32 scan x1000', hd_bulk_scan(1000, 0)),
+    ('hdnode scan no-cache', hd_scan(0)),
+    ('hdnode scan', hd_scan(tcc.bip32.cache_stats()[2])),
+    ('b58 encode 78B', b58(False)),
+    ('b58 decode 78B', b58(True)),
+    ('b58 encode_many x100', b58(False, 100)),
+    ('b58 decode_many x100', b58(True, 100)),
+    ('bech32 encode p2wpkh', bech32(0, False)),
+    ('bech32 decode p2wpkh', bech32(0, True)),
+    ('bech32m encode p2tr', bech32(1, False)),
+    ('bech32m decode p2tr', bech32(1, True)),
+    ('bech32m encode_many x100', bech32(1, False, 100)),
+    ('pbkdf2 hmac-sha512 2048', pbkdf2('hmac-sha512', 2048)),
+    ('bip39 seed_many x16', bip39_seed_many(16)),
+    ('bip39 lookup_word', bip39_words('lookup_word')),
+    ('bip39 decode_words x24', bip39_words('decode_words')),
+    # these turn the k*G table off, so keep them last
+    ('secp256k1 publickey no-table', secp_precomputed(0, secp_pubkey)),
+    ('secp256k1 sign no-table', secp_precomputed(0, secp_sign)),
+]
+
+def main(args):
+    mhz = 0
+    if '--mhz' in args:
+        i = args.index('--mhz')
+        mhz = float(args[i+1])
+        del args[i:i+2]
+    else:
+        mhz = cpu_mhz()
+
+    print('# cpu: %s MHz' % (mhz or 'unknown'))
+    for name, setup in CASES:
+        if args and not any(name.startswith(a) for a in args):
+            continue
+        fn, nbytes = setup()
+        n, dt = measure(fn)
+        report(name, n, dt, nbytes, mhz)
+
+main(sys.argv[1:])
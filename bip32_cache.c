@@ -0,0 +1,190 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * LRU cache of BIP32 child nodes, for private and public derivation.
+ *
+ * An entry is found by everything that determines the child: the parent's
+ * curve, depth, chain code and key (private key and extension, or public key
+ * for a public-only parent), plus the index. Matching on all of it means a
+ * node can only get children it could have derived itself; in particular a
+ * public node never sees a private child. Key material is compared in
+ * constant time.
+ *
+ * The parent's fingerprint is worked out only for callers that ask for it
+ * (usually just for the last step of a path), and is then kept with the
+ * child, which saves computing the parent's public key again on a hit.
+ *
+ */
+
+#include "bip32_cache.h"
+
+#include <string.h>
+
+#if BIP32_CACHE_SIZE > 0
+
+typedef struct {
+    // parent
+    const curve_info *curve;
+    uint32_t depth;
+    bool have_private;
+    uint8_t chain_code[32];
+    uint8_t key[33];                    // private key, or public key
+    uint8_t key_ext[32];                // private_key_extension
+    uint32_t index;
+
+    HDNode child;
+    uint32_t fingerprint;               // of the parent, if have_fingerprint
+    bool have_fingerprint;
+    uint32_t used;                      // LRU stamp, 0 if the entry is free
+} cache_entry;
+
+static cache_entry cache[BIP32_CACHE_SIZE];
+static int cache_size = BIP32_CACHE_SIZE;
+static uint32_t tick, hits, misses;
+
+static bool ct_equal(const uint8_t *a, const uint8_t *b, size_t len)
+{
+    uint8_t diff = 0;
+    for (size_t i = 0; i < len; i++) diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+// record what identifies node as a parent
+static void set_parent(cache_entry *e, const HDNode *node, bool have_private, uint32_t index)
+{
+    e->curve = node->curve;
+    e->depth = node->depth;
+    e->have_private = have_private;
+    memcpy(e->chain_code, node->chain_code, 32);
+    if (have_private) {
+        memcpy(e->key, node->private_key, 32);
+        e->key[32] = 0;
+        memcpy(e->key_ext, node->private_key_extension, 32);
+    } else {
+        memcpy(e->key, node->public_key, 33);
+        memset(e->key_ext, 0, 32);
+    }
+    e->index = index;
+}
+
+static bool same_parent(const cache_entry *a, const cache_entry *b)
+{
+    // check everything, not stopping at the first difference
+    bool same = (a->curve == b->curve) & (a->depth == b->depth)
+                & (a->have_private == b->have_private) & (a->index == b->index);
+    same &= ct_equal(a->chain_code, b->chain_code, 32);
+    same &= ct_equal(a->key, b->key, 33);
+    same &= ct_equal(a->key_ext, b->key_ext, 32);
+    return same;
+}
+
+int bip32_cache_ckd(HDNode *node, bool have_private, uint32_t index, uint32_t *fingerprint)
+{
+    cache_entry probe;
+    cache_entry *victim = NULL;
+    int res;
+
+    if (cache_size == 0) {
+        if (fingerprint) {
+            *fingerprint = hdnode_fingerprint(node);
+        }
+        return have_private ? hdnode_private_ckd(node, index) : hdnode_public_ckd(node, index);
+    }
+
+    if (++tick == 0) {
+        // stamps wrapped: start again rather than evict the wrong entries
+        memset(cache, 0, sizeof(cache));
+        tick = 1;
+    }
+
+    set_parent(&probe, node, have_private, index);
+    for (int i = 0; i < cache_size; i++) {
+        cache_entry *e = &cache[i];
+        if (e->used && same_parent(e, &probe)) {
+            e->used = tick;
+            if (fingerprint) {
+                if (!e->have_fingerprint) {
+                    e->fingerprint = hdnode_fingerprint(node);
+                    e->have_fingerprint = true;
+                }
+                *fingerprint = e->fingerprint;
+            }
+            *node = e->child;
+            hits++;
+            memset(&probe, 0, sizeof(probe));
+            return 1;
+        }
+        if (!victim || e->used < victim->used) {
+            victim = e;
+        }
+    }
+
+    misses++;
+    probe.have_fingerprint = (fingerprint != NULL);
+    probe.fingerprint = fingerprint ? hdnode_fingerprint(node) : 0;
+    res = have_private ? hdnode_private_ckd(node, index) : hdnode_public_ckd(node, index);
+    if (res) {
+        probe.child = *node;
+        probe.used = tick;
+        *victim = probe;
+        if (fingerprint) {
+            *fingerprint = probe.fingerprint;
+        }
+    }
+    memset(&probe, 0, sizeof(probe));
+    return res;
+}
+
+bool bip32_cache_configure(int size)
+{
+    if (size < 0 || size > BIP32_CACHE_SIZE) {
+        return false;
+    }
+    memset(&cache[size], 0, sizeof(cache_entry) * (BIP32_CACHE_SIZE - size));
+    cache_size = size;
+    return true;
+}
+
+void bip32_cache_clear(void)
+{
+    memset(cache, 0, sizeof(cache));
+    tick = hits = misses = 0;
+}
+
+void bip32_cache_stats(uint32_t *hits_out, uint32_t *misses_out, int *size)
+{
+    *hits_out = hits;
+    *misses_out = misses;
+    *size = cache_size;
+}
+
+#else // BIP32_CACHE_SIZE
+
+int bip32_cache_ckd(HDNode *node, bool have_private, uint32_t index, uint32_t *fingerprint)
+{
+    if (fingerprint) {
+        *fingerprint = hdnode_fingerprint(node);
+    }
+    return have_private ? hdnode_private_ckd(node, index) : hdnode_public_ckd(node, index);
+}
+
+bool bip32_cache_configure(int size)
+{
+    return size == 0;
+}
+
+void bip32_cache_clear(void)
+{
+}
+
+void bip32_cache_stats(uint32_t *hits, uint32_t *misses, int *size)
+{
+    *hits = *misses = 0;
+    *size = 0;
+}
+
+#endif
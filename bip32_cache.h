@@ -0,0 +1,40 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * LRU cache of BIP32 child nodes, for private and public derivation.
+ *
+ */
+
+#ifndef __BIP32_CACHE_H__
+#define __BIP32_CACHE_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "bip32.h"
+
+// Entries to reserve (~330 bytes each); 0 turns the cache off.
+#ifndef BIP32_CACHE_SIZE
+#define BIP32_CACHE_SIZE 32
+#endif
+
+// Replaces node by its child at index, privately if have_private, else
+// publicly. Unless fingerprint is NULL, it gets the parent's fingerprint,
+// which is only worked out when asked for. Returns 0 if the derivation
+// fails, like hdnode_private_ckd(), leaving node undefined. Not thread-safe.
+int bip32_cache_ckd(HDNode *node, bool have_private, uint32_t index, uint32_t *fingerprint);
+
+// Use only the first size entries (at most BIP32_CACHE_SIZE), dropping the
+// others; false if size is out of range.
+bool bip32_cache_configure(int size);
+
+// Wipes every entry and the counters.
+void bip32_cache_clear(void);
+
+void bip32_cache_stats(uint32_t *hits, uint32_t *misses, int *size);
+
+#endif
@@ -0,0 +1,8 @@
+// Made by "make bip39_prefix.h" from bip39_english.h; do not edit.
+// Words starting with letter c are [bip39_bucket[c], bip39_bucket[c + 1]).
+
+static const uint16_t bip39_bucket[27] = {
+    0, 136, 253, 439, 551, 651, 757, 833, 897,
+    952, 972, 992, 1068, 1173, 1214, 1269, 1401, 1409,
+    1517, 1767, 1888, 1923, 1969, 2038, 2038, 2044, 2048
+};
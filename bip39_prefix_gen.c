@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * Host tool, run by "make bip39_prefix.h": prints the first-letter
+ * buckets of trezor-crypto's English BIP39 wordlist as a const table, for
+ * modtcc-bip39.c. Fails if the list isn't sorted lowercase words, which the
+ * binary search there relies on.
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "bip39_english.h"
+
+int main(void)
+{
+    int bucket[27] = { 0 };
+    int n;
+
+    for (n = 0; wordlist[n] != 0; n++) {
+        unsigned c = (unsigned char)wordlist[n][0] - 'a';
+        if (c >= 26 || (n > 0 && strcmp(wordlist[n - 1], wordlist[n]) >= 0)) {
+            fprintf(stderr, "bip39_english.h: \"%s\" out of order\n", wordlist[n]);
+            return 1;
+        }
+        bucket[c + 1]++;
+    }
+    for (int i = 1; i < 27; i++) {
+        bucket[i] += bucket[i - 1];
+    }
+
+    printf("// Made by \"make bip39_prefix.h\" from bip39_english.h; do not edit.\n");
+    printf("// Words starting with letter c are [bip39_bucket[c], bip39_bucket[c + 1]).\n\n");
+    printf("static const uint16_t bip39_bucket[27] = {");
+    for (int i = 0; i < 27; i++) {
+        printf("%s%d", (i % 9) ? ", " : (i ? ",\n    " : "\n    "), bucket[i]);
+    }
+    printf("\n};\n");
+
+    return 0;
+}
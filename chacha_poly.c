@@ -0,0 +1,826 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * ChaCha20-Poly1305 (RFC 7539).
+ *
+ * The SIMD code keeps 4 (SSE2, NEON) or 8 (AVX2) blocks in flight, one
+ * block per lane: register i holds word i of every block, so the rounds
+ * are the scalar code on vectors, and a transpose at the end puts each
+ * block's keystream back together. Lengths short of that many blocks, and
+ * other CPUs, use the plain C rounds.
+ *
+ * Poly1305 is poly1305-donna: three 44-bit limbs with 128-bit products, or
+ * five 26-bit limbs and 64-bit products. The 44-bit code takes two blocks
+ * per step, as (h + m1) * r^2 + m2 * r, so the two multiplications don't
+ * wait on each other and there is one carry chain per 32 bytes.
+ *
+ */
+
+#include "chacha_poly.h"
+
+#include <string.h>
+
+static inline uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void put_le32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+//
+// ChaCha20
+//
+
+#define ROTL32(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QR(a, b, c, d) \
+    a += b; d ^= a; d = ROTL32(d, 16); \
+    c += d; b ^= c; b = ROTL32(b, 12); \
+    a += b; d ^= a; d = ROTL32(d, 8); \
+    c += d; b ^= c; b = ROTL32(b, 7);
+
+static void chacha20_rounds(uint32_t x[16])
+{
+    for (int i = 0; i < 10; i++) {
+        QR(x[0], x[4], x[8], x[12])
+        QR(x[1], x[5], x[9], x[13])
+        QR(x[2], x[6], x[10], x[14])
+        QR(x[3], x[7], x[11], x[15])
+        QR(x[0], x[5], x[10], x[15])
+        QR(x[1], x[6], x[11], x[12])
+        QR(x[2], x[7], x[8], x[13])
+        QR(x[3], x[4], x[9], x[14])
+    }
+}
+
+static void chacha20_block(const uint32_t input[16], uint8_t out[64])
+{
+    uint32_t x[16];
+
+    memcpy(x, input, sizeof(x));
+    chacha20_rounds(x);
+    for (int i = 0; i < 16; i++) {
+        put_le32(out + 4 * i, x[i] + input[i]);
+    }
+    memset(x, 0, sizeof(x));
+}
+
+#ifdef CHACHA_SIMD
+
+// the same quarter rounds on whole registers, given V_ADD, V_XOR and V_ROTLn
+#define QR_V(a, b, c, d) \
+    a = V_ADD(a, b); d = V_ROTL16(V_XOR(d, a)); \
+    c = V_ADD(c, d); b = V_ROTL12(V_XOR(b, c)); \
+    a = V_ADD(a, b); d = V_ROTL8(V_XOR(d, a)); \
+    c = V_ADD(c, d); b = V_ROTL7(V_XOR(b, c));
+
+#define DOUBLE_ROUND_V(x) \
+    QR_V(x[0], x[4], x[8], x[12]) \
+    QR_V(x[1], x[5], x[9], x[13]) \
+    QR_V(x[2], x[6], x[10], x[14]) \
+    QR_V(x[3], x[7], x[11], x[15]) \
+    QR_V(x[0], x[5], x[10], x[15]) \
+    QR_V(x[1], x[6], x[11], x[12]) \
+    QR_V(x[2], x[7], x[8], x[13]) \
+    QR_V(x[3], x[4], x[9], x[14])
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+#define V_ADD(a, b)     _mm_add_epi32((a), (b))
+#define V_XOR(a, b)     _mm_xor_si128((a), (b))
+#define V_ROTL(v, n)    _mm_or_si128(_mm_slli_epi32((v), (n)), _mm_srli_epi32((v), 32 - (n)))
+#define V_ROTL16(v)     _mm_shufflehi_epi16(_mm_shufflelo_epi16((v), 0xb1), 0xb1)
+#define V_ROTL12(v)     V_ROTL((v), 12)
+#define V_ROTL8(v)      V_ROTL((v), 8)
+#define V_ROTL7(v)      V_ROTL((v), 7)
+
+// 4 blocks, 256 bytes
+__attribute__((target("sse2")))
+static void blocks4_sse2(uint32_t input[16], const uint8_t *in, uint8_t *out)
+{
+    __m128i s[16], x[16];
+
+    for (int i = 0; i < 16; i++) {
+        s[i] = _mm_set1_epi32(input[i]);
+    }
+    s[12] = _mm_add_epi32(s[12], _mm_set_epi32(3, 2, 1, 0));
+    memcpy(x, s, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        DOUBLE_ROUND_V(x)
+    }
+
+    for (int g = 0; g < 4; g++) {
+        __m128i a = V_ADD(x[4 * g], s[4 * g]);
+        __m128i b = V_ADD(x[4 * g + 1], s[4 * g + 1]);
+        __m128i c = V_ADD(x[4 * g + 2], s[4 * g + 2]);
+        __m128i d = V_ADD(x[4 * g + 3], s[4 * g + 3]);
+        __m128i t0 = _mm_unpacklo_epi32(a, b);
+        __m128i t1 = _mm_unpacklo_epi32(c, d);
+        __m128i t2 = _mm_unpackhi_epi32(a, b);
+        __m128i t3 = _mm_unpackhi_epi32(c, d);
+        __m128i r[4] = {
+            _mm_unpacklo_epi64(t0, t1), _mm_unpackhi_epi64(t0, t1),
+            _mm_unpacklo_epi64(t2, t3), _mm_unpackhi_epi64(t2, t3),
+        };
+        for (int j = 0; j < 4; j++) {
+            size_t off = 64 * j + 16 * g;
+            __m128i m = _mm_loadu_si128((const __m128i *)(in + off));
+            _mm_storeu_si128((__m128i *)(out + off), V_XOR(m, r[j]));
+        }
+    }
+    input[12] += 4;
+}
+
+#undef V_ADD
+#undef V_XOR
+#undef V_ROTL
+#undef V_ROTL16
+#undef V_ROTL12
+#undef V_ROTL8
+#undef V_ROTL7
+
+#define V_ADD(a, b)     _mm256_add_epi32((a), (b))
+#define V_XOR(a, b)     _mm256_xor_si256((a), (b))
+#define V_ROTL(v, n)    _mm256_or_si256(_mm256_slli_epi32((v), (n)), _mm256_srli_epi32((v), 32 - (n)))
+#define V_ROTL16(v)     _mm256_shuffle_epi8((v), rot16)
+#define V_ROTL12(v)     V_ROTL((v), 12)
+#define V_ROTL8(v)      _mm256_shuffle_epi8((v), rot8)
+#define V_ROTL7(v)      V_ROTL((v), 7)
+
+// 8 blocks, 512 bytes
+__attribute__((target("avx2")))
+static void blocks8_avx2(uint32_t input[16], const uint8_t *in, uint8_t *out)
+{
+    const __m256i rot16 = _mm256_set_epi8(13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2,
+                                          13, 12, 15, 14, 9, 8, 11, 10, 5, 4, 7, 6, 1, 0, 3, 2);
+    const __m256i rot8 = _mm256_set_epi8(14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3,
+                                         14, 13, 12, 15, 10, 9, 8, 11, 6, 5, 4, 7, 2, 1, 0, 3);
+    __m256i s[16], x[16], r[4][4];
+
+    for (int i = 0; i < 16; i++) {
+        s[i] = _mm256_set1_epi32(input[i]);
+    }
+    s[12] = _mm256_add_epi32(s[12], _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+    memcpy(x, s, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        DOUBLE_ROUND_V(x)
+    }
+
+    // as for SSE2 within each 128-bit lane: blocks 0-3 low, 4-7 high
+    for (int g = 0; g < 4; g++) {
+        __m256i a = V_ADD(x[4 * g], s[4 * g]);
+        __m256i b = V_ADD(x[4 * g + 1], s[4 * g + 1]);
+        __m256i c = V_ADD(x[4 * g + 2], s[4 * g + 2]);
+        __m256i d = V_ADD(x[4 * g + 3], s[4 * g + 3]);
+        __m256i t0 = _mm256_unpacklo_epi32(a, b);
+        __m256i t1 = _mm256_unpacklo_epi32(c, d);
+        __m256i t2 = _mm256_unpackhi_epi32(a, b);
+        __m256i t3 = _mm256_unpackhi_epi32(c, d);
+        r[g][0] = _mm256_unpacklo_epi64(t0, t1);
+        r[g][1] = _mm256_unpackhi_epi64(t0, t1);
+        r[g][2] = _mm256_unpacklo_epi64(t2, t3);
+        r[g][3] = _mm256_unpackhi_epi64(t2, t3);
+    }
+    for (int j = 0; j < 4; j++) {
+        __m256i k[4] = {
+            _mm256_permute2x128_si256(r[0][j], r[1][j], 0x20),     // block j
+            _mm256_permute2x128_si256(r[2][j], r[3][j], 0x20),
+            _mm256_permute2x128_si256(r[0][j], r[1][j], 0x31),     // block j + 4
+            _mm256_permute2x128_si256(r[2][j], r[3][j], 0x31),
+        };
+        for (int h = 0; h < 4; h++) {
+            size_t off = 64 * j + 256 * (h >> 1) + 32 * (h & 1);
+            __m256i m = _mm256_loadu_si256((const __m256i *)(in + off));
+            _mm256_storeu_si256((__m256i *)(out + off), V_XOR(m, k[h]));
+        }
+    }
+    input[12] += 8;
+}
+
+static size_t chacha20_xor_simd(uint32_t input[16], const uint8_t *in, uint8_t *out, size_t len)
+{
+    size_t done = 0;
+
+    if (len >= 512 && __builtin_cpu_supports("avx2")) {
+        for (; len - done >= 512; done += 512) {
+            blocks8_avx2(input, in + done, out + done);
+        }
+    }
+    for (; len - done >= 256; done += 256) {
+        blocks4_sse2(input, in + done, out + done);
+    }
+    return done;
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+
+#define V_ADD(a, b)     vaddq_u32((a), (b))
+#define V_XOR(a, b)     veorq_u32((a), (b))
+#define V_ROTL(v, n)    vsriq_n_u32(vshlq_n_u32((v), (n)), (v), 32 - (n))
+#define V_ROTL16(v)     vreinterpretq_u32_u16(vrev32q_u16(vreinterpretq_u16_u32(v)))
+#define V_ROTL12(v)     V_ROTL((v), 12)
+#define V_ROTL8(v)      V_ROTL((v), 8)
+#define V_ROTL7(v)      V_ROTL((v), 7)
+
+// 4 blocks, 256 bytes
+static void blocks4_neon(uint32_t input[16], const uint8_t *in, uint8_t *out)
+{
+    static const uint32_t lanes[4] = { 0, 1, 2, 3 };
+    uint32x4_t s[16], x[16];
+
+    for (int i = 0; i < 16; i++) {
+        s[i] = vdupq_n_u32(input[i]);
+    }
+    s[12] = vaddq_u32(s[12], vld1q_u32(lanes));
+    memcpy(x, s, sizeof(x));
+    for (int i = 0; i < 10; i++) {
+        DOUBLE_ROUND_V(x)
+    }
+
+    for (int g = 0; g < 4; g++) {
+        uint32x4x2_t t0 = vtrnq_u32(V_ADD(x[4 * g], s[4 * g]), V_ADD(x[4 * g + 1], s[4 * g + 1]));
+        uint32x4x2_t t1 = vtrnq_u32(V_ADD(x[4 * g + 2], s[4 * g + 2]), V_ADD(x[4 * g + 3], s[4 * g + 3]));
+        uint32x4_t r[4] = {
+            vcombine_u32(vget_low_u32(t0.val[0]), vget_low_u32(t1.val[0])),
+            vcombine_u32(vget_low_u32(t0.val[1]), vget_low_u32(t1.val[1])),
+            vcombine_u32(vget_high_u32(t0.val[0]), vget_high_u32(t1.val[0])),
+            vcombine_u32(vget_high_u32(t0.val[1]), vget_high_u32(t1.val[1])),
+        };
+        for (int j = 0; j < 4; j++) {
+            size_t off = 64 * j + 16 * g;
+            uint32x4_t m = vreinterpretq_u32_u8(vld1q_u8(in + off));
+            vst1q_u8(out + off, vreinterpretq_u8_u32(V_XOR(m, r[j])));
+        }
+    }
+    input[12] += 4;
+}
+
+static size_t chacha20_xor_simd(uint32_t input[16], const uint8_t *in, uint8_t *out, size_t len)
+{
+    size_t done = 0;
+
+    for (; len - done >= 256; done += 256) {
+        blocks4_neon(input, in + done, out + done);
+    }
+    return done;
+}
+
+#endif
+
+#endif // CHACHA_SIMD
+
+// XOR len bytes of keystream into in, from block input[12] on, and advance
+// the counter; a partial last block uses up the whole block
+static void chacha20_xor(uint32_t input[16], const uint8_t *in, uint8_t *out, size_t len)
+{
+    uint8_t ks[64];
+
+#ifdef CHACHA_SIMD
+    size_t done = chacha20_xor_simd(input, in, out, len);
+    in += done;
+    out += done;
+    len -= done;
+#endif
+    while (len) {
+        size_t n = (len < 64) ? len : 64;
+        chacha20_block(input, ks);
+        input[12]++;
+        for (size_t i = 0; i < n; i++) {
+            out[i] = in[i] ^ ks[i];
+        }
+        in += n;
+        out += n;
+        len -= n;
+    }
+    memset(ks, 0, sizeof(ks));
+}
+
+//
+// Poly1305
+//
+
+#ifdef POLY1305_64
+
+typedef unsigned __int128 uint128_t;
+
+#define M44 0xfffffffffffULL
+#define M42 0x3ffffffffffULL
+#define POLY1305_HIBIT ((uint64_t)1 << 40)
+
+static inline uint64_t get_le64(const uint8_t *p)
+{
+    return (uint64_t)get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+// message block as limbs; hibit is 0 for a padded last block
+#define LOAD_BLOCK(m, l0, l1, l2, hibit) do { \
+        uint64_t t0 = get_le64(m), t1 = get_le64((m) + 8); \
+        l0 = t0 & M44; \
+        l1 = ((t0 >> 44) | (t1 << 20)) & M44; \
+        l2 = ((t1 >> 24) & M42) | (hibit); \
+    } while (0)
+
+// d mod 2^130 - 5 back into h, leaving h0 a little over 44 bits
+#define CARRY(d0, d1, d2, h) do { \
+        uint64_t c; \
+        c = (uint64_t)(d0 >> 44); h[0] = (uint64_t)d0 & M44; \
+        d1 += c; c = (uint64_t)(d1 >> 44); h[1] = (uint64_t)d1 & M44; \
+        d2 += c; c = (uint64_t)(d2 >> 42); h[2] = (uint64_t)d2 & M42; \
+        h[0] += c * 5; c = h[0] >> 44; h[0] &= M44; h[1] += c; \
+    } while (0)
+
+static void poly1305_blocks(chacha_poly_mac *st, const uint8_t *m, size_t nblocks, uint64_t hibit)
+{
+    const uint64_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2];
+    const uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    const uint64_t q0 = st->r2[0], q1 = st->r2[1], q2 = st->r2[2];
+    const uint64_t p1 = q1 * (5 << 2), p2 = q2 * (5 << 2);
+    uint64_t h[3] = { st->h[0], st->h[1], st->h[2] };
+
+    for (; nblocks >= 2; nblocks -= 2, m += 32) {
+        uint64_t a0, a1, a2, b0, b1, b2;
+        LOAD_BLOCK(m, a0, a1, a2, hibit);
+        LOAD_BLOCK(m + 16, b0, b1, b2, hibit);
+        a0 += h[0];
+        a1 += h[1];
+        a2 += h[2];
+
+        uint128_t d0 = (uint128_t)a0 * q0 + (uint128_t)a1 * p2 + (uint128_t)a2 * p1
+                     + (uint128_t)b0 * r0 + (uint128_t)b1 * s2 + (uint128_t)b2 * s1;
+        uint128_t d1 = (uint128_t)a0 * q1 + (uint128_t)a1 * q0 + (uint128_t)a2 * p2
+                     + (uint128_t)b0 * r1 + (uint128_t)b1 * r0 + (uint128_t)b2 * s2;
+        uint128_t d2 = (uint128_t)a0 * q2 + (uint128_t)a1 * q1 + (uint128_t)a2 * q0
+                     + (uint128_t)b0 * r2 + (uint128_t)b1 * r1 + (uint128_t)b2 * r0;
+        CARRY(d0, d1, d2, h);
+    }
+    if (nblocks) {
+        uint64_t a0, a1, a2;
+        LOAD_BLOCK(m, a0, a1, a2, hibit);
+        a0 += h[0];
+        a1 += h[1];
+        a2 += h[2];
+
+        uint128_t d0 = (uint128_t)a0 * r0 + (uint128_t)a1 * s2 + (uint128_t)a2 * s1;
+        uint128_t d1 = (uint128_t)a0 * r1 + (uint128_t)a1 * r0 + (uint128_t)a2 * s2;
+        uint128_t d2 = (uint128_t)a0 * r2 + (uint128_t)a1 * r1 + (uint128_t)a2 * r0;
+        CARRY(d0, d1, d2, h);
+    }
+
+    st->h[0] = h[0];
+    st->h[1] = h[1];
+    st->h[2] = h[2];
+}
+
+static void poly1305_begin(chacha_poly_mac *st, const uint8_t key[32])
+{
+    uint64_t t0 = get_le64(key), t1 = get_le64(key + 8);
+
+    memset(st, 0, sizeof(*st));
+    st->r[0] = t0 & 0xffc0fffffffULL;
+    st->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xfffffc0ffffULL;
+    st->r[2] = (t1 >> 24) & 0x00ffffffc0fULL;
+
+    // r^2, the same way as a block
+    const uint64_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2];
+    const uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint128_t d0 = (uint128_t)r0 * r0 + (uint128_t)r1 * s2 + (uint128_t)r2 * s1;
+    uint128_t d1 = (uint128_t)r0 * r1 + (uint128_t)r1 * r0 + (uint128_t)r2 * s2;
+    uint128_t d2 = (uint128_t)r0 * r2 + (uint128_t)r1 * r1 + (uint128_t)r2 * r0;
+    CARRY(d0, d1, d2, st->r2);
+
+    for (int i = 0; i < 4; i++) {
+        st->pad[i] = get_le32(key + 16 + 4 * i);
+    }
+}
+
+static void poly1305_end(chacha_poly_mac *st, uint8_t mac[16])
+{
+    uint64_t h0, h1, h2, g0, g1, g2, c, mask;
+
+    if (st->buf_len) {
+        memset(st->buf + st->buf_len, 0, 16 - st->buf_len);
+        st->buf[st->buf_len] = 1;
+        poly1305_blocks(st, st->buf, 1, 0);
+    }
+
+    // fully carry h
+    h0 = st->h[0];
+    h1 = st->h[1];
+    h2 = st->h[2];
+    c = h1 >> 44; h1 &= M44;
+    h2 += c; c = h2 >> 42; h2 &= M42;
+    h0 += c * 5; c = h0 >> 44; h0 &= M44;
+    h1 += c; c = h1 >> 44; h1 &= M44;
+    h2 += c; c = h2 >> 42; h2 &= M42;
+    h0 += c * 5; c = h0 >> 44; h0 &= M44;
+    h1 += c;
+
+    // h - p, and pick it if h >= p
+    g0 = h0 + 5; c = g0 >> 44; g0 &= M44;
+    g1 = h1 + c; c = g1 >> 44; g1 &= M44;
+    g2 = h2 + c - ((uint64_t)1 << 42);
+    mask = (g2 >> 63) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+
+    // + pad, mod 2^128
+    uint64_t t0 = st->pad[0] | ((uint64_t)st->pad[1] << 32);
+    uint64_t t1 = st->pad[2] | ((uint64_t)st->pad[3] << 32);
+    h0 += t0 & M44; c = h0 >> 44; h0 &= M44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & M44) + c; c = h1 >> 44; h1 &= M44;
+    h2 += ((t1 >> 24) & M42) + c;
+
+    h0 = h0 | (h1 << 44);
+    h1 = (h1 >> 20) | (h2 << 24);
+    put_le32(mac, h0);
+    put_le32(mac + 4, h0 >> 32);
+    put_le32(mac + 8, h1);
+    put_le32(mac + 12, h1 >> 32);
+
+    memset(st, 0, sizeof(*st));
+}
+
+#else // POLY1305_64
+
+#define M26 0x3ffffff
+#define POLY1305_HIBIT ((uint32_t)1 << 24)
+
+static void poly1305_blocks(chacha_poly_mac *st, const uint8_t *m, size_t nblocks, uint32_t hibit)
+{
+    const uint32_t r0 = st->r[0], r1 = st->r[1], r2 = st->r[2], r3 = st->r[3], r4 = st->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = st->h[0], h1 = st->h[1], h2 = st->h[2], h3 = st->h[3], h4 = st->h[4];
+
+    for (; nblocks; nblocks--, m += 16) {
+        h0 += get_le32(m) & M26;
+        h1 += (get_le32(m + 3) >> 2) & M26;
+        h2 += (get_le32(m + 6) >> 4) & M26;
+        h3 += (get_le32(m + 9) >> 6) & M26;
+        h4 += (get_le32(m + 12) >> 8) | hibit;
+
+        uint64_t d0 = (uint64_t)h0 * r0 + (uint64_t)h1 * s4 + (uint64_t)h2 * s3 + (uint64_t)h3 * s2 + (uint64_t)h4 * s1;
+        uint64_t d1 = (uint64_t)h0 * r1 + (uint64_t)h1 * r0 + (uint64_t)h2 * s4 + (uint64_t)h3 * s3 + (uint64_t)h4 * s2;
+        uint64_t d2 = (uint64_t)h0 * r2 + (uint64_t)h1 * r1 + (uint64_t)h2 * r0 + (uint64_t)h3 * s4 + (uint64_t)h4 * s3;
+        uint64_t d3 = (uint64_t)h0 * r3 + (uint64_t)h1 * r2 + (uint64_t)h2 * r1 + (uint64_t)h3 * r0 + (uint64_t)h4 * s4;
+        uint64_t d4 = (uint64_t)h0 * r4 + (uint64_t)h1 * r3 + (uint64_t)h2 * r2 + (uint64_t)h3 * r1 + (uint64_t)h4 * r0;
+
+        uint32_t c;
+        c = d0 >> 26; h0 = d0 & M26;
+        d1 += c; c = d1 >> 26; h1 = d1 & M26;
+        d2 += c; c = d2 >> 26; h2 = d2 & M26;
+        d3 += c; c = d3 >> 26; h3 = d3 & M26;
+        d4 += c; c = d4 >> 26; h4 = d4 & M26;
+        h0 += c * 5; c = h0 >> 26; h0 &= M26;
+        h1 += c;
+    }
+
+    st->h[0] = h0;
+    st->h[1] = h1;
+    st->h[2] = h2;
+    st->h[3] = h3;
+    st->h[4] = h4;
+}
+
+static void poly1305_begin(chacha_poly_mac *st, const uint8_t key[32])
+{
+    memset(st, 0, sizeof(*st));
+    st->r[0] = get_le32(key) & 0x3ffffff;
+    st->r[1] = (get_le32(key + 3) >> 2) & 0x3ffff03;
+    st->r[2] = (get_le32(key + 6) >> 4) & 0x3ffc0ff;
+    st->r[3] = (get_le32(key + 9) >> 6) & 0x3f03fff;
+    st->r[4] = (get_le32(key + 12) >> 8) & 0x00fffff;
+    for (int i = 0; i < 4; i++) {
+        st->pad[i] = get_le32(key + 16 + 4 * i);
+    }
+}
+
+static void poly1305_end(chacha_poly_mac *st, uint8_t mac[16])
+{
+    uint32_t h0, h1, h2, h3, h4, g0, g1, g2, g3, g4, c, mask;
+    uint64_t f;
+
+    if (st->buf_len) {
+        memset(st->buf + st->buf_len, 0, 16 - st->buf_len);
+        st->buf[st->buf_len] = 1;
+        poly1305_blocks(st, st->buf, 1, 0);
+    }
+
+    // fully carry h
+    h0 = st->h[0];
+    h1 = st->h[1];
+    h2 = st->h[2];
+    h3 = st->h[3];
+    h4 = st->h[4];
+    c = h1 >> 26; h1 &= M26;
+    h2 += c; c = h2 >> 26; h2 &= M26;
+    h3 += c; c = h3 >> 26; h3 &= M26;
+    h4 += c; c = h4 >> 26; h4 &= M26;
+    h0 += c * 5; c = h0 >> 26; h0 &= M26;
+    h1 += c;
+
+    // h - p, and pick it if h >= p
+    g0 = h0 + 5; c = g0 >> 26; g0 &= M26;
+    g1 = h1 + c; c = g1 >> 26; g1 &= M26;
+    g2 = h2 + c; c = g2 >> 26; g2 &= M26;
+    g3 = h3 + c; c = g3 >> 26; g3 &= M26;
+    g4 = h4 + c - (1UL << 26);
+    mask = (g4 >> 31) - 1;
+    h0 = (h0 & ~mask) | (g0 & mask);
+    h1 = (h1 & ~mask) | (g1 & mask);
+    h2 = (h2 & ~mask) | (g2 & mask);
+    h3 = (h3 & ~mask) | (g3 & mask);
+    h4 = (h4 & ~mask) | (g4 & mask);
+
+    // to 32-bit words, + pad mod 2^128
+    h0 = h0 | (h1 << 26);
+    h1 = (h1 >> 6) | (h2 << 20);
+    h2 = (h2 >> 12) | (h3 << 14);
+    h3 = (h3 >> 18) | (h4 << 8);
+    f = (uint64_t)h0 + st->pad[0];             h0 = f;
+    f = (uint64_t)h1 + st->pad[1] + (f >> 32); h1 = f;
+    f = (uint64_t)h2 + st->pad[2] + (f >> 32); h2 = f;
+    f = (uint64_t)h3 + st->pad[3] + (f >> 32); h3 = f;
+    put_le32(mac, h0);
+    put_le32(mac + 4, h1);
+    put_le32(mac + 8, h2);
+    put_le32(mac + 12, h3);
+
+    memset(st, 0, sizeof(*st));
+}
+
+#endif // POLY1305_64
+
+static void poly1305_update(chacha_poly_mac *st, const uint8_t *data, size_t len)
+{
+    if (st->buf_len) {
+        size_t n = 16 - st->buf_len;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(st->buf + st->buf_len, data, n);
+        st->buf_len += n;
+        data += n;
+        len -= n;
+        if (st->buf_len < 16) {
+            return;
+        }
+        poly1305_blocks(st, st->buf, 1, POLY1305_HIBIT);
+        st->buf_len = 0;
+    }
+    if (len >= 16) {
+        poly1305_blocks(st, data, len / 16, POLY1305_HIBIT);
+        data += len & ~(size_t)15;
+        len &= 15;
+    }
+    if (len) {
+        memcpy(st->buf, data, len);
+        st->buf_len = len;
+    }
+}
+
+//
+// AEAD
+//
+
+// zeros up to the next 16-byte boundary
+static void poly1305_pad16(chacha_poly_mac *st)
+{
+    static const uint8_t zeros[16];
+    if (st->buf_len) {
+        poly1305_update(st, zeros, 16 - st->buf_len);
+    }
+}
+
+static void set_key(uint32_t input[16], const uint8_t key[32])
+{
+    input[0] = 0x61707865;              // "expand 32-byte k"
+    input[1] = 0x3320646e;
+    input[2] = 0x79622d32;
+    input[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) {
+        input[4 + i] = get_le32(key + 4 * i);
+    }
+}
+
+void chacha_poly_init(chacha_poly_ctx *ctx, const uint8_t key[32], const uint8_t nonce[12])
+{
+    set_key(ctx->input, key);
+    chacha_poly_reset(ctx, nonce);
+}
+
+void chacha_poly_hchacha20(const uint8_t key[32], const uint8_t nonce[16], uint8_t out[32])
+{
+    uint32_t x[16];
+
+    set_key(x, key);
+    for (int i = 0; i < 4; i++) {
+        x[12 + i] = get_le32(nonce + 4 * i);
+    }
+    chacha20_rounds(x);
+    for (int i = 0; i < 4; i++) {
+        put_le32(out + 4 * i, x[i]);
+        put_le32(out + 16 + 4 * i, x[12 + i]);
+    }
+    memset(x, 0, sizeof(x));
+}
+
+void xchacha_poly_init(chacha_poly_ctx *ctx, const uint8_t key[32], const uint8_t nonce[24])
+{
+    uint8_t subkey[32], nonce12[12] = { 0 };
+
+    chacha_poly_hchacha20(key, nonce, subkey);
+    memcpy(nonce12 + 4, nonce + 16, 8);
+    chacha_poly_init(ctx, subkey, nonce12);
+    memset(subkey, 0, sizeof(subkey));
+}
+
+void chacha_poly_reset(chacha_poly_ctx *ctx, const uint8_t nonce[12])
+{
+    uint8_t block0[64];
+
+    ctx->input[12] = 0;
+    for (int i = 0; i < 3; i++) {
+        ctx->input[13 + i] = get_le32(nonce + 4 * i);
+    }
+
+    // block 0 makes the Poly1305 key, the text starts at block 1
+    chacha20_block(ctx->input, block0);
+    ctx->input[12] = 1;
+    poly1305_begin(&ctx->poly, block0);
+    memset(block0, 0, sizeof(block0));
+    memset(ctx->ks, 0, sizeof(ctx->ks));
+    ctx->ks_pos = 0;
+    ctx->in_text = false;
+    ctx->finished = false;
+    memset(ctx->tag, 0, sizeof(ctx->tag));
+    ctx->alen = 0;
+    ctx->plen = 0;
+}
+
+void chacha_poly_auth(chacha_poly_ctx *ctx, const uint8_t *data, size_t len)
+{
+    poly1305_update(&ctx->poly, data, len);
+    ctx->alen += len;
+}
+
+// the additional data is padded once, where the text starts
+static void start_text(chacha_poly_ctx *ctx)
+{
+    if (!ctx->in_text) {
+        poly1305_pad16(&ctx->poly);
+        ctx->in_text = true;
+    }
+}
+
+// keystream carries on across calls, so a part-used block isn't lost
+static void stream_xor(chacha_poly_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+    if (ctx->ks_pos) {
+        for (; len && ctx->ks_pos < 64; len--) {
+            *out++ = *in++ ^ ctx->ks[ctx->ks_pos++];
+        }
+        if (ctx->ks_pos == 64) {
+            ctx->ks_pos = 0;
+        }
+    }
+
+    size_t whole = len & ~(size_t)63;
+    chacha20_xor(ctx->input, in, out, whole);
+    in += whole;
+    out += whole;
+    len -= whole;
+
+    if (len) {
+        chacha20_block(ctx->input, ctx->ks);
+        ctx->input[12]++;
+        for (size_t i = 0; i < len; i++) {
+            out[i] = in[i] ^ ctx->ks[i];
+        }
+        ctx->ks_pos = len;
+    }
+}
+
+void chacha_poly_encrypt(chacha_poly_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+    start_text(ctx);
+    stream_xor(ctx, in, out, len);
+    poly1305_update(&ctx->poly, out, len);
+    ctx->plen += len;
+}
+
+void chacha_poly_decrypt(chacha_poly_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len)
+{
+    start_text(ctx);
+    poly1305_update(&ctx->poly, in, len);
+    stream_xor(ctx, in, out, len);
+    ctx->plen += len;
+}
+
+void chacha_poly_finish(chacha_poly_ctx *ctx, uint8_t tag[16])
+{
+    uint8_t lengths[16];
+
+    // poly1305_end() wipes the state, so the tag can only be made once
+    if (!ctx->finished) {
+        start_text(ctx);
+        poly1305_pad16(&ctx->poly);
+        put_le32(lengths, ctx->alen);
+        put_le32(lengths + 4, ctx->alen >> 32);
+        put_le32(lengths + 8, ctx->plen);
+        put_le32(lengths + 12, ctx->plen >> 32);
+        poly1305_update(&ctx->poly, lengths, 16);
+        poly1305_end(&ctx->poly, ctx->tag);
+        memset(ctx->ks, 0, sizeof(ctx->ks));
+        ctx->ks_pos = 0;
+        ctx->finished = true;
+    }
+    memcpy(tag, ctx->tag, 16);
+}
+
+bool chacha_poly_verify(chacha_poly_ctx *ctx, const uint8_t tag[16])
+{
+    uint8_t mine[16], diff = 0;
+
+    chacha_poly_finish(ctx, mine);
+    for (int i = 0; i < 16; i++) {
+        diff |= mine[i] ^ tag[i];
+    }
+    memset(mine, 0, sizeof(mine));
+    return diff == 0;
+}
+
+void chacha_poly_seal(chacha_poly_ctx *ctx, const uint8_t *aad, size_t alen,
+                      const uint8_t *in, uint8_t *out, size_t len, uint8_t tag[16])
+{
+    chacha_poly_auth(ctx, aad, alen);
+    chacha_poly_encrypt(ctx, in, out, len);
+    chacha_poly_finish(ctx, tag);
+}
+
+bool chacha_poly_open(chacha_poly_ctx *ctx, const uint8_t *aad, size_t alen,
+                      const uint8_t *in, uint8_t *out, size_t len, const uint8_t tag[16])
+{
+    chacha_poly_auth(ctx, aad, alen);
+    start_text(ctx);
+    poly1305_update(&ctx->poly, in, len);
+    ctx->plen += len;
+    if (!chacha_poly_verify(ctx, tag)) {
+        return false;
+    }
+    chacha20_xor(ctx->input, in, out, len);
+    return true;
+}
+
+//
+// STREAM
+//
+
+static void stream_nonce(uint8_t nonce[24], const uint8_t prefix[CHACHA_STREAM_PREFIX], uint32_t index, bool last)
+{
+    memcpy(nonce, prefix, CHACHA_STREAM_PREFIX);
+    nonce[19] = index >> 24;
+    nonce[20] = index >> 16;
+    nonce[21] = index >> 8;
+    nonce[22] = index;
+    nonce[23] = last;
+}
+
+void chacha_stream_seal(const uint8_t key[32], const uint8_t prefix[CHACHA_STREAM_PREFIX], uint32_t index, bool last,
+                        const uint8_t *in, uint8_t *out, size_t len)
+{
+    chacha_poly_ctx ctx;
+    uint8_t nonce[24];
+
+    stream_nonce(nonce, prefix, index, last);
+    xchacha_poly_init(&ctx, key, nonce);
+    chacha_poly_seal(&ctx, NULL, 0, in, out, len, out + len);
+    memset(&ctx, 0, sizeof(ctx));
+}
+
+bool chacha_stream_open(const uint8_t key[32], const uint8_t prefix[CHACHA_STREAM_PREFIX], uint32_t index, bool last,
+                        const uint8_t *in, uint8_t *out, size_t len)
+{
+    chacha_poly_ctx ctx;
+    uint8_t nonce[24];
+
+    stream_nonce(nonce, prefix, index, last);
+    xchacha_poly_init(&ctx, key, nonce);
+    bool ok = chacha_poly_open(&ctx, NULL, 0, in, out, len, in + len);
+    memset(&ctx, 0, sizeof(ctx));
+    return ok;
+}
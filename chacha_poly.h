@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * ChaCha20-Poly1305 (RFC 7539), XChaCha20-Poly1305 and STREAM segments on
+ * top of it, with ChaCha20 on several blocks at once in
+ * SIMD registers: SSE2 or AVX2 (checked at runtime) on x86-64, NEON on
+ * ARMv8. Poly1305 uses 44-bit limbs where the compiler has 128-bit
+ * integers, and 26-bit limbs otherwise.
+ *
+ */
+
+#ifndef __CHACHA_POLY_H__
+#define __CHACHA_POLY_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// define CHACHA_NO_SIMD to always use the plain C code
+#ifndef CHACHA_NO_SIMD
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CHACHA_SIMD 1
+#elif defined(__aarch64__) && defined(__ARM_NEON) && !defined(__ARM_BIG_ENDIAN)
+#define CHACHA_SIMD 1
+#endif
+#endif
+
+#ifdef __SIZEOF_INT128__
+#define POLY1305_64 1
+#endif
+
+typedef struct {
+#ifdef POLY1305_64
+    uint64_t r[3], r2[3];       // r, and r^2 for two blocks per step
+    uint64_t h[3];
+#else
+    uint32_t r[5];
+    uint32_t h[5];
+#endif
+    uint32_t pad[4];
+    uint8_t buf[16];            // partial block not yet hashed
+    uint8_t buf_len;
+} chacha_poly_mac;
+
+typedef struct {
+    uint32_t input[16];         // constants, key, block counter, nonce
+    chacha_poly_mac poly;
+    uint8_t ks[64];             // keystream of a part-used block
+    uint8_t ks_pos;             // ... and how much of it is used, 0 if none
+    bool in_text;               // past the additional data
+    bool finished;              // tag is final
+    uint8_t tag[16];
+    uint64_t alen, plen;
+} chacha_poly_ctx;
+
+void chacha_poly_init(chacha_poly_ctx *ctx, const uint8_t key[32], const uint8_t nonce[12]);
+
+// start a new message under the same key
+void chacha_poly_reset(chacha_poly_ctx *ctx, const uint8_t nonce[12]);
+
+// additional data, any chunking, all of it before the text
+void chacha_poly_auth(chacha_poly_ctx *ctx, const uint8_t *data, size_t len);
+
+// any chunking; in == out is fine
+void chacha_poly_encrypt(chacha_poly_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len);
+void chacha_poly_decrypt(chacha_poly_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len);
+
+// the tag is worked out once; later calls return the same one
+void chacha_poly_finish(chacha_poly_ctx *ctx, uint8_t tag[16]);
+
+// finish, and compare with tag in constant time
+bool chacha_poly_verify(chacha_poly_ctx *ctx, const uint8_t tag[16]);
+
+// A whole message, from a fresh or reset context. open() checks the tag
+// before decrypting, and writes nothing to out if it is wrong.
+void chacha_poly_seal(chacha_poly_ctx *ctx, const uint8_t *aad, size_t alen,
+                      const uint8_t *in, uint8_t *out, size_t len, uint8_t tag[16]);
+bool chacha_poly_open(chacha_poly_ctx *ctx, const uint8_t *aad, size_t alen,
+                      const uint8_t *in, uint8_t *out, size_t len, const uint8_t tag[16]);
+
+// XChaCha20-Poly1305: the key for a 24-byte nonce's first 16 bytes, made by
+// HChaCha20, with the last 8 as an RFC 7539 nonce.
+void chacha_poly_hchacha20(const uint8_t key[32], const uint8_t nonce[16], uint8_t out[32]);
+void xchacha_poly_init(chacha_poly_ctx *ctx, const uint8_t key[32], const uint8_t nonce[24]);
+
+// STREAM (Hoang, Reyhanitabar, Rogaway, Vizar 2015) on XChaCha20-Poly1305:
+// segment i of a stream is sealed on its own, with the nonce prefix, i as
+// 32 bits big-endian, and a byte that is 1 for the last segment only. So
+// segments can be done in any order or in parallel, and a stream can't be
+// cut short, reordered or spliced without failing open(). Each stream under
+// a key needs its own prefix (random is fine), and the segment nonces share
+// the 24 byte nonce space of xchacha_poly_init() under that key.
+#define CHACHA_STREAM_PREFIX    19
+
+// out (seal) or in (open) has len bytes, then the 16 byte tag
+void chacha_stream_seal(const uint8_t key[32], const uint8_t prefix[CHACHA_STREAM_PREFIX], uint32_t index, bool last,
+                        const uint8_t *in, uint8_t *out, size_t len);
+bool chacha_stream_open(const uint8_t key[32], const uint8_t prefix[CHACHA_STREAM_PREFIX], uint32_t index, bool last,
+                        const uint8_t *in, uint8_t *out, size_t len);
+
+#endif
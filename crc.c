@@ -38,6 +38,22 @@
 
 #include "crc.h"
 
+#include <stdbool.h>
+
+/*
+ * Three engines are available, all computing the same (zlib) CRC32:
+ *
+ *   - a 16-entry nibble table; tiny, slow. Always used when CRC32_SMALL is
+ *     defined, for flash-constrained builds.
+ *   - slicing-by-8: eight 256-entry tables (8k of RAM, built on first use),
+ *     consumes 8 bytes per step.
+ *   - hardware: carry-less multiply folding (PCLMULQDQ) on x86-64, picked at
+ *     runtime if the CPU has it, or the CRC32 instructions on ARMv8 when the
+ *     compiler targets them. Short tails fall back to slicing-by-8.
+ */
+
+#define CRC32_POLY      0xedb88320
+
 static const uint32_t crc32tab[16] = {
    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190,
    0x6b6b51f4, 0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344,
@@ -45,15 +61,272 @@ static const uint32_t crc32tab[16] = {
    0xbdbdf21c
 };
 
-/* crc is previous value for incremental computation, 0xffffffff initially */
-uint32_t crc32(const uint8_t *data, uint32_t length, uint32_t crc)
+static uint32_t crc32_nibble(const uint8_t *data, uint32_t length, uint32_t crc)
 {
    for (uint32_t i = 0; i < length; ++i) {
       crc ^= data[i];
       crc = crc32tab[crc & 0x0f] ^ (crc >> 4);
       crc = crc32tab[crc & 0x0f] ^ (crc >> 4);
    }
+   return crc;
+}
+
+#ifndef CRC32_SMALL
+
+static uint32_t crc32tab8[8][256];
+
+static void crc32_make_tables(void)
+{
+   for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) {
+         c = (c & 1) ? (c >> 1) ^ CRC32_POLY : (c >> 1);
+      }
+      crc32tab8[0][n] = c;
+   }
+   for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = crc32tab8[0][n];
+      for (int k = 1; k < 8; k++) {
+         c = crc32tab8[0][c & 0xff] ^ (c >> 8);
+         crc32tab8[k][n] = c;
+      }
+   }
+}
+
+static inline uint32_t load_le32(const uint8_t *p)
+{
+   return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint32_t crc32_slice8(const uint8_t *data, uint32_t length, uint32_t crc)
+{
+   while (length >= 8) {
+      uint32_t one = load_le32(data) ^ crc;
+      uint32_t two = load_le32(data + 4);
+      crc = crc32tab8[7][one & 0xff] ^ crc32tab8[6][(one >> 8) & 0xff]
+          ^ crc32tab8[5][(one >> 16) & 0xff] ^ crc32tab8[4][one >> 24]
+          ^ crc32tab8[3][two & 0xff] ^ crc32tab8[2][(two >> 8) & 0xff]
+          ^ crc32tab8[1][(two >> 16) & 0xff] ^ crc32tab8[0][two >> 24];
+      data += 8;
+      length -= 8;
+   }
+   while (length--) {
+      crc = crc32tab8[0][(crc ^ *data++) & 0xff] ^ (crc >> 8);
+   }
+   return crc;
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define CRC32_HAVE_CLMUL
+
+#include <immintrin.h>
+
+/*
+ * Fold 64 bytes at a time using carry-less multiplication, then reduce.
+ * See Intel's "Fast CRC Computation for Generic Polynomials Using PCLMULQDQ
+ * Instruction"; the constants are for the bit-reflected zlib polynomial.
+ * Requires length >= 64 and a multiple of 16.
+ */
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t crc32_clmul_fold(const uint8_t *buf, uint32_t len, uint32_t crc)
+{
+   static const uint64_t k1k2[2] __attribute__((aligned(16))) = { 0x0154442bd4, 0x01c6e41596 };
+   static const uint64_t k3k4[2] __attribute__((aligned(16))) = { 0x01751997d0, 0x00ccaa009e };
+   static const uint64_t k5k0[2] __attribute__((aligned(16))) = { 0x0163cd6124, 0x0000000000 };
+   static const uint64_t poly[2] __attribute__((aligned(16))) = { 0x01db710641, 0x01f7011641 };
+
+   __m128i x0, x1, x2, x3, x4, x5, x6, x7, x8, y5, y6, y7, y8;
+
+   x1 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+   x2 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+   x3 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+   x4 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+   x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+   x0 = _mm_load_si128((const __m128i *)k1k2);
+   buf += 64;
+   len -= 64;
+
+   // four lanes in parallel
+   while (len >= 64) {
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+      x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+      x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+      x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+      x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+      y5 = _mm_loadu_si128((const __m128i *)(buf + 0x00));
+      y6 = _mm_loadu_si128((const __m128i *)(buf + 0x10));
+      y7 = _mm_loadu_si128((const __m128i *)(buf + 0x20));
+      y8 = _mm_loadu_si128((const __m128i *)(buf + 0x30));
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), y5);
+      x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), y6);
+      x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), y7);
+      x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), y8);
+      buf += 64;
+      len -= 64;
+   }
+
+   // fold the four lanes into one
+   x0 = _mm_load_si128((const __m128i *)k3k4);
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+   x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+   x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+   // remaining 16-byte blocks
+   while (len >= 16) {
+      x2 = _mm_loadu_si128((const __m128i *)buf);
+      x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+      x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+      x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+      buf += 16;
+      len -= 16;
+   }
+
+   // 128 -> 64 bits
+   x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+   x3 = _mm_setr_epi32(~0, 0, ~0, 0);
+   x1 = _mm_srli_si128(x1, 8);
+   x1 = _mm_xor_si128(x1, x2);
+   x0 = _mm_loadl_epi64((const __m128i *)k5k0);
+   x2 = _mm_srli_si128(x1, 4);
+   x1 = _mm_and_si128(x1, x3);
+   x1 = _mm_clmulepi64_si128(x1, x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   // Barrett reduction to 32 bits
+   x0 = _mm_load_si128((const __m128i *)poly);
+   x2 = _mm_and_si128(x1, x3);
+   x2 = _mm_clmulepi64_si128(x2, x0, 0x10);
+   x2 = _mm_and_si128(x2, x3);
+   x2 = _mm_clmulepi64_si128(x2, x0, 0x00);
+   x1 = _mm_xor_si128(x1, x2);
+
+   return (uint32_t)_mm_extract_epi32(x1, 1);
+}
+
+static uint32_t crc32_hw(const uint8_t *data, uint32_t length, uint32_t crc)
+{
+   if (length >= 64) {
+      uint32_t chunk = length & ~(uint32_t)15;
+      crc = crc32_clmul_fold(data, chunk, crc);
+      data += chunk;
+      length -= chunk;
+   }
+   return crc32_slice8(data, length, crc);
+}
+
+static bool crc32_hw_usable(void)
+{
+   return __builtin_cpu_supports("pclmul") && __builtin_cpu_supports("sse4.1");
+}
+
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define CRC32_HAVE_CLMUL
+
+#include <arm_acle.h>
+
+static uint32_t crc32_hw(const uint8_t *data, uint32_t length, uint32_t crc)
+{
+   while (length && ((uintptr_t)data & 7)) {
+      crc = __crc32b(crc, *data++);
+      length--;
+   }
+   while (length >= 8) {
+      crc = __crc32d(crc, *(const uint64_t *)data);
+      data += 8;
+      length -= 8;
+   }
+   while (length--) {
+      crc = __crc32b(crc, *data++);
+   }
+   return crc;
+}
+
+static bool crc32_hw_usable(void)
+{
+   // compiler was told the target has it
+   return true;
+}
+#endif
+
+static uint32_t crc32_pick(const uint8_t *data, uint32_t length, uint32_t crc);
+
+static uint32_t (*crc32_engine)(const uint8_t *, uint32_t, uint32_t) = crc32_pick;
+
+// first call: build tables and choose the fastest engine available
+static uint32_t crc32_pick(const uint8_t *data, uint32_t length, uint32_t crc)
+{
+   crc32_make_tables();
+   crc32_engine = crc32_slice8;
+#ifdef CRC32_HAVE_CLMUL
+   if (crc32_hw_usable()) {
+      crc32_engine = crc32_hw;
+   }
+#endif
+   return crc32_engine(data, length, crc);
+}
+
+#endif // !CRC32_SMALL
+
+/* crc is previous value for incremental computation, 0xffffffff initially */
+uint32_t crc32(const uint8_t *data, uint32_t length, uint32_t crc)
+{
+#ifdef CRC32_SMALL
+   crc = crc32_nibble(data, length, crc);
+#else
+   // tiny inputs are not worth a table walk
+   crc = (length < 16) ? crc32_nibble(data, length, crc) : crc32_engine(data, length, crc);
+#endif
 
    // return value suitable for passing in next time, for final value invert it
    return crc/* ^ 0xffffffff*/;
 }
+
+/* multiply a and b modulo the CRC polynomial, in the bit-reflected domain */
+static uint32_t crc32_multmodp(uint32_t a, uint32_t b)
+{
+   uint32_t m = (uint32_t)1 << 31, p = 0;
+
+   for (;;) {
+      if (a & m) {
+         p ^= b;
+         if ((a & (m - 1)) == 0) {
+            break;
+         }
+      }
+      m >>= 1;
+      b = (b & 1) ? (b >> 1) ^ CRC32_POLY : (b >> 1);
+   }
+   return p;
+}
+
+/*
+ * Combine final CRC values of two consecutive chunks A and B into the final
+ * CRC of A|B, given only the length of B (as zlib's crc32_combine).
+ */
+uint32_t crc32_combine(uint32_t crc_a, uint32_t crc_b, uint32_t len_b)
+{
+   // x^(8 * len_b) mod p, by square-and-multiply over x^(2^k)
+   uint32_t sq = (uint32_t)1 << 30;      // x^1
+   uint32_t xn = (uint32_t)1 << 31;      // x^0
+
+   for (int k = 0; k < 3; k++) {
+      sq = crc32_multmodp(sq, sq);        // x^8
+   }
+   while (len_b) {
+      if (len_b & 1) {
+         xn = crc32_multmodp(sq, xn);
+      }
+      len_b >>= 1;
+      sq = crc32_multmodp(sq, sq);
+   }
+   return crc32_multmodp(xn, crc_a) ^ crc_b;
+}
@@ -11,5 +11,6 @@
 #include <stdint.h>
 
 uint32_t crc32(const uint8_t *data, uint32_t length, uint32_t crc);
+uint32_t crc32_combine(uint32_t crc_a, uint32_t crc_b, uint32_t len_b);
 
 #endif
@@ -0,0 +1,760 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * Fixed-base scalar multiplication (k*G) from a window table held in RAM.
+ *
+ * For window width w, the table holds (2j+1) * 2^(w*i) * G for each window i
+ * and j < 2^(w-1). An odd scalar a < 2^(w*m) is recoded into odd signed digits
+ *
+ *      a = 2^(w*m) + sum_{i<m} d_i * 2^(w*i),   d_i odd, |d_i| < 2^w
+ *
+ * where d_i = ((a >> w*i) | 1) mod 2^(w+1) - 2^w. So every window adds exactly
+ * one table point (possibly negated) and there are no zero digits to skip.
+ * Even scalars are handled as -(n - k). Points are summed in Jacobian
+ * coordinates with one inversion at the end.
+ *
+ * Nothing branches on k or reads memory at an address that depends on it,
+ * since k is a private key.
+ *
+ */
+
+#include <string.h>
+
+#include "ecmult_gen.h"
+#include "memzero.h"
+#include "rand.h"
+#include "rfc6979.h"
+
+#define ECMULT_LIMBS (sizeof(((bignum256 *)0)->val) / sizeof(uint32_t))
+
+// 1 if a = 0 mod prime, for a < 2 * prime (so a is 0 or prime), without
+// branches on a; limbs are under 2^31
+static int bn_is_zero_mod(const bignum256 *a, const bignum256 *prime)
+{
+    uint32_t z = 0, p = 0;
+    for (size_t i = 0; i < ECMULT_LIMBS; i++) {
+        z |= a->val[i];
+        p |= a->val[i] ^ prime->val[i];
+    }
+    return (int)(((z - 1) | (p - 1)) >> 31);
+}
+
+// res = p if mask is all ones, unchanged if it is zero
+static void point_cmov_mask(curve_point *res, uint32_t mask, const curve_point *p)
+{
+    for (size_t i = 0; i < ECMULT_LIMBS; i++) {
+        res->x.val[i] ^= mask & (res->x.val[i] ^ p->x.val[i]);
+        res->y.val[i] ^= mask & (res->y.val[i] ^ p->y.val[i]);
+    }
+}
+
+// sum = jp + p (affine) by the general formula, which is wrong when jp is
+// infinity or +/-p; then h = 0 or z(jp) = 0. h, r are left for the caller.
+static void jacobian_sum_affine(const ecmult_gen_jacobian *jp, const curve_point *p, const bignum256 *prime,
+                                ecmult_gen_jacobian *sum, bignum256 *h, bignum256 *r)
+{
+    bignum256 z1z1, u2, s2, hh, hhh, v, t1, t2;
+
+    // u2 = x2 * z1^2, s2 = y2 * z1^3
+    bn_copy(&jp->z, &z1z1);
+    bn_multiply(&jp->z, &z1z1, prime);
+    bn_copy(&p->x, &u2);
+    bn_multiply(&z1z1, &u2, prime);
+    bn_copy(&p->y, &s2);
+    bn_multiply(&jp->z, &s2, prime);
+    bn_multiply(&z1z1, &s2, prime);
+
+    // h = u2 - x1, r = s2 - y1
+    bn_subtractmod(&u2, &jp->x, h, prime);
+    bn_fast_mod(h, prime);
+    bn_subtractmod(&s2, &jp->y, r, prime);
+    bn_fast_mod(r, prime);
+
+    // hh = h^2, hhh = h^3, v = x1 * hh
+    bn_copy(h, &hh);
+    bn_multiply(h, &hh, prime);
+    bn_copy(&hh, &hhh);
+    bn_multiply(h, &hhh, prime);
+    bn_copy(&jp->x, &v);
+    bn_multiply(&hh, &v, prime);
+
+    // x3 = r^2 - hhh - 2v
+    bn_copy(r, &t1);
+    bn_multiply(r, &t1, prime);
+    bn_subtractmod(&t1, &hhh, &t2, prime);
+    bn_fast_mod(&t2, prime);
+    bn_copy(&v, &t1);
+    bn_mult_k(&t1, 2, prime);
+    bn_subtractmod(&t2, &t1, &sum->x, prime);
+    bn_fast_mod(&sum->x, prime);
+
+    // y3 = r * (v - x3) - y1 * hhh
+    bn_subtractmod(&v, &sum->x, &t1, prime);
+    bn_fast_mod(&t1, prime);
+    bn_multiply(r, &t1, prime);
+    bn_copy(&jp->y, &t2);
+    bn_multiply(&hhh, &t2, prime);
+    bn_subtractmod(&t1, &t2, &sum->y, prime);
+    bn_fast_mod(&sum->y, prime);
+
+    // z3 = z1 * h, so 0 (infinity) when jp = -p
+    bn_copy(&jp->z, &sum->z);
+    bn_multiply(h, &sum->z, prime);
+
+    memzero(&v, sizeof(v));
+    memzero(&t1, sizeof(t1));
+    memzero(&t2, sizeof(t2));
+}
+
+// jp += p (affine), for any jp: infinity (z = 0), p itself or -p too. The
+// general sum, the double of p and p are all worked out, and the right one
+// is picked with bn_cmov(), so the time doesn't depend on the points.
+static void jacobian_add_affine(ecmult_gen_jacobian *jp, const curve_point *p, const ecdsa_curve *curve)
+{
+    const bignum256 *prime = &curve->prime;
+    bignum256 h, r, m, yy, s, t1, t2;
+    ecmult_gen_jacobian sum, dbl;
+
+    jacobian_sum_affine(jp, p, prime, &sum, &h, &r);
+
+    // 2p, z = 1: m = 3 x^2 + a, s = 4 x y^2,
+    // x3 = m^2 - 2s, y3 = m (s - x3) - 8 y^4, z3 = 2y
+    bn_copy(&p->x, &m);
+    bn_multiply(&p->x, &m, prime);
+    bn_mult_k(&m, 3, prime);
+    bn_subi(&m, -curve->a, prime);
+    bn_copy(&p->y, &yy);
+    bn_multiply(&p->y, &yy, prime);
+    bn_copy(&p->x, &s);
+    bn_multiply(&yy, &s, prime);
+    bn_mult_k(&s, 4, prime);
+    bn_copy(&yy, &t2);
+    bn_multiply(&yy, &t2, prime);
+    bn_mult_k(&t2, 8, prime);                           // 8 y^4
+    bn_copy(&m, &t1);
+    bn_multiply(&m, &t1, prime);
+    bn_copy(&s, &yy);
+    bn_mult_k(&yy, 2, prime);
+    bn_subtractmod(&t1, &yy, &dbl.x, prime);
+    bn_fast_mod(&dbl.x, prime);
+    bn_subtractmod(&s, &dbl.x, &t1, prime);
+    bn_fast_mod(&t1, prime);
+    bn_multiply(&m, &t1, prime);
+    bn_subtractmod(&t1, &t2, &dbl.y, prime);
+    bn_fast_mod(&dbl.y, prime);
+    bn_copy(&p->y, &dbl.z);
+    bn_mult_k(&dbl.z, 2, prime);
+
+    int inf = bn_is_zero_mod(&jp->z, prime);
+    int same = bn_is_zero_mod(&h, prime) & bn_is_zero_mod(&r, prime) & (inf ^ 1);
+
+    bn_one(&t1);
+    bn_cmov(&jp->x, same, &dbl.x, &sum.x);
+    bn_cmov(&jp->y, same, &dbl.y, &sum.y);
+    bn_cmov(&jp->z, same, &dbl.z, &sum.z);
+    bn_cmov(&jp->x, inf, &p->x, &jp->x);
+    bn_cmov(&jp->y, inf, &p->y, &jp->y);
+    bn_cmov(&jp->z, inf, &t1, &jp->z);
+
+    memzero(&sum, sizeof(sum));
+    memzero(&dbl, sizeof(dbl));
+    memzero(&h, sizeof(h));
+    memzero(&r, sizeof(r));
+    memzero(&m, sizeof(m));
+    memzero(&yy, sizeof(yy));
+    memzero(&s, sizeof(s));
+    memzero(&t1, sizeof(t1));
+    memzero(&t2, sizeof(t2));
+}
+
+// read cnt bits (cnt <= 9) at bit position pos of a 32-byte big-endian number
+static uint32_t be_bits(const uint8_t *be, int pos, int cnt)
+{
+    uint32_t v = 0;
+    for (int b = 0; b < cnt; b++) {
+        int q = pos + b;
+        if (q < 256) {
+            v |= (uint32_t)((be[31 - (q >> 3)] >> (q & 7)) & 1) << b;
+        }
+    }
+    return v;
+}
+
+// random 0 < r < prime, to blind the inversion at the end
+static void random_fe(bignum256 *r, const bignum256 *prime)
+{
+    uint8_t buf[32];
+    do {
+        random_buffer(buf, sizeof(buf));
+        bn_read_be(buf, r);
+        bn_fast_mod(r, prime);
+        bn_mod(r, prime);
+    } while (bn_is_zero(r));
+    memzero(buf, sizeof(buf));
+}
+
+// k must be 0 < k < order. Constant time in k: every window reads its whole
+// table row and keeps one entry by mask, signs are applied with bn_cmov(),
+// the additions are complete, and the inversion at the end is blinded.
+static void ecmult_gen_window(const ecmult_gen_table *t, const bignum256 *k, curve_point *res)
+{
+    const ecdsa_curve *curve = t->curve;
+    const bignum256 *prime = &curve->prime;
+    const int w = ECMULT_GEN_WIDTH(t->level);
+    const int m = ECMULT_GEN_WINDOWS(t->level);
+    const int per = 1 << (w - 1);
+    const uint32_t mask = (1 << w) - 1;
+    ecmult_gen_jacobian jp;
+    curve_point p;
+    bignum256 a, ny, blind;
+    uint8_t abuf[32];
+
+    // work with whichever of k, n - k is odd
+    int neg = (k->val[0] & 1) ^ 1;
+    bn_subtract(&curve->order, k, &ny);
+    bn_cmov(&a, neg, &ny, k);
+    bn_write_be(&a, abuf);
+
+    bn_zero(&jp.x);
+    bn_zero(&jp.y);
+    bn_zero(&jp.z);
+    for (int i = 0; i < m; i++) {
+        uint32_t v = be_bits(abuf, w * i, w + 1) | 1;
+        uint32_t positive = v >> w;
+        uint32_t idx = ((v ^ (mask & (positive - 1))) & mask) >> 1;
+        const curve_point *row = &t->points[i * per];
+
+        memzero(&p, sizeof(p));
+        for (int j = 0; j < per; j++) {
+            // all ones when j == idx
+            uint32_t sel = (((uint32_t)j ^ idx) - 1) >> 31;
+            point_cmov_mask(&p, -sel, &row[j]);
+        }
+        bn_subtract(prime, &p.y, &ny);
+        bn_cmov(&p.y, positive, &p.y, &ny);
+
+        jacobian_add_affine(&jp, &p, curve);
+    }
+    jacobian_add_affine(&jp, &t->top, curve);
+
+    // back to affine: 1/z = r / (z r)
+    random_fe(&blind, prime);
+    bn_multiply(&blind, &jp.z, prime);
+    bn_mod(&jp.z, prime);
+    bn_inverse(&jp.z, prime);
+    bn_multiply(&blind, &jp.z, prime);
+    bn_copy(&jp.z, &a);
+    bn_multiply(&jp.z, &a, prime);          // 1/z^2
+    bn_multiply(&a, &jp.x, prime);
+    bn_multiply(&jp.z, &a, prime);          // 1/z^3
+    bn_multiply(&a, &jp.y, prime);
+    bn_mod(&jp.x, prime);
+    bn_mod(&jp.y, prime);
+    bn_copy(&jp.x, &res->x);
+    bn_subtract(prime, &jp.y, &ny);
+    bn_cmov(&res->y, neg, &ny, &jp.y);
+
+    memzero(&jp, sizeof(jp));
+    memzero(&p, sizeof(p));
+    memzero(&a, sizeof(a));
+    memzero(&ny, sizeof(ny));
+    memzero(&blind, sizeof(blind));
+    memzero(abuf, sizeof(abuf));
+}
+
+// (Re)build the table at the given level, 0 to stop using it. Slow: one
+// affine point addition per table entry. Returns 0 if level is too big.
+int ecmult_gen_build(ecmult_gen_table *t, int level)
+{
+    if (level < 0 || level > t->max_level) {
+        return 0;
+    }
+    t->lazy = false;
+    t->level = 0;
+    if (level == 0) {
+        return 1;
+    }
+
+    const ecdsa_curve *curve = t->curve;
+    const int w = ECMULT_GEN_WIDTH(level);
+    const int m = ECMULT_GEN_WINDOWS(level);
+    const int per = 1 << (w - 1);
+    curve_point base, twice;
+
+    point_copy(&curve->G, &base);
+    for (int i = 0; i < m; i++) {
+        curve_point *row = &t->points[i * per];
+
+        // row[j] = (2j + 1) * base
+        point_copy(&base, &row[0]);
+        point_copy(&base, &twice);
+        point_double(curve, &twice);
+        for (int j = 1; j < per; j++) {
+            point_copy(&row[j - 1], &row[j]);
+            point_add(curve, &twice, &row[j]);
+        }
+
+        for (int b = 0; b < w; b++) {
+            point_double(curve, &base);
+        }
+    }
+    point_copy(&base, &t->top);
+
+    t->level = level;
+    return 1;
+}
+
+void ecmult_gen(ecmult_gen_table *t, const bignum256 *k, curve_point *res)
+{
+    if (t->lazy) {
+        ecmult_gen_build(t, t->max_level);
+    }
+    if (t->level && !bn_is_zero(k) && bn_is_less(k, &t->curve->order)) {
+        ecmult_gen_window(t, k, res);
+    } else {
+        scalar_multiply(t->curve, k, res);
+    }
+}
+
+void ecmult_gen_get_public_key33(ecmult_gen_table *t, const uint8_t *priv_key, uint8_t *pub_key)
+{
+    curve_point R;
+    bignum256 k;
+
+    bn_read_be(priv_key, &k);
+    ecmult_gen(t, &k, &R);
+    pub_key[0] = 0x02 | (R.y.val[0] & 0x01);
+    bn_write_be(&R.x, pub_key + 1);
+    memzero(&R, sizeof(R));
+    memzero(&k, sizeof(k));
+}
+
+void ecmult_gen_get_public_key65(ecmult_gen_table *t, const uint8_t *priv_key, uint8_t *pub_key)
+{
+    curve_point R;
+    bignum256 k;
+
+    bn_read_be(priv_key, &k);
+    ecmult_gen(t, &k, &R);
+    pub_key[0] = 0x04;
+    bn_write_be(&R.x, pub_key + 1);
+    bn_write_be(&R.y, pub_key + 33);
+    memzero(&R, sizeof(R));
+    memzero(&k, sizeof(k));
+}
+
+// ecdsa_sign_digest() with RFC6979 nonces: the same steps, with R = k*G from
+// ecmult_gen() and the inversion of k blinded as trezor-crypto does
+int ecmult_gen_sign_digest(ecmult_gen_table *t, const uint8_t *priv_key, const uint8_t *digest, uint8_t *sig,
+                           uint8_t *pby, int (*is_canonical)(uint8_t by, uint8_t sig[64]))
+{
+    const ecdsa_curve *curve = t->curve;
+    curve_point R;
+    bignum256 k, z, randk;
+    bignum256 *s = &R.y;
+    uint8_t kbuf[32];
+    uint8_t by;
+    rfc6979_state rng;
+    int rv = -1;
+
+    init_rfc6979(priv_key, digest, &rng);
+    bn_read_be(digest, &z);
+
+    for (int i = 0; i < 10000; i++) {
+        generate_rfc6979(kbuf, &rng);
+        bn_read_be(kbuf, &k);
+        if (bn_is_zero(&k) || !bn_is_less(&k, &curve->order)) {
+            continue;
+        }
+
+        ecmult_gen(t, &k, &R);
+        by = R.y.val[0] & 1;
+        // r = R.x mod n
+        if (!bn_is_less(&R.x, &curve->order)) {
+            bn_subtract(&R.x, &curve->order, &R.x);
+            by |= 2;
+        }
+        if (bn_is_zero(&R.x)) {
+            continue;
+        }
+
+        // s = (k * randk)^-1 * (z + r * priv) * randk
+        random_fe(&randk, &curve->order);
+        bn_multiply(&randk, &k, &curve->order);
+        bn_mod(&k, &curve->order);
+        bn_inverse(&k, &curve->order);
+        bn_read_be(priv_key, s);
+        bn_multiply(&R.x, s, &curve->order);
+        bn_mod(s, &curve->order);
+        bn_addmod(s, &z, &curve->order);
+        bn_multiply(&k, s, &curve->order);
+        bn_multiply(&randk, s, &curve->order);
+        bn_mod(s, &curve->order);
+        if (bn_is_zero(s)) {
+            continue;
+        }
+
+        // low-s form
+        if (bn_is_less(&curve->order_half, s)) {
+            bn_subtract(&curve->order, s, s);
+            by ^= 1;
+        }
+
+        bn_write_be(&R.x, sig);
+        bn_write_be(s, sig + 32);
+        if (is_canonical && !is_canonical(by, sig)) {
+            continue;
+        }
+        if (pby) {
+            *pby = by;
+        }
+        rv = 0;
+        break;
+    }
+
+    memzero(&k, sizeof(k));
+    memzero(&randk, sizeof(randk));
+    memzero(&R, sizeof(R));
+    memzero(kbuf, sizeof(kbuf));
+    memzero(&rng, sizeof(rng));
+    return rv;
+}
+
+// jp = 2 jp, for any jp
+static void jacobian_double(ecmult_gen_jacobian *jp, const ecdsa_curve *curve)
+{
+    const bignum256 *prime = &curve->prime;
+    bignum256 m, yy, s, t1, t2;
+
+    if (bn_is_zero_mod(&jp->z, prime)) {
+        return;
+    }
+
+    // m = 3 x^2 + a z^4, s = 4 x y^2,
+    // x3 = m^2 - 2s, y3 = m (s - x3) - 8 y^4, z3 = 2 y z
+    bn_copy(&jp->x, &m);
+    bn_multiply(&jp->x, &m, prime);
+    bn_mult_k(&m, 3, prime);
+    if (curve->a) {
+        bn_copy(&jp->z, &t1);
+        bn_multiply(&jp->z, &t1, prime);
+        bn_copy(&t1, &t2);
+        bn_multiply(&t1, &t2, prime);
+        bn_mult_k(&t2, -curve->a, prime);
+        bn_subtractmod(&m, &t2, &t1, prime);
+        bn_fast_mod(&t1, prime);
+        bn_copy(&t1, &m);
+    }
+    bn_copy(&jp->y, &yy);
+    bn_multiply(&jp->y, &yy, prime);
+    bn_copy(&jp->x, &s);
+    bn_multiply(&yy, &s, prime);
+    bn_mult_k(&s, 4, prime);
+    bn_multiply(&jp->y, &jp->z, prime);
+    bn_mult_k(&jp->z, 2, prime);
+    bn_copy(&yy, &t2);
+    bn_multiply(&yy, &t2, prime);
+    bn_mult_k(&t2, 8, prime);
+    bn_copy(&m, &t1);
+    bn_multiply(&m, &t1, prime);
+    bn_copy(&s, &yy);
+    bn_mult_k(&yy, 2, prime);
+    bn_subtractmod(&t1, &yy, &jp->x, prime);
+    bn_fast_mod(&jp->x, prime);
+    bn_subtractmod(&s, &jp->x, &t1, prime);
+    bn_fast_mod(&t1, prime);
+    bn_multiply(&m, &t1, prime);
+    bn_subtractmod(&t1, &t2, &jp->y, prime);
+    bn_fast_mod(&jp->y, prime);
+}
+
+// jp += p (affine), branching on the special cases
+static void jacobian_add_affine_var(ecmult_gen_jacobian *jp, const curve_point *p, const ecdsa_curve *curve)
+{
+    const bignum256 *prime = &curve->prime;
+    ecmult_gen_jacobian sum;
+    bignum256 h, r;
+
+    if (bn_is_zero_mod(&jp->z, prime)) {
+        bn_copy(&p->x, &jp->x);
+        bn_copy(&p->y, &jp->y);
+        bn_one(&jp->z);
+        return;
+    }
+    jacobian_sum_affine(jp, p, prime, &sum, &h, &r);
+    if (bn_is_zero_mod(&h, prime)) {
+        if (bn_is_zero_mod(&r, prime)) {
+            jacobian_double(jp, curve);
+        } else {
+            bn_zero(&jp->z);
+        }
+        return;
+    }
+    *jp = sum;
+}
+
+// jp += q, both Jacobian, branching on the special cases
+static void jacobian_add_var(ecmult_gen_jacobian *jp, const ecmult_gen_jacobian *q, const ecdsa_curve *curve)
+{
+    const bignum256 *prime = &curve->prime;
+    bignum256 z1z1, z2z2, u1, u2, s1, s2, h, r, hh, t1, t2;
+
+    if (bn_is_zero_mod(&q->z, prime)) {
+        return;
+    }
+    if (bn_is_zero_mod(&jp->z, prime)) {
+        *jp = *q;
+        return;
+    }
+
+    // u1 = x1 z2^2, u2 = x2 z1^2, s1 = y1 z2^3, s2 = y2 z1^3
+    bn_copy(&jp->z, &z1z1);
+    bn_multiply(&jp->z, &z1z1, prime);
+    bn_copy(&q->z, &z2z2);
+    bn_multiply(&q->z, &z2z2, prime);
+    bn_copy(&jp->x, &u1);
+    bn_multiply(&z2z2, &u1, prime);
+    bn_copy(&q->x, &u2);
+    bn_multiply(&z1z1, &u2, prime);
+    bn_copy(&jp->y, &s1);
+    bn_multiply(&q->z, &s1, prime);
+    bn_multiply(&z2z2, &s1, prime);
+    bn_copy(&q->y, &s2);
+    bn_multiply(&jp->z, &s2, prime);
+    bn_multiply(&z1z1, &s2, prime);
+
+    bn_subtractmod(&u2, &u1, &h, prime);
+    bn_fast_mod(&h, prime);
+    bn_subtractmod(&s2, &s1, &r, prime);
+    bn_fast_mod(&r, prime);
+    if (bn_is_zero_mod(&h, prime)) {
+        if (bn_is_zero_mod(&r, prime)) {
+            jacobian_double(jp, curve);
+        } else {
+            bn_zero(&jp->z);
+        }
+        return;
+    }
+
+    // x3 = r^2 - h^3 - 2 u1 h^2, y3 = r (u1 h^2 - x3) - s1 h^3, z3 = z1 z2 h
+    bn_copy(&h, &hh);
+    bn_multiply(&h, &hh, prime);
+    bn_multiply(&hh, &u1, prime);                       // u1 h^2
+    bn_multiply(&h, &hh, prime);                        // h^3
+    bn_copy(&r, &t1);
+    bn_multiply(&r, &t1, prime);
+    bn_subtractmod(&t1, &hh, &t2, prime);
+    bn_fast_mod(&t2, prime);
+    bn_copy(&u1, &t1);
+    bn_mult_k(&t1, 2, prime);
+    bn_subtractmod(&t2, &t1, &jp->x, prime);
+    bn_fast_mod(&jp->x, prime);
+    bn_subtractmod(&u1, &jp->x, &t1, prime);
+    bn_fast_mod(&t1, prime);
+    bn_multiply(&r, &t1, prime);
+    bn_multiply(&hh, &s1, prime);
+    bn_subtractmod(&t1, &s1, &jp->y, prime);
+    bn_fast_mod(&jp->y, prime);
+    bn_multiply(&q->z, &jp->z, prime);
+    bn_multiply(&h, &jp->z, prime);
+}
+
+void ecmult_gen_odd_multiples(const ecdsa_curve *curve, const curve_point *q, ecmult_gen_jacobian *out, int n)
+{
+    ecmult_gen_jacobian twice;
+
+    bn_copy(&q->x, &out[0].x);
+    bn_copy(&q->y, &out[0].y);
+    bn_one(&out[0].z);
+    twice = out[0];
+    jacobian_double(&twice, curve);
+    for (int j = 1; j < n; j++) {
+        out[j] = out[j - 1];
+        jacobian_add_var(&out[j], &twice, curve);
+    }
+}
+
+void ecmult_gen_batch_affine(const ecdsa_curve *curve, const ecmult_gen_jacobian *in, curve_point *out, size_t n,
+                             bignum256 *scratch)
+{
+    const bignum256 *prime = &curve->prime;
+    bignum256 acc, zi, t;
+
+    // scratch[i] = z_0 * ... * z_i-1, counting infinity as 1
+    bn_one(&acc);
+    for (size_t i = 0; i < n; i++) {
+        bn_copy(&acc, &scratch[i]);
+        if (!bn_is_zero_mod(&in[i].z, prime)) {
+            bn_multiply(&in[i].z, &acc, prime);
+        }
+    }
+    bn_mod(&acc, prime);
+    bn_inverse(&acc, prime);
+
+    // acc = 1 / (z_0 * ... * z_i) going down
+    for (size_t i = n; i-- > 0; ) {
+        if (bn_is_zero_mod(&in[i].z, prime)) {
+            point_set_infinity(&out[i]);
+            continue;
+        }
+        bn_copy(&scratch[i], &zi);
+        bn_multiply(&acc, &zi, prime);                  // 1/z
+        bn_multiply(&in[i].z, &acc, prime);
+        bn_copy(&zi, &t);
+        bn_multiply(&zi, &t, prime);                    // 1/z^2
+        bn_copy(&in[i].x, &out[i].x);
+        bn_multiply(&t, &out[i].x, prime);
+        bn_multiply(&zi, &t, prime);                    // 1/z^3
+        bn_copy(&in[i].y, &out[i].y);
+        bn_multiply(&t, &out[i].y, prime);
+        bn_mod(&out[i].x, prime);
+        bn_mod(&out[i].y, prime);
+    }
+}
+
+// width-w NAF of k: odd digits, |d| < 2^(w-1), each followed by at least
+// w-1 zeros. Returns the number of digits, at most 257.
+static int wnaf(int8_t naf[257], const bignum256 *k, int w)
+{
+    uint8_t be[32];
+    uint32_t carry = 0;
+    int len = 0;
+
+    bn_write_be(k, be);
+    memset(naf, 0, 257);
+    for (int bit = 0; bit < 257; ) {
+        if (be_bits(be, bit, 1) == carry) {
+            bit++;
+            continue;
+        }
+        int32_t word = (int32_t)(be_bits(be, bit, w) + carry);
+        carry = (word >> (w - 1)) & 1;
+        word -= (int32_t)(carry << w);
+        naf[bit] = (int8_t)word;
+        len = bit + 1;
+        bit += w;
+    }
+    return len;
+}
+
+// jp += d * (odd multiples in tab), d odd or 0
+static void add_digit(ecmult_gen_jacobian *jp, const curve_point *tab, int d, const ecdsa_curve *curve)
+{
+    curve_point p;
+
+    if (d > 0) {
+        jacobian_add_affine_var(jp, &tab[d >> 1], curve);
+    } else if (d < 0) {
+        bn_copy(&tab[-d >> 1].x, &p.x);
+        bn_subtract(&curve->prime, &tab[-d >> 1].y, &p.y);
+        jacobian_add_affine_var(jp, &p, curve);
+    }
+}
+
+void ecmult_gen_prepare(ecmult_gen_table *t)
+{
+    if (t->lazy) {
+        ecmult_gen_build(t, t->max_level);
+    }
+    if (!t->have_odd) {
+        ecmult_gen_jacobian odd[ECMULT_STRAUSS_G_POINTS];
+        bignum256 scratch[ECMULT_STRAUSS_G_POINTS];
+
+        ecmult_gen_odd_multiples(t->curve, &t->curve->G, odd, ECMULT_STRAUSS_G_POINTS);
+        ecmult_gen_batch_affine(t->curve, odd, t->odd, ECMULT_STRAUSS_G_POINTS, scratch);
+        t->have_odd = true;
+    }
+}
+
+void ecmult_gen_strauss(ecmult_gen_table *t, const bignum256 *u1, const bignum256 *u2,
+                        const curve_point qodd[ECMULT_STRAUSS_Q_POINTS], ecmult_gen_jacobian *res)
+{
+    const ecdsa_curve *curve = t->curve;
+    int8_t n1[257], n2[257];
+
+    ecmult_gen_prepare(t);
+
+    int len1 = wnaf(n1, u1, ECMULT_STRAUSS_G_WIDTH);
+    int len2 = wnaf(n2, u2, ECMULT_STRAUSS_Q_WIDTH);
+
+    bn_zero(&res->x);
+    bn_zero(&res->y);
+    bn_zero(&res->z);
+    for (int i = (len1 > len2 ? len1 : len2) - 1; i >= 0; i--) {
+        jacobian_double(res, curve);
+        add_digit(res, t->odd, n1[i], curve);
+        add_digit(res, qodd, n2[i], curve);
+    }
+}
+
+void ecmult_gen_var(ecmult_gen_table *t, const bignum256 *k, curve_point *res)
+{
+    const ecdsa_curve *curve = t->curve;
+    const bignum256 *prime = &curve->prime;
+    ecmult_gen_jacobian jp;
+    bignum256 zi, zz;
+    int neg = 0;
+
+    if (bn_is_zero(k)) {
+        point_set_infinity(res);
+        return;
+    }
+    ecmult_gen_prepare(t);
+
+    if (t->level) {
+        // the digits of ecmult_gen_window(), but each point read directly
+        const int w = ECMULT_GEN_WIDTH(t->level);
+        const int m = ECMULT_GEN_WINDOWS(t->level);
+        const int per = 1 << (w - 1);
+        bignum256 a;
+        uint8_t abuf[32];
+
+        neg = !(k->val[0] & 1);
+        if (neg) {
+            bn_subtract(&curve->order, k, &a);
+        } else {
+            bn_copy(k, &a);
+        }
+        bn_write_be(&a, abuf);
+
+        bn_zero(&jp.x);
+        bn_zero(&jp.y);
+        bn_zero(&jp.z);
+        for (int i = 0; i < m; i++) {
+            uint32_t v = be_bits(abuf, w * i, w + 1) | 1;
+            int d = (int)v - (1 << w);
+            add_digit(&jp, &t->points[i * per], d, curve);
+        }
+        jacobian_add_affine_var(&jp, &t->top, curve);
+    } else {
+        bignum256 zero;
+
+        bn_zero(&zero);
+        ecmult_gen_strauss(t, k, &zero, NULL, &jp);
+    }
+
+    if (bn_is_zero_mod(&jp.z, prime)) {
+        point_set_infinity(res);
+        return;
+    }
+    bn_mod(&jp.z, prime);
+    bn_copy(&jp.z, &zi);
+    bn_inverse(&zi, prime);
+    bn_copy(&zi, &zz);
+    bn_multiply(&zi, &zz, prime);           // 1/z^2
+    bn_multiply(&zz, &jp.x, prime);
+    bn_multiply(&zi, &zz, prime);           // 1/z^3
+    bn_multiply(&zz, &jp.y, prime);
+    bn_mod(&jp.x, prime);
+    bn_mod(&jp.y, prime);
+    bn_copy(&jp.x, &res->x);
+    if (neg) {
+        bn_subtract(prime, &jp.y, &res->y);
+    } else {
+        bn_copy(&jp.y, &res->y);
+    }
+}
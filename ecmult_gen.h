@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * Fixed-base scalar multiplication (k*G) from a window table held in RAM.
+ *
+ */
+
+#ifndef __ECMULT_GEN_H__
+#define __ECMULT_GEN_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "ecdsa.h"
+
+// Table level to reserve RAM for, per curve; it is built on first use.
+//   0 = none, just use trezor-crypto's scalar_multiply()
+//   1 = 4-bit windows,  512 points,  ~37k (like trezor-crypto's ROM table,
+//       for builds without USE_PRECOMPUTED_CP)
+//   2 = 6-bit windows, 1376 points,  ~99k
+//   3 = 8-bit windows, 4096 points, ~295k
+#ifndef ECMULT_GEN_LEVEL
+#define ECMULT_GEN_LEVEL 0
+#endif
+
+#define ECMULT_GEN_MAX_LEVEL        3
+#define ECMULT_GEN_WIDTH(level)     ((level) == 1 ? 4 : ((level) == 2 ? 6 : 8))
+#define ECMULT_GEN_WINDOWS(level)   ((256 + ECMULT_GEN_WIDTH(level) - 1) / ECMULT_GEN_WIDTH(level))
+#define ECMULT_GEN_POINTS(level)    (ECMULT_GEN_WINDOWS(level) << (ECMULT_GEN_WIDTH(level) - 1))
+
+// Jacobian coordinates: x = X/Z^2, y = Y/Z^3, and Z = 0 is infinity
+typedef struct {
+    bignum256 x, y, z;
+} ecmult_gen_jacobian;
+
+// wNAF widths of ecmult_gen_strauss(), and the odd multiples they need
+#define ECMULT_STRAUSS_G_WIDTH      5
+#define ECMULT_STRAUSS_Q_WIDTH      4
+#define ECMULT_STRAUSS_G_POINTS     (1 << (ECMULT_STRAUSS_G_WIDTH - 2))
+#define ECMULT_STRAUSS_Q_POINTS     (1 << (ECMULT_STRAUSS_Q_WIDTH - 2))
+
+typedef struct {
+    const ecdsa_curve *curve;
+    curve_point *points;        // room for ECMULT_GEN_POINTS(max_level)
+    int max_level;
+    int level;                  // currently built, 0 if none
+    bool lazy;                  // build max_level on first use
+    curve_point top;            // 2^(width * windows) * G
+    bool have_odd;
+    curve_point odd[ECMULT_STRAUSS_G_POINTS];   // G, 3G, 5G, ... for verifying
+} ecmult_gen_table;
+
+// declare a (static) table for a curve, sized by ECMULT_GEN_LEVEL
+#if ECMULT_GEN_LEVEL
+#define ECMULT_GEN_TABLE(name, crv) \
+    static curve_point name##_points[ECMULT_GEN_POINTS(ECMULT_GEN_LEVEL)]; \
+    static ecmult_gen_table name = { &(crv), name##_points, ECMULT_GEN_LEVEL, 0, true }
+#else
+#define ECMULT_GEN_TABLE(name, crv) \
+    static ecmult_gen_table name = { &(crv), NULL, 0, 0, false }
+#endif
+
+int ecmult_gen_build(ecmult_gen_table *t, int level);
+void ecmult_gen(ecmult_gen_table *t, const bignum256 *k, curve_point *res);
+
+// same as the ecdsa_* functions, but k*G comes from the table
+void ecmult_gen_get_public_key33(ecmult_gen_table *t, const uint8_t *priv_key, uint8_t *pub_key);
+void ecmult_gen_get_public_key65(ecmult_gen_table *t, const uint8_t *priv_key, uint8_t *pub_key);
+int ecmult_gen_sign_digest(ecmult_gen_table *t, const uint8_t *priv_key, const uint8_t *digest, uint8_t *sig,
+                           uint8_t *pby, int (*is_canonical)(uint8_t by, uint8_t sig[64]));
+
+// Build whatever ecmult_gen() and ecmult_gen_var() would build on first
+// use, so that they can then run on several threads at once.
+void ecmult_gen_prepare(ecmult_gen_table *t);
+
+// For verifying signatures and deriving public keys, so not constant time.
+//
+// k*G for a public 0 <= k < order, without random numbers (no blinding) so
+// that, after ecmult_gen_prepare(), it is safe to call from several threads.
+void ecmult_gen_var(ecmult_gen_table *t, const bignum256 *k, curve_point *res);
+//
+// out[j] = (2j + 1) * q, for j < n
+void ecmult_gen_odd_multiples(const ecdsa_curve *curve, const curve_point *q, ecmult_gen_jacobian *out, int n);
+
+// Jacobian to affine with one inversion for all n points (Montgomery's
+// trick); scratch has room for n numbers. Infinity comes out as
+// point_set_infinity() makes it.
+void ecmult_gen_batch_affine(const ecdsa_curve *curve, const ecmult_gen_jacobian *in, curve_point *out, size_t n,
+                             bignum256 *scratch);
+
+// res = u1 * G + u2 * q in one Strauss/Shamir ladder: wNAF digits of both,
+// one chain of doublings. qodd is q, 3q, 5q, 7q in affine coordinates.
+void ecmult_gen_strauss(ecmult_gen_table *t, const bignum256 *u1, const bignum256 *u2,
+                        const curve_point qodd[ECMULT_STRAUSS_Q_POINTS], ecmult_gen_jacobian *res);
+
+#endif
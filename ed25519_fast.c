@@ -0,0 +1,1097 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * Ed25519 verification, one at a time or in batches, and signing with a
+ * key expanded once.
+ *
+ * Each signature (R, s) on message m under key A must satisfy
+ *
+ *      8*s*B = 8*R + 8*h*A,    h = SHA-512(R || A || m) mod l
+ *
+ * With random 128-bit z_i, all n of them hold (except with negligible
+ * chance) when
+ *
+ *      8*(sum(z_i*R_i) + sum((z_i*h_i)*A_i) - sum(z_i*s_i)*B) = 0
+ *
+ * which is one multi-scalar multiplication of 2n+1 points. It is done with
+ * Pippenger's bucket method, using Booth-recoded signed digits so each
+ * window of c bits needs only 2^(c-1) buckets. Everything here is on
+ * public data, so variable time is fine.
+ *
+ * The factor 8 (the cofactor) is there because a key or R may have a
+ * small-order component. Without it, such a signature could fail alone
+ * yet pass in a batch, where the z_i can cancel that component (chance up
+ * to 1/2). With it, both ways give the same answer: ed25519_fast_verify()
+ * checks one signature by the same equation, and is also what a failed
+ * batch falls back to. Both are strict: A and R must be canonical
+ * encodings, and s < l.
+ *
+ */
+
+#include <string.h>
+
+#include "ed25519_fast.h"
+#include "memzero.h"
+#include "rand.h"
+#include "sha2.h"
+
+typedef ed25519_fe fe;
+typedef ed25519_ge ge;
+typedef ed25519_ge_cached ge_cached;
+
+//
+// GF(2^255 - 19)
+//
+
+#ifdef ED25519_FAST_64
+
+typedef unsigned __int128 uint128_t;
+
+#define MASK51 0x7ffffffffffffULL
+
+static const fe fe_one = { { 1 } };
+static const fe fe_d = { { 0x34dca135978a3, 0x1a8283b156ebd, 0x5e7a26001c029, 0x739c663a03cbb, 0x52036cee2b6ff } };
+static const fe fe_d2 = { { 0x69b9426b2f159, 0x35050762add7a, 0x3cf44c0038052, 0x6738cc7407977, 0x2406d9dc56dff } };
+static const fe fe_sqrtm1 = { { 0x61b274a0ea0b0, 0x0d5a5fc8f189d, 0x7ef5e9cbd0c60, 0x78595a6804c9e, 0x2b8324804fc1d } };
+
+static inline uint64_t load64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static inline void store64(uint8_t *p, uint64_t v)
+{
+    for (int i = 0; i < 8; i++) {
+        p[i] = v >> (8 * i);
+    }
+}
+
+// limbs back under 2^51 (limb 1 may be a little over)
+static inline void fe_carry(fe *h)
+{
+    uint64_t c;
+
+    c = h->v[0] >> 51; h->v[0] &= MASK51; h->v[1] += c;
+    c = h->v[1] >> 51; h->v[1] &= MASK51; h->v[2] += c;
+    c = h->v[2] >> 51; h->v[2] &= MASK51; h->v[3] += c;
+    c = h->v[3] >> 51; h->v[3] &= MASK51; h->v[4] += c;
+    c = h->v[4] >> 51; h->v[4] &= MASK51; h->v[0] += 19 * c;
+    c = h->v[0] >> 51; h->v[0] &= MASK51; h->v[1] += c;
+}
+
+static void fe_frombytes(fe *h, const uint8_t s[32])
+{
+    h->v[0] = load64(s) & MASK51;
+    h->v[1] = (load64(s + 6) >> 3) & MASK51;
+    h->v[2] = (load64(s + 12) >> 6) & MASK51;
+    h->v[3] = (load64(s + 19) >> 1) & MASK51;
+    h->v[4] = (load64(s + 24) >> 12) & MASK51;
+}
+
+static void fe_tobytes(uint8_t s[32], const fe *f)
+{
+    fe t = *f;
+    uint64_t q, c;
+
+    fe_carry(&t);
+    // q = 1 if t >= p, then t -= q*p
+    q = (t.v[0] + 19) >> 51;
+    q = (t.v[1] + q) >> 51;
+    q = (t.v[2] + q) >> 51;
+    q = (t.v[3] + q) >> 51;
+    q = (t.v[4] + q) >> 51;
+    t.v[0] += 19 * q;
+    c = t.v[0] >> 51; t.v[0] &= MASK51; t.v[1] += c;
+    c = t.v[1] >> 51; t.v[1] &= MASK51; t.v[2] += c;
+    c = t.v[2] >> 51; t.v[2] &= MASK51; t.v[3] += c;
+    c = t.v[3] >> 51; t.v[3] &= MASK51; t.v[4] += c;
+    t.v[4] &= MASK51;
+
+    store64(s, t.v[0] | (t.v[1] << 51));
+    store64(s + 8, (t.v[1] >> 13) | (t.v[2] << 38));
+    store64(s + 16, (t.v[2] >> 26) | (t.v[3] << 25));
+    store64(s + 24, (t.v[3] >> 39) | (t.v[4] << 12));
+}
+
+static inline void fe_add(fe *h, const fe *f, const fe *g)
+{
+    for (int i = 0; i < 5; i++) {
+        h->v[i] = f->v[i] + g->v[i];
+    }
+    fe_carry(h);
+}
+
+// f + 4p - g, so nothing goes negative
+static inline void fe_sub(fe *h, const fe *f, const fe *g)
+{
+    h->v[0] = f->v[0] + 0x1fffffffffffb4ULL - g->v[0];
+    for (int i = 1; i < 5; i++) {
+        h->v[i] = f->v[i] + 0x1ffffffffffffcULL - g->v[i];
+    }
+    fe_carry(h);
+}
+
+static void fe_mul(fe *h, const fe *f, const fe *g)
+{
+    uint64_t f0 = f->v[0], f1 = f->v[1], f2 = f->v[2], f3 = f->v[3], f4 = f->v[4];
+    uint64_t g0 = g->v[0], g1 = g->v[1], g2 = g->v[2], g3 = g->v[3], g4 = g->v[4];
+    uint64_t g1_19 = 19 * g1, g2_19 = 19 * g2, g3_19 = 19 * g3, g4_19 = 19 * g4;
+    uint128_t r0, r1, r2, r3, r4;
+    uint64_t c;
+
+    r0 = (uint128_t)f0 * g0 + (uint128_t)f1 * g4_19 + (uint128_t)f2 * g3_19 + (uint128_t)f3 * g2_19 + (uint128_t)f4 * g1_19;
+    r1 = (uint128_t)f0 * g1 + (uint128_t)f1 * g0 + (uint128_t)f2 * g4_19 + (uint128_t)f3 * g3_19 + (uint128_t)f4 * g2_19;
+    r2 = (uint128_t)f0 * g2 + (uint128_t)f1 * g1 + (uint128_t)f2 * g0 + (uint128_t)f3 * g4_19 + (uint128_t)f4 * g3_19;
+    r3 = (uint128_t)f0 * g3 + (uint128_t)f1 * g2 + (uint128_t)f2 * g1 + (uint128_t)f3 * g0 + (uint128_t)f4 * g4_19;
+    r4 = (uint128_t)f0 * g4 + (uint128_t)f1 * g3 + (uint128_t)f2 * g2 + (uint128_t)f3 * g1 + (uint128_t)f4 * g0;
+
+    r1 += (uint64_t)(r0 >> 51); h->v[0] = (uint64_t)r0 & MASK51;
+    r2 += (uint64_t)(r1 >> 51); h->v[1] = (uint64_t)r1 & MASK51;
+    r3 += (uint64_t)(r2 >> 51); h->v[2] = (uint64_t)r2 & MASK51;
+    r4 += (uint64_t)(r3 >> 51); h->v[3] = (uint64_t)r3 & MASK51;
+    c = (uint64_t)(r4 >> 51); h->v[4] = (uint64_t)r4 & MASK51;
+    h->v[0] += 19 * c;
+    c = h->v[0] >> 51; h->v[0] &= MASK51; h->v[1] += c;
+}
+
+#else
+
+// limb i holds bits from ceil(25.5 * i): 26 bits in even limbs, 25 in odd
+static const fe fe_one = { { 1 } };
+static const fe fe_d = { { 0x35978a3, 0x0d37284, 0x3156ebd, 0x06a0a0e, 0x001c029,
+                           0x179e898, 0x3a03cbb, 0x1ce7198, 0x2e2b6ff, 0x1480db3 } };
+static const fe fe_d2 = { { 0x2b2f159, 0x1a6e509, 0x22add7a, 0x0d4141d, 0x0038052,
+                            0x0f3d130, 0x3407977, 0x19ce331, 0x1c56dff, 0x0901b67 } };
+static const fe fe_sqrtm1 = { { 0x20ea0b0, 0x186c9d2, 0x08f189d, 0x035697f, 0x0bd0c60,
+                                0x1fbd7a7, 0x2804c9e, 0x1e16569, 0x004fc1d, 0x0ae0c92 } };
+
+#define LIMB_BITS(i)    (26 - ((i) & 1))
+
+#define CARRY(t, i, j, b) do { \
+        int64_t c = (t[i] + ((int64_t)1 << ((b) - 1))) >> (b); \
+        t[j] += c; \
+        t[i] -= c * ((int64_t)1 << (b)); \
+    } while (0)
+
+// limbs back into about +/- 2^25 (or 2^24 for odd ones)
+static void fe_carry64(fe *h, int64_t t[10])
+{
+    CARRY(t, 0, 1, 26); CARRY(t, 4, 5, 26);
+    CARRY(t, 1, 2, 25); CARRY(t, 5, 6, 25);
+    CARRY(t, 2, 3, 26); CARRY(t, 6, 7, 26);
+    CARRY(t, 3, 4, 25); CARRY(t, 7, 8, 25);
+    CARRY(t, 4, 5, 26); CARRY(t, 8, 9, 26);
+    {
+        int64_t c = (t[9] + (1 << 24)) >> 25;
+        t[0] += 19 * c;
+        t[9] -= c * (1 << 25);
+    }
+    CARRY(t, 0, 1, 26);
+    for (int i = 0; i < 10; i++) {
+        h->v[i] = (int32_t)t[i];
+    }
+}
+
+static void fe_frombytes(fe *h, const uint8_t s[32])
+{
+    int64_t t[10];
+    int pos = 0;
+
+    for (int i = 0; i < 10; i++) {
+        uint64_t v = 0;
+        for (int k = 4; k >= 0; k--) {
+            int j = (pos >> 3) + k;
+            v = (v << 8) | (j < 32 ? s[j] : 0);
+        }
+        t[i] = (v >> (pos & 7)) & ((1u << LIMB_BITS(i)) - 1);
+        pos += LIMB_BITS(i);
+    }
+    t[9] &= 0x1ffffff;          // drop bit 255
+    for (int i = 0; i < 10; i++) {
+        h->v[i] = (int32_t)t[i];
+    }
+}
+
+static void fe_tobytes(uint8_t s[32], const fe *f)
+{
+    int32_t h[10];
+    int32_t q, c;
+
+    // q = 1 if f >= p, then f -= q*p, as ref10
+    for (int i = 0; i < 10; i++) {
+        h[i] = f->v[i];
+    }
+    q = (19 * h[9] + (1 << 24)) >> 25;
+    for (int i = 0; i < 10; i++) {
+        q = (h[i] + q) >> LIMB_BITS(i);
+    }
+    h[0] += 19 * q;
+    for (int i = 0; i < 9; i++) {
+        c = h[i] >> LIMB_BITS(i);
+        h[i + 1] += c;
+        h[i] -= c * (1 << LIMB_BITS(i));
+    }
+    c = h[9] >> 25;
+    h[9] -= c * (1 << 25);
+
+    uint64_t acc = 0;
+    int bits = 0, n = 0;
+    for (int i = 0; i < 10; i++) {
+        acc |= (uint64_t)(uint32_t)h[i] << bits;
+        bits += LIMB_BITS(i);
+        while (bits >= 8) {
+            s[n++] = acc & 0xff;
+            acc >>= 8;
+            bits -= 8;
+        }
+    }
+    s[n] = acc & 0xff;
+}
+
+static void fe_add(fe *h, const fe *f, const fe *g)
+{
+    int64_t t[10];
+
+    for (int i = 0; i < 10; i++) {
+        t[i] = (int64_t)f->v[i] + g->v[i];
+    }
+    fe_carry64(h, t);
+}
+
+static void fe_sub(fe *h, const fe *f, const fe *g)
+{
+    int64_t t[10];
+
+    for (int i = 0; i < 10; i++) {
+        t[i] = (int64_t)f->v[i] - g->v[i];
+    }
+    fe_carry64(h, t);
+}
+
+static void fe_mul(fe *h, const fe *fv, const fe *gv)
+{
+    int64_t f2[10], f[10], g[10], g19[10], t[10];
+
+    // limbs i and j, both odd, land one bit above limb i+j; and 2^255 = 19
+    for (int i = 0; i < 10; i++) {
+        f[i] = fv->v[i];
+        f2[i] = 2 * fv->v[i];
+        g[i] = gv->v[i];
+        g19[i] = 19 * (int64_t)gv->v[i];
+    }
+    t[0] = f[0] * g[0] + f2[1] * g19[9] + f[2] * g19[8] + f2[3] * g19[7] + f[4] * g19[6]
+         + f2[5] * g19[5] + f[6] * g19[4] + f2[7] * g19[3] + f[8] * g19[2] + f2[9] * g19[1];
+    t[1] = f[0] * g[1] + f[1] * g[0] + f[2] * g19[9] + f[3] * g19[8] + f[4] * g19[7]
+         + f[5] * g19[6] + f[6] * g19[5] + f[7] * g19[4] + f[8] * g19[3] + f[9] * g19[2];
+    t[2] = f[0] * g[2] + f2[1] * g[1] + f[2] * g[0] + f2[3] * g19[9] + f[4] * g19[8]
+         + f2[5] * g19[7] + f[6] * g19[6] + f2[7] * g19[5] + f[8] * g19[4] + f2[9] * g19[3];
+    t[3] = f[0] * g[3] + f[1] * g[2] + f[2] * g[1] + f[3] * g[0] + f[4] * g19[9]
+         + f[5] * g19[8] + f[6] * g19[7] + f[7] * g19[6] + f[8] * g19[5] + f[9] * g19[4];
+    t[4] = f[0] * g[4] + f2[1] * g[3] + f[2] * g[2] + f2[3] * g[1] + f[4] * g[0]
+         + f2[5] * g19[9] + f[6] * g19[8] + f2[7] * g19[7] + f[8] * g19[6] + f2[9] * g19[5];
+    t[5] = f[0] * g[5] + f[1] * g[4] + f[2] * g[3] + f[3] * g[2] + f[4] * g[1]
+         + f[5] * g[0] + f[6] * g19[9] + f[7] * g19[8] + f[8] * g19[7] + f[9] * g19[6];
+    t[6] = f[0] * g[6] + f2[1] * g[5] + f[2] * g[4] + f2[3] * g[3] + f[4] * g[2]
+         + f2[5] * g[1] + f[6] * g[0] + f2[7] * g19[9] + f[8] * g19[8] + f2[9] * g19[7];
+    t[7] = f[0] * g[7] + f[1] * g[6] + f[2] * g[5] + f[3] * g[4] + f[4] * g[3]
+         + f[5] * g[2] + f[6] * g[1] + f[7] * g[0] + f[8] * g19[9] + f[9] * g19[8];
+    t[8] = f[0] * g[8] + f2[1] * g[7] + f[2] * g[6] + f2[3] * g[5] + f[4] * g[4]
+         + f2[5] * g[3] + f[6] * g[2] + f2[7] * g[1] + f[8] * g[0] + f2[9] * g19[9];
+    t[9] = f[0] * g[9] + f[1] * g[8] + f[2] * g[7] + f[3] * g[6] + f[4] * g[5]
+         + f[5] * g[4] + f[6] * g[3] + f[7] * g[2] + f[8] * g[1] + f[9] * g[0];
+    fe_carry64(h, t);
+}
+
+#endif
+
+static inline void fe_sq(fe *h, const fe *f)
+{
+    fe_mul(h, f, f);
+}
+
+static void fe_neg(fe *h, const fe *f)
+{
+    fe zero;
+
+    memset(&zero, 0, sizeof(zero));
+    fe_sub(h, &zero, f);
+}
+
+static bool fe_iszero(const fe *f)
+{
+    uint8_t s[32], r = 0;
+
+    fe_tobytes(s, f);
+    for (int i = 0; i < 32; i++) {
+        r |= s[i];
+    }
+    return r == 0;
+}
+
+static int fe_isnegative(const fe *f)
+{
+    uint8_t s[32];
+
+    fe_tobytes(s, f);
+    return s[0] & 1;
+}
+
+static void fe_sqn(fe *h, const fe *f, int n)
+{
+    *h = *f;
+    while (n--) {
+        fe_sq(h, h);
+    }
+}
+
+// z^(2^250 - 1), and z^11 on the way
+static void fe_pow250(fe *h, fe *z11, const fe *z)
+{
+    fe z2, z9, a, b, c;
+
+    fe_sq(&z2, z);
+    fe_sqn(&a, &z2, 2);
+    fe_mul(&z9, &a, z);
+    fe_mul(z11, &z9, &z2);
+    fe_sq(&a, z11);
+    fe_mul(&b, &a, &z9);            // 2^5 - 1
+    fe_sqn(&a, &b, 5);
+    fe_mul(&b, &a, &b);             // 2^10 - 1
+    fe_sqn(&a, &b, 10);
+    fe_mul(&c, &a, &b);             // 2^20 - 1
+    fe_sqn(&a, &c, 20);
+    fe_mul(&a, &a, &c);             // 2^40 - 1
+    fe_sqn(&a, &a, 10);
+    fe_mul(&b, &a, &b);             // 2^50 - 1
+    fe_sqn(&a, &b, 50);
+    fe_mul(&c, &a, &b);             // 2^100 - 1
+    fe_sqn(&a, &c, 100);
+    fe_mul(&a, &a, &c);             // 2^200 - 1
+    fe_sqn(&a, &a, 50);
+    fe_mul(h, &a, &b);              // 2^250 - 1
+}
+
+// z^((p-5)/8) = z^(2^252 - 3)
+static void fe_pow22523(fe *h, const fe *z)
+{
+    fe t, z11;
+
+    fe_pow250(&t, &z11, z);
+    fe_sqn(&t, &t, 2);
+    fe_mul(h, &t, z);
+}
+
+// z^(p-2) = 1/z
+static void fe_invert(fe *h, const fe *z)
+{
+    fe t, z11;
+
+    fe_pow250(&t, &z11, z);
+    fe_sqn(&t, &t, 5);
+    fe_mul(h, &t, &z11);
+}
+
+// f = g if b (0 or 1), in constant time
+static void fe_cmov(fe *f, const fe *g, unsigned b)
+{
+    int64_t mask = -(int64_t)b;
+
+    for (size_t i = 0; i < sizeof(f->v) / sizeof(f->v[0]); i++) {
+        f->v[i] ^= (f->v[i] ^ g->v[i]) & mask;
+    }
+}
+
+//
+// Points
+//
+
+static void ge_identity(ge *p)
+{
+    memset(p, 0, sizeof(*p));
+    p->Y = fe_one;
+    p->Z = fe_one;
+}
+
+static bool ge_is_identity(const ge *p)
+{
+    fe t;
+
+    fe_sub(&t, &p->Y, &p->Z);
+    return fe_iszero(&p->X) && fe_iszero(&t);
+}
+
+// Decode a point; false if s is not one, or is not the canonical encoding
+// (y >= p, or x = 0 with the sign bit set).
+static bool ge_frombytes(ge *p, const uint8_t s[32])
+{
+    fe u, v, v3, vxx, check;
+    uint8_t b[32];
+
+    fe_frombytes(&p->Y, s);
+    fe_tobytes(b, &p->Y);
+    b[31] |= s[31] & 0x80;
+    if (memcmp(b, s, 32) != 0) {
+        return false;
+    }
+    p->Z = fe_one;
+
+    // x^2 = u/v = (y^2 - 1)/(d*y^2 + 1), x = u*v^3 * (u*v^7)^((p-5)/8)
+    fe_sq(&u, &p->Y);
+    fe_mul(&v, &u, &fe_d);
+    fe_sub(&u, &u, &fe_one);
+    fe_add(&v, &v, &fe_one);
+    fe_sq(&v3, &v);
+    fe_mul(&v3, &v3, &v);
+    fe_sq(&p->X, &v3);
+    fe_mul(&p->X, &p->X, &v);
+    fe_mul(&p->X, &p->X, &u);
+    fe_pow22523(&p->X, &p->X);
+    fe_mul(&p->X, &p->X, &v3);
+    fe_mul(&p->X, &p->X, &u);
+
+    fe_sq(&vxx, &p->X);
+    fe_mul(&vxx, &vxx, &v);
+    fe_sub(&check, &vxx, &u);
+    if (!fe_iszero(&check)) {
+        fe_add(&check, &vxx, &u);
+        if (!fe_iszero(&check)) {
+            return false;
+        }
+        fe_mul(&p->X, &p->X, &fe_sqrtm1);
+    }
+    if (fe_isnegative(&p->X) != (s[31] >> 7)) {
+        if (fe_iszero(&p->X)) {
+            return false;
+        }
+        fe_neg(&p->X, &p->X);
+    }
+    fe_mul(&p->T, &p->X, &p->Y);
+    return true;
+}
+
+static void ge_to_cached(ge_cached *c, const ge *p, bool negate)
+{
+    if (!negate) {
+        fe_add(&c->YplusX, &p->Y, &p->X);
+        fe_sub(&c->YminusX, &p->Y, &p->X);
+        fe_mul(&c->T2d, &p->T, &fe_d2);
+    } else {
+        fe t;
+        fe_add(&c->YminusX, &p->Y, &p->X);
+        fe_sub(&c->YplusX, &p->Y, &p->X);
+        fe_mul(&t, &p->T, &fe_d2);
+        fe_neg(&c->T2d, &t);
+    }
+    c->Z = p->Z;
+}
+
+static void ge_tobytes(uint8_t s[32], const ge *p)
+{
+    fe recip, x, y;
+
+    fe_invert(&recip, &p->Z);
+    fe_mul(&x, &p->X, &recip);
+    fe_mul(&y, &p->Y, &recip);
+    fe_tobytes(s, &y);
+    s[31] ^= fe_isnegative(&x) << 7;
+}
+
+// r = p + q (add-2008-hwcd-3); r may be p
+static void ge_add(ge *r, const ge *p, const ge_cached *q)
+{
+    fe a, b, c, d, e, f, g, h;
+
+    fe_sub(&a, &p->Y, &p->X);
+    fe_mul(&a, &a, &q->YminusX);
+    fe_add(&b, &p->Y, &p->X);
+    fe_mul(&b, &b, &q->YplusX);
+    fe_mul(&c, &p->T, &q->T2d);
+    fe_mul(&d, &p->Z, &q->Z);
+    fe_add(&d, &d, &d);
+    fe_sub(&e, &b, &a);
+    fe_sub(&f, &d, &c);
+    fe_add(&g, &d, &c);
+    fe_add(&h, &b, &a);
+    fe_mul(&r->X, &e, &f);
+    fe_mul(&r->Y, &g, &h);
+    fe_mul(&r->T, &e, &h);
+    fe_mul(&r->Z, &f, &g);
+}
+
+// r = p - q
+static void ge_sub(ge *r, const ge *p, const ge_cached *q)
+{
+    fe a, b, c, d, e, f, g, h;
+
+    fe_sub(&a, &p->Y, &p->X);
+    fe_mul(&a, &a, &q->YplusX);
+    fe_add(&b, &p->Y, &p->X);
+    fe_mul(&b, &b, &q->YminusX);
+    fe_mul(&c, &p->T, &q->T2d);
+    fe_mul(&d, &p->Z, &q->Z);
+    fe_add(&d, &d, &d);
+    fe_sub(&e, &b, &a);
+    fe_add(&f, &d, &c);
+    fe_sub(&g, &d, &c);
+    fe_add(&h, &b, &a);
+    fe_mul(&r->X, &e, &f);
+    fe_mul(&r->Y, &g, &h);
+    fe_mul(&r->T, &e, &h);
+    fe_mul(&r->Z, &f, &g);
+}
+
+// r = 2p (dbl-2008-hwcd, a = -1); r may be p
+static void ge_dbl(ge *r, const ge *p)
+{
+    fe a, b, c, e, f, g, h;
+
+    fe_sq(&a, &p->X);
+    fe_sq(&b, &p->Y);
+    fe_sq(&c, &p->Z);
+    fe_add(&c, &c, &c);
+    fe_add(&e, &p->X, &p->Y);
+    fe_sq(&e, &e);
+    fe_sub(&e, &e, &a);
+    fe_sub(&e, &e, &b);
+    fe_sub(&g, &b, &a);
+    fe_sub(&f, &g, &c);
+    fe_add(&h, &a, &b);
+    fe_neg(&h, &h);
+    fe_mul(&r->X, &e, &f);
+    fe_mul(&r->Y, &g, &h);
+    fe_mul(&r->T, &e, &h);
+    fe_mul(&r->Z, &f, &g);
+}
+
+//
+// Scalars mod l = 2^252 + 27742317777372353535851937790883648493
+//
+
+static const uint8_t sc_l[32] = {
+    0xed, 0xd3, 0xf5, 0x5c, 0x1a, 0x63, 0x12, 0x58, 0xd6, 0x9c, 0xf7, 0xa2, 0xde, 0xf9, 0xde, 0x14,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0x10
+};
+
+// r = x mod l, from 64 signed byte-sized (or so) limbs; as TweetNaCl
+static void sc_reduce_limbs(uint8_t r[32], int64_t x[64])
+{
+    int64_t carry;
+    int i, j;
+
+    for (i = 63; i >= 32; i--) {
+        carry = 0;
+        for (j = i - 32; j < i - 12; j++) {
+            x[j] += carry - 16 * x[i] * sc_l[j - (i - 32)];
+            carry = (x[j] + 128) >> 8;
+            x[j] -= carry * 256;
+        }
+        x[j] += carry;
+        x[i] = 0;
+    }
+    carry = 0;
+    for (j = 0; j < 32; j++) {
+        x[j] += carry - (x[31] >> 4) * sc_l[j];
+        carry = x[j] >> 8;
+        x[j] &= 255;
+    }
+    for (j = 0; j < 32; j++) {
+        x[j] -= carry * sc_l[j];
+    }
+    for (i = 0; i < 32; i++) {
+        x[i + 1] += x[i] >> 8;
+        r[i] = x[i] & 255;
+    }
+}
+
+static void sc_reduce(uint8_t r[32], const uint8_t h[64])
+{
+    int64_t x[64];
+
+    for (int i = 0; i < 64; i++) {
+        x[i] = h[i];
+    }
+    sc_reduce_limbs(r, x);
+}
+
+// r = a*b + c mod l
+static void sc_muladd(uint8_t r[32], const uint8_t a[32], const uint8_t b[32], const uint8_t c[32])
+{
+    int64_t x[64] = { 0 };
+
+    for (int i = 0; i < 32; i++) {
+        x[i] = c[i];
+    }
+    for (int i = 0; i < 32; i++) {
+        for (int j = 0; j < 32; j++) {
+            x[i + j] += (int64_t)a[i] * b[j];
+        }
+    }
+    sc_reduce_limbs(r, x);
+}
+
+static bool sc_is_canonical(const uint8_t s[32])
+{
+    for (int i = 31; i >= 0; i--) {
+        if (s[i] != sc_l[i]) {
+            return s[i] < sc_l[i];
+        }
+    }
+    return false;
+}
+
+//
+// Multi-scalar multiplication
+//
+
+// Booth digit j of width c: bits [c*j - 1, c*j + c - 1] of s, giving
+// s = sum(d_j * 2^(c*j)) with -2^(c-1) <= d_j <= 2^(c-1)
+static int booth_digit(const uint8_t s[32], int j, int c)
+{
+    int pos = c * j + 7;            // of the lowest bit, plus 8
+    uint32_t u = 0;
+
+    // c + 1 bits, reading zeros below bit 0 and above bit 255
+    for (int k = 2; k >= 0; k--) {
+        int i = (pos >> 3) - 1 + k;
+        u = (u << 8) | ((i >= 0 && i < 32) ? s[i] : 0);
+    }
+    u = (u >> (pos & 7)) & ((2u << c) - 1);
+    return (int)((u >> 1) + (u & 1)) - (int)((u >> c) << c);
+}
+
+// the window width that needs the fewest additions for np points
+static int msm_window(size_t np)
+{
+    int best = 2;
+    size_t best_cost = (size_t)-1;
+
+    for (int c = 2; c <= ED25519_MSM_MAX_WINDOW; c++) {
+        size_t cost = ((254 + c - 1) / c) * (np + (2u << (c - 1)));
+        if (cost < best_cost) {
+            best = c;
+            best_cost = cost;
+        }
+    }
+    return best;
+}
+
+// r = sum(scalars[i] * points[i]); scalars must be < 2^253
+static void msm(ge *r, ed25519_batch_scratch *w, size_t np)
+{
+    int c = msm_window(np);
+    int windows = (254 + c - 1) / c;
+    int nb = 1 << (c - 1);
+    ge acc, sum;
+    ge_cached t;
+
+    ge_identity(r);
+    for (int j = windows - 1; j >= 0; j--) {
+        for (int k = 0; k < c; k++) {
+            ge_dbl(r, r);
+        }
+
+        for (int b = 0; b < nb; b++) {
+            ge_identity(&w->buckets[b]);
+        }
+        for (size_t i = 0; i < np; i++) {
+            int d = booth_digit(w->scalars[i], j, c);
+            if (d > 0) {
+                ge_add(&w->buckets[d - 1], &w->buckets[d - 1], &w->points[i]);
+            } else if (d < 0) {
+                ge_sub(&w->buckets[-d - 1], &w->buckets[-d - 1], &w->points[i]);
+            }
+        }
+
+        // sum(b * bucket[b-1]), as a running sum from the top
+        ge_identity(&acc);
+        ge_identity(&sum);
+        for (int b = nb - 1; b >= 0; b--) {
+            ge_to_cached(&t, &w->buckets[b], false);
+            ge_add(&acc, &acc, &t);
+            ge_to_cached(&t, &acc, false);
+            ge_add(&sum, &sum, &t);
+        }
+        ge_to_cached(&t, &sum, false);
+        ge_add(r, r, &t);
+    }
+}
+
+//
+// Batch verification
+//
+
+static const uint8_t base_point[32] = {
+    0x58, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66,
+    0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66, 0x66
+};
+
+// true if all n signatures are valid, and strictly encoded
+static bool verify_batch(ed25519_batch_scratch *w, const uint8_t *const *m, const size_t *mlen,
+                         const uint8_t *const *pk, const uint8_t *const *sig, size_t n)
+{
+    uint8_t sum[32] = { 0 }, zero[32] = { 0 }, z[32] = { 0 }, hram[64];
+    SHA512_CTX ctx;
+    ge p;
+
+    for (size_t i = 0; i < n; i++) {
+        if (!sc_is_canonical(sig[i] + 32)) {
+            return false;
+        }
+        if (!ge_frombytes(&p, sig[i])) {
+            return false;
+        }
+        ge_to_cached(&w->points[2 * i + 1], &p, false);
+        if (!ge_frombytes(&p, pk[i])) {
+            return false;
+        }
+        ge_to_cached(&w->points[2 * i + 2], &p, false);
+
+        sha512_Init(&ctx);
+        sha512_Update(&ctx, sig[i], 32);
+        sha512_Update(&ctx, pk[i], 32);
+        sha512_Update(&ctx, m[i], mlen[i]);
+        sha512_Final(&ctx, hram);
+        sc_reduce(hram, hram);
+
+        random_buffer(z, 16);
+        memcpy(w->scalars[2 * i + 1], z, 32);
+        sc_muladd(w->scalars[2 * i + 2], z, hram, zero);
+        sc_muladd(sum, z, sig[i] + 32, sum);
+    }
+
+    // ... and -sum(z_i*s_i) * B
+    ge_frombytes(&p, base_point);
+    ge_to_cached(&w->points[0], &p, true);
+    memcpy(w->scalars[0], sum, 32);
+
+    msm(&p, w, 2 * n + 1);
+    for (int k = 0; k < 3; k++) {
+        ge_dbl(&p, &p);
+    }
+    return ge_is_identity(&p);
+}
+
+// table[j] = (j + 1)*p, for Booth digits of width 5
+static void multiples16(ge_cached table[16], const ge *p)
+{
+    ge q = *p;
+
+    ge_to_cached(&table[0], p, false);
+    for (int j = 1; j < 16; j++) {
+        ge_add(&q, &q, &table[0]);
+        ge_to_cached(&table[j], &q, false);
+    }
+}
+
+// One signature, by the same equation: s*B - h*A on one chain of
+// doublings, with Booth-recoded 5-bit digits of both.
+bool ed25519_fast_verify(const uint8_t *m, size_t mlen, const uint8_t pk[32], const uint8_t sig[64])
+{
+    uint8_t hram[64];
+    SHA512_CTX ctx;
+    ge a, r, p;
+    ge_cached t, btab[16], atab[16];
+
+    if (!sc_is_canonical(sig + 32) || !ge_frombytes(&a, pk) || !ge_frombytes(&r, sig)) {
+        return false;
+    }
+
+    sha512_Init(&ctx);
+    sha512_Update(&ctx, sig, 32);
+    sha512_Update(&ctx, pk, 32);
+    sha512_Update(&ctx, m, mlen);
+    sha512_Final(&ctx, hram);
+    sc_reduce(hram, hram);
+
+    ge_frombytes(&p, base_point);
+    multiples16(btab, &p);
+    multiples16(atab, &a);
+
+    ge_identity(&p);
+    for (int j = (254 + 4) / 5 - 1; j >= 0; j--) {
+        for (int k = 0; k < 5; k++) {
+            ge_dbl(&p, &p);
+        }
+        int d = booth_digit(sig + 32, j, 5);
+        if (d > 0) {
+            ge_add(&p, &p, &btab[d - 1]);
+        } else if (d < 0) {
+            ge_sub(&p, &p, &btab[-d - 1]);
+        }
+        d = booth_digit(hram, j, 5);
+        if (d > 0) {
+            ge_sub(&p, &p, &atab[d - 1]);
+        } else if (d < 0) {
+            ge_add(&p, &p, &atab[-d - 1]);
+        }
+    }
+
+    // 8*(s*B - h*A - R)
+    ge_to_cached(&t, &r, false);
+    ge_sub(&p, &p, &t);
+    for (int k = 0; k < 3; k++) {
+        ge_dbl(&p, &p);
+    }
+    return ge_is_identity(&p);
+}
+
+bool ed25519_fast_verify_batch(ed25519_batch_scratch *scratch, const uint8_t *const *m, const size_t *mlen,
+                               const uint8_t *const *pk, const uint8_t *const *sig, size_t n, bool *valid)
+{
+    bool all = true;
+
+    // batches as even as can be, none over the limit
+    size_t batches = (n + ED25519_BATCH_MAX - 1) / ED25519_BATCH_MAX;
+    for (size_t done = 0; done < n; batches--) {
+        size_t count = (n - done + batches - 1) / batches;
+        bool ok = count > 1 && verify_batch(scratch, m + done, mlen + done, pk + done, sig + done, count);
+        for (size_t i = done; i < done + count; i++) {
+            valid[i] = ok || ed25519_fast_verify(m[i], mlen[i], pk[i], sig[i]);
+            all = all && valid[i];
+        }
+        done += count;
+    }
+    return all;
+}
+
+//
+// Signing
+//
+// k*B is the sum of one entry from each of 32 tables, for k in signed
+// base-16 digits (ref10's layout): table i holds j * 256^i * B for
+// j = 1..8, and the odd digits' sum is multiplied by 16. Entries are read
+// in constant time. The tables (about 30k, affine) are const, made by
+// "make ed25519_fast_table.h" with ED25519_FAST_GEN_TABLE defined.
+//
+
+// an affine point, ready to be added: y+x, y-x, 2dxy
+typedef struct {
+    fe YplusX, YminusX, T2d;
+} ge_precomp;
+
+// r = p + q, for affine q; r may be p
+static void ge_madd(ge *r, const ge *p, const ge_precomp *q)
+{
+    fe a, b, c, d, e, f, g, h;
+
+    fe_sub(&a, &p->Y, &p->X);
+    fe_mul(&a, &a, &q->YminusX);
+    fe_add(&b, &p->Y, &p->X);
+    fe_mul(&b, &b, &q->YplusX);
+    fe_mul(&c, &p->T, &q->T2d);
+    fe_add(&d, &p->Z, &p->Z);
+    fe_sub(&e, &b, &a);
+    fe_sub(&f, &d, &c);
+    fe_add(&g, &d, &c);
+    fe_add(&h, &b, &a);
+    fe_mul(&r->X, &e, &f);
+    fe_mul(&r->Y, &g, &h);
+    fe_mul(&r->T, &e, &h);
+    fe_mul(&r->Z, &f, &g);
+}
+
+#ifdef ED25519_FAST_GEN_TABLE
+static ge_precomp base_table[32][8];
+
+// fully reduced, as printed
+static void fe_normalize(fe *f)
+{
+    uint8_t b[32];
+
+    fe_tobytes(b, f);
+    fe_frombytes(f, b);
+}
+
+static void base_table_init(void)
+{
+    ge p, q;
+    ge_cached c;
+    fe recip, x, y;
+
+    ge_frombytes(&p, base_point);
+    for (int i = 0; i < 32; i++) {
+        q = p;
+        ge_to_cached(&c, &p, false);
+        for (int j = 0; j < 8; j++) {
+            ge_precomp *e = &base_table[i][j];
+
+            fe_invert(&recip, &q.Z);
+            fe_mul(&x, &q.X, &recip);
+            fe_mul(&y, &q.Y, &recip);
+            fe_add(&e->YplusX, &y, &x);
+            fe_sub(&e->YminusX, &y, &x);
+            fe_mul(&e->T2d, &x, &y);
+            fe_mul(&e->T2d, &e->T2d, &fe_d2);
+            fe_normalize(&e->YplusX);
+            fe_normalize(&e->YminusX);
+            fe_normalize(&e->T2d);
+            ge_add(&q, &q, &c);
+        }
+        // p = 256 * p
+        for (int k = 0; k < 8; k++) {
+            ge_dbl(&p, &p);
+        }
+    }
+}
+#else
+#include "ed25519_fast_table.h"
+#endif
+
+// t = b * table[pos], for -8 <= b <= 8, in constant time
+static void base_select(ge_precomp *t, int pos, int8_t b)
+{
+    unsigned negative = (uint8_t)b >> 7;
+    unsigned babs = b - ((-(int)negative & b) * 2);
+    ge_precomp neg;
+
+    memset(t, 0, sizeof(*t));
+    t->YplusX = fe_one;
+    t->YminusX = fe_one;
+    for (unsigned j = 0; j < 8; j++) {
+        unsigned eq = ((babs ^ (j + 1)) - 1) >> 31;
+        fe_cmov(&t->YplusX, &base_table[pos][j].YplusX, eq);
+        fe_cmov(&t->YminusX, &base_table[pos][j].YminusX, eq);
+        fe_cmov(&t->T2d, &base_table[pos][j].T2d, eq);
+    }
+    neg.YplusX = t->YminusX;
+    neg.YminusX = t->YplusX;
+    fe_neg(&neg.T2d, &t->T2d);
+    fe_cmov(&t->YplusX, &neg.YplusX, negative);
+    fe_cmov(&t->YminusX, &neg.YminusX, negative);
+    fe_cmov(&t->T2d, &neg.T2d, negative);
+}
+
+// r = k*B, in constant time; k < 2^255
+static void ge_scalarmult_base(ge *r, const uint8_t k[32])
+{
+    int8_t e[64], carry = 0;
+    ge_precomp t;
+
+    for (int i = 0; i < 32; i++) {
+        e[2 * i] = k[i] & 15;
+        e[2 * i + 1] = k[i] >> 4;
+    }
+    for (int i = 0; i < 63; i++) {
+        e[i] += carry;
+        carry = (e[i] + 8) >> 4;
+        e[i] -= carry * 16;
+    }
+    e[63] += carry;
+
+    ge_identity(r);
+    for (int i = 1; i < 64; i += 2) {
+        base_select(&t, i / 2, e[i]);
+        ge_madd(r, r, &t);
+    }
+    for (int k = 0; k < 4; k++) {
+        ge_dbl(r, r);
+    }
+    for (int i = 0; i < 64; i += 2) {
+        base_select(&t, i / 2, e[i]);
+        ge_madd(r, r, &t);
+    }
+    memzero(e, sizeof(e));
+    memzero(&t, sizeof(t));
+}
+
+void ed25519_fast_key_init(ed25519_fast_key *key, const uint8_t secret[32])
+{
+    uint8_t h[64];
+    ge a;
+
+    sha512_Raw(secret, 32, h);
+    h[0] &= 248;
+    h[31] &= 127;
+    h[31] |= 64;
+    memcpy(key->scalar, h, 32);
+    memcpy(key->prefix, h + 32, 32);
+    ge_scalarmult_base(&a, key->scalar);
+    ge_tobytes(key->public_key, &a);
+    memzero(h, sizeof(h));
+    memzero(&a, sizeof(a));
+}
+
+void ed25519_fast_sign(const ed25519_fast_key *key, const uint8_t *m, size_t mlen, uint8_t sig[64])
+{
+    uint8_t r[64], hram[64];
+    SHA512_CTX ctx;
+    ge p;
+
+    // r = H(prefix || m), R = r*B
+    sha512_Init(&ctx);
+    sha512_Update(&ctx, key->prefix, 32);
+    sha512_Update(&ctx, m, mlen);
+    sha512_Final(&ctx, r);
+    sc_reduce(r, r);
+    ge_scalarmult_base(&p, r);
+    ge_tobytes(sig, &p);
+
+    // S = r + H(R || A || m) * a
+    sha512_Init(&ctx);
+    sha512_Update(&ctx, sig, 32);
+    sha512_Update(&ctx, key->public_key, 32);
+    sha512_Update(&ctx, m, mlen);
+    sha512_Final(&ctx, hram);
+    sc_reduce(hram, hram);
+    sc_muladd(sig + 32, hram, key->scalar, r);
+
+    memzero(r, sizeof(r));
+    memzero(&p, sizeof(p));
+}
+
+#ifdef ED25519_FAST_GEN_TABLE
+#include <stdio.h>
+
+static void print_fe(const fe *f)
+{
+    printf("{ {");
+    for (size_t i = 0; i < sizeof(f->v) / sizeof(f->v[0]); i++) {
+#ifdef ED25519_FAST_64
+        printf(" 0x%013llx%s", (unsigned long long)f->v[i], i < 4 ? "," : "");
+#else
+        printf(" %ld%s", (long)f->v[i], i < 9 ? "," : "");
+#endif
+    }
+    printf(" } }");
+}
+
+// Print base_table for this build's limbs. The 64-bit build writes the
+// head of ed25519_fast_table.h, the ED25519_FAST_32 one the rest.
+int main(void)
+{
+    base_table_init();
+#ifdef ED25519_FAST_64
+    printf("// Made by \"make ed25519_fast_table.h\" from ed25519_fast.c; do not edit.\n");
+    printf("// Entry [i][j] is (j + 1) * 256^i * B.\n\n#ifdef ED25519_FAST_64\n");
+#else
+    printf("#else\n");
+#endif
+    printf("static const ge_precomp base_table[32][8] = {\n");
+    for (int i = 0; i < 32; i++) {
+        printf("    {\n");
+        for (int j = 0; j < 8; j++) {
+            printf("        {\n            ");
+            print_fe(&base_table[i][j].YplusX);
+            printf(",\n            ");
+            print_fe(&base_table[i][j].YminusX);
+            printf(",\n            ");
+            print_fe(&base_table[i][j].T2d);
+            printf("\n        },\n");
+        }
+        printf("    },\n");
+    }
+    printf("};\n");
+#ifndef ED25519_FAST_64
+    printf("#endif\n");
+#endif
+    return 0;
+}
+#endif
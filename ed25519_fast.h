@@ -0,0 +1,83 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * Ed25519 verification, one at a time or in batches, and signing with a
+ * key expanded once, with its own field and group arithmetic: 51-bit limbs
+ * where the compiler has 128-bit integers, and 25.5-bit limbs (as in ref10)
+ * otherwise.
+ *
+ */
+
+#ifndef __ED25519_FAST_H__
+#define __ED25519_FAST_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// signatures checked by one multi-scalar multiplication; the scratch space
+// below is about 400 bytes per signature
+#ifndef ED25519_BATCH_MAX
+#define ED25519_BATCH_MAX 128
+#endif
+
+// widest Pippenger window, so the most buckets are 2^(this-1)
+#define ED25519_MSM_MAX_WINDOW 7
+
+// define ED25519_FAST_32 for the 25.5-bit limbs everywhere
+#if defined(__SIZEOF_INT128__) && !defined(ED25519_FAST_32)
+#define ED25519_FAST_64 1
+typedef struct {
+    uint64_t v[5];
+} ed25519_fe;
+#else
+typedef struct {
+    int32_t v[10];
+} ed25519_fe;
+#endif
+
+// extended coordinates: x = X/Z, y = Y/Z, xy = T/Z
+typedef struct {
+    ed25519_fe X, Y, Z, T;
+} ed25519_ge;
+
+// ready to be added: Y+X, Y-X, Z, 2dT
+typedef struct {
+    ed25519_fe YplusX, YminusX, Z, T2d;
+} ed25519_ge_cached;
+
+typedef struct {
+    ed25519_ge_cached points[2 * ED25519_BATCH_MAX + 1];
+    uint8_t scalars[2 * ED25519_BATCH_MAX + 1][32];
+    ed25519_ge buckets[1 << (ED25519_MSM_MAX_WINDOW - 1)];
+} ed25519_batch_scratch;
+
+// Verify a signature (64 bytes) of m under a public key (32 bytes), with the
+// cofactor: see ed25519_fast.c. Strict about encodings, as RFC 8032 is.
+bool ed25519_fast_verify(const uint8_t *m, size_t mlen, const uint8_t pk[32], const uint8_t sig[64]);
+
+// Verify n signatures (64 bytes each) of messages under public keys (32
+// bytes each), and set valid[i] as ed25519_fast_verify() would. Returns
+// true if all are valid. Batches that fail are checked one signature at a
+// time, so a bad entry costs about a batch.
+bool ed25519_fast_verify_batch(ed25519_batch_scratch *scratch, const uint8_t *const *m, const size_t *mlen,
+                               const uint8_t *const *pk, const uint8_t *const *sig, size_t n, bool *valid);
+
+// A secret key (RFC 8032's 32-byte seed) expanded for signing: the clamped
+// scalar and nonce prefix from SHA-512 of the seed, and the public key.
+typedef struct {
+    uint8_t scalar[32];
+    uint8_t prefix[32];
+    uint8_t public_key[32];
+} ed25519_fast_key;
+
+void ed25519_fast_key_init(ed25519_fast_key *key, const uint8_t secret[32]);
+
+// the same signature as ed25519_sign(), in constant time
+void ed25519_fast_sign(const ed25519_fast_key *key, const uint8_t *m, size_t mlen, uint8_t sig[64]);
+
+#endif
@@ -0,0 +1,35 @@
+#
+# MicroPython USER_C_MODULES fragment; see "make unix" in ./Makefile.
+#
+# trezor-crypto is linked as the shared library built by its own Makefile,
+# so its sources stay out of the qstr scan. Its default random32() is NOT
+# suitable for production use; this build is for testing and benchmarks.
+#
+
+TCC_MOD_DIR := $(USERMOD_DIR)
+TCC_TC_DIR := $(TCC_MOD_DIR)/trezor-crypto
+
+SRC_USERMOD += $(TCC_MOD_DIR)/modtcc.c
+SRC_USERMOD += $(TCC_MOD_DIR)/aes_gcm.c
+SRC_USERMOD += $(TCC_MOD_DIR)/aes_hw.c
+SRC_USERMOD += $(TCC_MOD_DIR)/b58_fast.c
+SRC_USERMOD += $(TCC_MOD_DIR)/bech32_fast.c
+SRC_USERMOD += $(TCC_MOD_DIR)/bip32_cache.c
+SRC_USERMOD += $(TCC_MOD_DIR)/chacha_poly.c
+SRC_USERMOD += $(TCC_MOD_DIR)/crc.c
+SRC_USERMOD += $(TCC_MOD_DIR)/ecmult_gen.c
+SRC_USERMOD += $(TCC_MOD_DIR)/ed25519_fast.c
+SRC_USERMOD += $(TCC_MOD_DIR)/sha_hw.c
+SRC_USERMOD += $(TCC_MOD_DIR)/sha_mb.c
+
+CFLAGS_USERMOD += -I$(TCC_MOD_DIR) -I$(TCC_TC_DIR)
+CFLAGS_USERMOD += -DMICROPY_PY_TREZORCRYPTO=1 -DUSE_KECCAK=1
+
+# RAM for the largest k*G table (~295k per curve); see ecmult_gen.h
+CFLAGS_USERMOD += -DECMULT_GEN_LEVEL=3
+
+LDFLAGS_USERMOD += -L$(TCC_TC_DIR) -ltrezor-crypto -Wl,-rpath,$(TCC_TC_DIR)
+
+# bip39.seed_many() and ChaCha20Poly1305 stream_encrypt()/stream_decrypt()
+# worker threads
+LDFLAGS_USERMOD += -lpthread
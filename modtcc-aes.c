@@ -8,6 +8,7 @@
 #include "py/objstr.h"
 
 #include "aes/aes.h"
+#include "aes_hw.h"
 
 /// class AES:
 ///     '''
@@ -18,8 +19,14 @@ typedef struct _mp_obj_AES_t {
     union {
         aes_encrypt_ctx encrypt_ctx;
         aes_decrypt_ctx decrypt_ctx;
+#ifdef AES_HW
+        aes_hw_ctx hw;
+#endif
     } ctx;
     mp_int_t mode;
+#ifdef AES_HW
+    bool hw;
+#endif
     uint8_t iv[AES_BLOCK_SIZE];
     uint8_t ctr[AES_BLOCK_SIZE];
 } mp_obj_AES_t;
@@ -66,6 +73,15 @@ STATIC mp_obj_t mod_trezorcrypto_AES_make_new(const mp_obj_type_t *type, size_t
     // for CTR modes, use IV
     memcpy(o->ctr, o->iv, AES_BLOCK_SIZE);
 
+#ifdef AES_HW
+    // ECB, CBC and CTR use the CPU's AES instructions if it has them
+    mp_int_t m = o->mode & AESModeMask;
+    o->hw = (m == ECB || m == CBC || m == CTR) && aes_hw_init(&(o->ctx.hw), key.buf, key.len);
+    if (o->hw) {
+        return MP_OBJ_FROM_PTR(o);
+    }
+#endif
+
     switch (key.len) {
         default:
             mp_raise_ValueError("Invalid/unsupported key length");
@@ -101,67 +117,112 @@ STATIC mp_obj_t mod_trezorcrypto_AES_make_new(const mp_obj_type_t *type, size_t
     return MP_OBJ_FROM_PTR(o);
 }
 
-/// def update(self, data: bytes) -> bytes:
-///     '''
-///     Update AES context with data.
-///     '''
-STATIC mp_obj_t mod_trezorcrypto_AES_update(mp_obj_t self, mp_obj_t data) {
-    mp_buffer_info_t buf;
-    mp_get_buffer_raise(data, &buf, MP_BUFFER_READ);
-    if (buf.len == 0) {
-        return mp_const_empty_bytes;
-    }
-    vstr_t vstr;
-    vstr_init_len(&vstr, buf.len);
-    mp_obj_AES_t *o = MP_OBJ_TO_PTR(self);
+STATIC void aes_crypt(mp_obj_AES_t *o, const uint8_t *in, uint8_t *out, size_t len) {
     switch (o->mode & AESModeMask) {
         case ECB:
-            if (buf.len & (AES_BLOCK_SIZE - 1)) {
+            if (len & (AES_BLOCK_SIZE - 1)) {
                 mp_raise_ValueError("Invalid data length");
             }
+#ifdef AES_HW
+            if (o->hw) {
+                if ((o->mode & AESDirMask) == Encrypt) {
+                    aes_hw_ecb_encrypt(&(o->ctx.hw), in, out, len);
+                } else {
+                    aes_hw_ecb_decrypt(&(o->ctx.hw), in, out, len);
+                }
+                break;
+            }
+#endif
             if ((o->mode & AESDirMask) == Encrypt) {
-                aes_ecb_encrypt(buf.buf, (uint8_t *)vstr.buf, buf.len, &(o->ctx.encrypt_ctx));
+                aes_ecb_encrypt(in, out, len, &(o->ctx.encrypt_ctx));
             } else {
-                aes_ecb_decrypt(buf.buf, (uint8_t *)vstr.buf, buf.len, &(o->ctx.decrypt_ctx));
+                aes_ecb_decrypt(in, out, len, &(o->ctx.decrypt_ctx));
             }
             break;
         case CBC:
-            if (buf.len & (AES_BLOCK_SIZE - 1)) {
+            if (len & (AES_BLOCK_SIZE - 1)) {
                 mp_raise_ValueError("Invalid data length");
             }
+#ifdef AES_HW
+            if (o->hw) {
+                if ((o->mode & AESDirMask) == Encrypt) {
+                    aes_hw_cbc_encrypt(&(o->ctx.hw), in, out, len, o->iv);
+                } else {
+                    aes_hw_cbc_decrypt(&(o->ctx.hw), in, out, len, o->iv);
+                }
+                break;
+            }
+#endif
             if ((o->mode & AESDirMask) == Encrypt) {
-                aes_cbc_encrypt(buf.buf, (uint8_t *)vstr.buf, buf.len, o->iv, &(o->ctx.encrypt_ctx));
+                aes_cbc_encrypt(in, out, len, o->iv, &(o->ctx.encrypt_ctx));
             } else {
-                aes_cbc_decrypt(buf.buf, (uint8_t *)vstr.buf, buf.len, o->iv, &(o->ctx.decrypt_ctx));
+                aes_cbc_decrypt(in, out, len, o->iv, &(o->ctx.decrypt_ctx));
             }
             break;
         case CFB:
             if ((o->mode & AESDirMask) == Encrypt) {
-                aes_cfb_encrypt(buf.buf, (uint8_t *)vstr.buf, buf.len, o->iv, &(o->ctx.encrypt_ctx));
+                aes_cfb_encrypt(in, out, len, o->iv, &(o->ctx.encrypt_ctx));
             } else {
-                aes_cfb_decrypt(buf.buf, (uint8_t *)vstr.buf, buf.len, o->iv, &(o->ctx.encrypt_ctx));
+                aes_cfb_decrypt(in, out, len, o->iv, &(o->ctx.encrypt_ctx));
             }
             break;
         case OFB: // (encrypt == decrypt)
-            aes_ofb_crypt(buf.buf, (uint8_t *)vstr.buf, buf.len, o->iv, &(o->ctx.encrypt_ctx));
+            aes_ofb_crypt(in, out, len, o->iv, &(o->ctx.encrypt_ctx));
             break;
         case CTR: // (encrypt == decrypt)
-            aes_ctr_crypt(buf.buf, (uint8_t *)vstr.buf, buf.len, o->ctr, aes_ctr_cbuf_inc, &(o->ctx.encrypt_ctx));
+#ifdef AES_HW
+            if (o->hw) {
+                aes_hw_ctr_crypt(&(o->ctx.hw), in, out, len, o->ctr);
+                break;
+            }
+#endif
+            aes_ctr_crypt(in, out, len, o->ctr, aes_ctr_cbuf_inc, &(o->ctx.encrypt_ctx));
             break;
     }
+}
+
+/// def update(self, data: bytes) -> bytes:
+///     '''
+///     Update AES context with data.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_AES_update(mp_obj_t self, mp_obj_t data) {
+    mp_buffer_info_t buf;
+    mp_get_buffer_raise(data, &buf, MP_BUFFER_READ);
+    if (buf.len == 0) {
+        return mp_const_empty_bytes;
+    }
+    vstr_t vstr;
+    vstr_init_len(&vstr, buf.len);
+    aes_crypt(MP_OBJ_TO_PTR(self), buf.buf, (uint8_t *)vstr.buf, buf.len);
     return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_AES_update_obj, mod_trezorcrypto_AES_update);
 
+/// def update_into(self, data: bytes, out: bytearray) -> int:
+///     '''
+///     Same as update(), but writes into a buffer of at least len(data) bytes
+///     instead of allocating. out may be data itself, to work in place.
+///     Returns the number of bytes written.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_AES_update_into(mp_obj_t self, mp_obj_t data, mp_obj_t out) {
+    mp_buffer_info_t buf;
+    mp_get_buffer_raise(data, &buf, MP_BUFFER_READ);
+    uint8_t *dst = modtcc_get_output_buffer(out, &buf);
+    aes_crypt(MP_OBJ_TO_PTR(self), buf.buf, dst, buf.len);
+    return mp_obj_new_int(buf.len);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(mod_trezorcrypto_AES_update_into_obj, mod_trezorcrypto_AES_update_into);
+
 STATIC mp_obj_t mod_trezorcrypto_AES___del__(mp_obj_t self) {
     mp_obj_AES_t *o = MP_OBJ_TO_PTR(self);
-    memset(&(o->ctx), 0, sizeof(aes_encrypt_ctx));
+    memset(&(o->ctx), 0, sizeof(o->ctx));
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_AES___del___obj, mod_trezorcrypto_AES___del__);
 
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_AES_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&mod_trezorcrypto_AES_update_obj) },
+    { MP_ROM_QSTR(MP_QSTR_update_into), MP_ROM_PTR(&mod_trezorcrypto_AES_update_into_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mod_trezorcrypto_AES___del___obj) },
     { MP_ROM_QSTR(MP_QSTR_ECB), MP_OBJ_NEW_SMALL_INT(ECB) },
     { MP_ROM_QSTR(MP_QSTR_CBC), MP_OBJ_NEW_SMALL_INT(CBC) },
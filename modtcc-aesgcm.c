@@ -0,0 +1,186 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ */
+
+#include "py/objstr.h"
+
+#include "aes_gcm.h"
+
+/// class AESGCM:
+///     '''
+///     AES-GCM context, used like ChaCha20Poly1305.
+///     '''
+typedef struct _mp_obj_AESGCM_t {
+    mp_obj_base_t base;
+    aes_gcm_ctx ctx;
+} mp_obj_AESGCM_t;
+
+/// def __init__(self, key: bytes, nonce: bytes) -> None:
+///     '''
+///     Initialize the AES-GCM context for encryption or decryption using a
+///     16, 24 or 32 byte key and a 12 byte nonce.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_AESGCM_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 2, 2, false);
+    mp_obj_AESGCM_t *o = m_new_obj(mp_obj_AESGCM_t);
+    o->base.type = type;
+    mp_buffer_info_t key, nonce;
+    mp_get_buffer_raise(args[0], &key, MP_BUFFER_READ);
+    mp_get_buffer_raise(args[1], &nonce, MP_BUFFER_READ);
+    if (nonce.len != 12) {
+        mp_raise_ValueError("Invalid length of nonce");
+    }
+    if (!aes_gcm_init(&(o->ctx), key.buf, key.len, nonce.buf)) {
+        mp_raise_ValueError("Invalid/unsupported key length");
+    }
+    return MP_OBJ_FROM_PTR(o);
+}
+
+/// def encrypt(self, data: bytes) -> bytes:
+///     '''
+///     Encrypt data, of any length.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_AESGCM_encrypt(mp_obj_t self, mp_obj_t data) {
+    mp_obj_AESGCM_t *o = MP_OBJ_TO_PTR(self);
+    if (o->ctx.finished) {
+        mp_raise_ValueError("finish() already called");
+    }
+    mp_buffer_info_t in;
+    mp_get_buffer_raise(data, &in, MP_BUFFER_READ);
+    vstr_t vstr;
+    vstr_init_len(&vstr, in.len);
+    aes_gcm_encrypt(&(o->ctx), in.buf, (uint8_t *)vstr.buf, in.len);
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_AESGCM_encrypt_obj, mod_trezorcrypto_AESGCM_encrypt);
+
+/// def encrypt_into(self, data: bytes, out: bytearray) -> int:
+///     '''
+///     Same as encrypt(), but writes into a buffer of at least len(data) bytes
+///     instead of allocating. out may be data itself, to work in place.
+///     Returns the number of bytes written.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_AESGCM_encrypt_into(mp_obj_t self, mp_obj_t data, mp_obj_t out) {
+    mp_obj_AESGCM_t *o = MP_OBJ_TO_PTR(self);
+    if (o->ctx.finished) {
+        mp_raise_ValueError("finish() already called");
+    }
+    mp_buffer_info_t in;
+    mp_get_buffer_raise(data, &in, MP_BUFFER_READ);
+    uint8_t *dst = modtcc_get_output_buffer(out, &in);
+    aes_gcm_encrypt(&(o->ctx), in.buf, dst, in.len);
+    return mp_obj_new_int(in.len);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(mod_trezorcrypto_AESGCM_encrypt_into_obj, mod_trezorcrypto_AESGCM_encrypt_into);
+
+/// def decrypt(self, data: bytes) -> bytes:
+///     '''
+///     Decrypt data, of any length.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_AESGCM_decrypt(mp_obj_t self, mp_obj_t data) {
+    mp_obj_AESGCM_t *o = MP_OBJ_TO_PTR(self);
+    if (o->ctx.finished) {
+        mp_raise_ValueError("finish() already called");
+    }
+    mp_buffer_info_t in;
+    mp_get_buffer_raise(data, &in, MP_BUFFER_READ);
+    vstr_t vstr;
+    vstr_init_len(&vstr, in.len);
+    aes_gcm_decrypt(&(o->ctx), in.buf, (uint8_t *)vstr.buf, in.len);
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_AESGCM_decrypt_obj, mod_trezorcrypto_AESGCM_decrypt);
+
+/// def decrypt_into(self, data: bytes, out: bytearray) -> int:
+///     '''
+///     Same as decrypt(), but writes into a buffer of at least len(data) bytes
+///     instead of allocating. out may be data itself, to work in place.
+///     Returns the number of bytes written.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_AESGCM_decrypt_into(mp_obj_t self, mp_obj_t data, mp_obj_t out) {
+    mp_obj_AESGCM_t *o = MP_OBJ_TO_PTR(self);
+    if (o->ctx.finished) {
+        mp_raise_ValueError("finish() already called");
+    }
+    mp_buffer_info_t in;
+    mp_get_buffer_raise(data, &in, MP_BUFFER_READ);
+    uint8_t *dst = modtcc_get_output_buffer(out, &in);
+    aes_gcm_decrypt(&(o->ctx), in.buf, dst, in.len);
+    return mp_obj_new_int(in.len);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(mod_trezorcrypto_AESGCM_decrypt_into_obj, mod_trezorcrypto_AESGCM_decrypt_into);
+
+/// def auth(self, data: bytes) -> None:
+///     '''
+///     Include authenticated data in the GHASH. May be called more than
+///     once, but only before encryption or decryption.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_AESGCM_auth(mp_obj_t self, mp_obj_t data) {
+    mp_obj_AESGCM_t *o = MP_OBJ_TO_PTR(self);
+    mp_buffer_info_t in;
+    mp_get_buffer_raise(data, &in, MP_BUFFER_READ);
+    if (o->ctx.in_text || o->ctx.finished) {
+        mp_raise_ValueError("auth() must come before encryption/decryption");
+    }
+    aes_gcm_auth(&(o->ctx), in.buf, in.len);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_AESGCM_auth_obj, mod_trezorcrypto_AESGCM_auth);
+
+/// def finish(self) -> bytes:
+///     '''
+///     Compute the 16 byte GCM tag. Later calls return the same tag; no
+///     more data can be added after the first.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_AESGCM_finish(mp_obj_t self) {
+    mp_obj_AESGCM_t *o = MP_OBJ_TO_PTR(self);
+    uint8_t out[16];
+    aes_gcm_finish(&(o->ctx), out);
+    return mp_obj_new_bytes(out, sizeof(out));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_AESGCM_finish_obj, mod_trezorcrypto_AESGCM_finish);
+
+/// def verify(self, tag: bytes) -> bool:
+///     '''
+///     Compute the tag as finish() does, and compare it with tag in
+///     constant time.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_AESGCM_verify(mp_obj_t self, mp_obj_t tag) {
+    mp_obj_AESGCM_t *o = MP_OBJ_TO_PTR(self);
+    mp_buffer_info_t t;
+    mp_get_buffer_raise(tag, &t, MP_BUFFER_READ);
+    if (t.len != 16) {
+        mp_raise_ValueError("Invalid length of tag");
+    }
+    return mp_obj_new_bool(aes_gcm_verify(&(o->ctx), t.buf));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_AESGCM_verify_obj, mod_trezorcrypto_AESGCM_verify);
+
+STATIC mp_obj_t mod_trezorcrypto_AESGCM___del__(mp_obj_t self) {
+    mp_obj_AESGCM_t *o = MP_OBJ_TO_PTR(self);
+    memset(&(o->ctx), 0, sizeof(aes_gcm_ctx));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_AESGCM___del___obj, mod_trezorcrypto_AESGCM___del__);
+
+STATIC const mp_rom_map_elem_t mod_trezorcrypto_AESGCM_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_encrypt), MP_ROM_PTR(&mod_trezorcrypto_AESGCM_encrypt_obj) },
+    { MP_ROM_QSTR(MP_QSTR_encrypt_into), MP_ROM_PTR(&mod_trezorcrypto_AESGCM_encrypt_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_decrypt), MP_ROM_PTR(&mod_trezorcrypto_AESGCM_decrypt_obj) },
+    { MP_ROM_QSTR(MP_QSTR_decrypt_into), MP_ROM_PTR(&mod_trezorcrypto_AESGCM_decrypt_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_auth), MP_ROM_PTR(&mod_trezorcrypto_AESGCM_auth_obj) },
+    { MP_ROM_QSTR(MP_QSTR_finish), MP_ROM_PTR(&mod_trezorcrypto_AESGCM_finish_obj) },
+    { MP_ROM_QSTR(MP_QSTR_verify), MP_ROM_PTR(&mod_trezorcrypto_AESGCM_verify_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mod_trezorcrypto_AESGCM___del___obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(mod_trezorcrypto_AESGCM_locals_dict, mod_trezorcrypto_AESGCM_locals_dict_table);
+
+STATIC const mp_obj_type_t mod_trezorcrypto_AESGCM_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_AESGCM,
+    .make_new = mod_trezorcrypto_AESGCM_make_new,
+    .locals_dict = (void*)&mod_trezorcrypto_AESGCM_locals_dict,
+};
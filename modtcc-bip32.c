@@ -9,6 +9,14 @@
 
 #include "bip32.h"
 #include "curves.h"
+#include "bip32_cache.h"
+#include "ecmult_gen.h"
+#include "hmac.h"
+#include "base58.h"
+#include "b58_fast.h"
+#include "crc.h"
+#include "sha_hw.h"
+#include "ripemd160.h"
 
 /// class HDNode:
 ///     '''
@@ -18,11 +26,41 @@ typedef struct _mp_obj_HDNode_t {
     mp_obj_base_t base;
     uint32_t fingerprint;
     bool have_private;
+    uint8_t cached;             // HDNODE_HAVE_*: what below is valid for hdnode
+    uint8_t pubkey_hash[20];
     HDNode hdnode;
 } mp_obj_HDNode_t;
 
 STATIC const mp_obj_type_t mod_trezorcrypto_HDNode_type;
 
+// HASH160 of a public key
+STATIC void bip32_hash160(const uint8_t pubkey[33], uint8_t out[20]) {
+    uint8_t h[SHA256_DIGEST_LENGTH];
+    sha256_hw_raw(pubkey, 33, h);
+    ripemd160(h, sizeof(h), out);
+}
+
+// The HASH160 of the public key is worked out at most once per node state;
+// whatever changes hdnode must zero cached. The public key itself is kept
+// in hdnode, where hdnode_fill_public_key() fills it in only while blank.
+#define HDNODE_HAVE_HASH    0x01
+
+// what address_raw() returns, and what the fingerprint and address come from
+STATIC const uint8_t *HDNode_pubkey_hash(mp_obj_HDNode_t *o) {
+    if (!(o->cached & HDNODE_HAVE_HASH)) {
+        hdnode_fill_public_key(&o->hdnode);
+        bip32_hash160(o->hdnode.public_key, o->pubkey_hash);
+        o->cached |= HDNODE_HAVE_HASH;
+    }
+    return o->pubkey_hash;
+}
+
+// first 4 bytes of the HASH160, big-endian
+STATIC uint32_t HDNode_fingerprint(mp_obj_HDNode_t *o) {
+    const uint8_t *h = HDNode_pubkey_hash(o);
+    return ((uint32_t)h[0] << 24) | ((uint32_t)h[1] << 16) | ((uint32_t)h[2] << 8) | h[3];
+}
+
 #define XPUB_MAXLEN 128
 #define ADDRESS_MAXLEN 36
 
@@ -111,6 +149,7 @@ STATIC mp_obj_t mod_trezorcrypto_HDNode_make_new(const mp_obj_type_t *type, size
         memset(o->hdnode.public_key, 0, 33);
     }
     o->hdnode.curve = curve;
+    o->cached = 0;
 
     return MP_OBJ_FROM_PTR(o);
 }
@@ -122,15 +161,12 @@ STATIC mp_obj_t mod_trezorcrypto_HDNode_make_new(const mp_obj_type_t *type, size
 STATIC mp_obj_t mod_trezorcrypto_HDNode_derive(mp_obj_t self, mp_obj_t index) {
     mp_obj_HDNode_t *o = MP_OBJ_TO_PTR(self);
     uint32_t i = mp_obj_get_int_truncated(index);
-    uint32_t fp = hdnode_fingerprint(&o->hdnode);
-    int res;
+    bool known = o->cached & HDNODE_HAVE_HASH;
+    uint32_t fp = known ? HDNode_fingerprint(o) : 0;
 
-    if(!o->have_private) {
-        // must do a public derivation when we have no private key
-        res = hdnode_public_ckd(&o->hdnode, i);
-    } else {
-        res = hdnode_private_ckd(&o->hdnode, i);
-    }
+    // a public derivation when we have no private key
+    int res = bip32_cache_ckd(&o->hdnode, o->have_private, i, known ? NULL : &fp);
+    o->cached = 0;
 
     if (!res) {
         memset(&o->hdnode, 0, sizeof(o->hdnode));
@@ -168,7 +204,22 @@ STATIC mp_obj_t mod_trezorcrypto_HDNode_derive_path(mp_obj_t self, mp_obj_t path
         pints[pi] = mp_obj_get_int_truncated(pitems[pi]);
     }
 
-    if (!hdnode_private_ckd_cached(&o->hdnode, pints, plen, &o->fingerprint)) {
+    // only the last parent's fingerprint is kept, so only it is worked out
+    for (pi = 0; pi < plen; pi++) {
+        uint32_t *fp = NULL;
+        if (pi == plen - 1) {
+            if (o->cached & HDNODE_HAVE_HASH) {
+                o->fingerprint = HDNode_fingerprint(o);
+            } else {
+                fp = &o->fingerprint;
+            }
+        }
+        o->cached = 0;
+        if (!bip32_cache_ckd(&o->hdnode, o->have_private, pints[pi], fp)) {
+            break;
+        }
+    }
+    if (pi < plen) {
         // derivation failed, reset the state and raise
         o->fingerprint = 0;
         memset(&o->hdnode, 0, sizeof(o->hdnode));
@@ -179,6 +230,149 @@ STATIC mp_obj_t mod_trezorcrypto_HDNode_derive_path(mp_obj_t self, mp_obj_t path
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_HDNode_derive_path_obj, mod_trezorcrypto_HDNode_derive_path);
 
+// A parent for public derivation of many children: its point, compressed
+// key and the HMAC keyed by its chain code are worked out once. The tweak
+// k is public, so k*G is ecmult_gen_var(), which uses the curve's table
+// (see modtcc-secp256k1.c) if it has one and, with no blinding, no random
+// numbers: children can be derived on several threads.
+typedef struct {
+    const curve_info *info;
+    ecmult_gen_table *gen;      // NULL: scalar_multiply(), one thread only
+    curve_point point;
+    uint8_t public_key[33];
+    HMAC_SHA512_CTX hmac;
+} bip32_public_parent_t;
+
+// false if node is not on an ECDSA curve
+STATIC bool bip32_public_parent_init(bip32_public_parent_t *p, HDNode *node) {
+    p->info = node->curve;
+    if (!p->info || !p->info->params) {
+        return false;
+    }
+    hdnode_fill_public_key(node);
+    memcpy(p->public_key, node->public_key, 33);
+    if (!ecdsa_read_pubkey(p->info->params, p->public_key, &p->point)) {
+        return false;
+    }
+
+    p->gen = NULL;
+    if (p->info->params == &secp256k1) {
+        p->gen = &secp256k1_gen;
+    } else if (p->info->params == &nist256p1) {
+        p->gen = &nist256p1_gen;
+    }
+    if (p->gen) {
+        // build what it needs now, so children can be derived on several threads
+        ecmult_gen_prepare(p->gen);
+    }
+
+    hmac_sha512_Init(&p->hmac, node->chain_code, 32);
+    hmac_sha512_Update(&p->hmac, p->public_key, 33);
+    return true;
+}
+
+// Compressed public key of non-hardened child i, like hdnode_public_ckd();
+// false for the (2^-127) indexes BIP32 declares invalid.
+STATIC bool bip32_public_child(const bip32_public_parent_t *p, uint32_t i, uint8_t pubkey[33]) {
+    const ecdsa_curve *curve = p->info->params;
+    HMAC_SHA512_CTX hmac = p->hmac;
+    uint8_t be[4] = { i >> 24, i >> 16, i >> 8, i };
+    uint8_t I[64];
+    bignum256 c;
+    curve_point child;
+
+    hmac_sha512_Update(&hmac, be, 4);
+    hmac_sha512_Final(&hmac, I);
+    bn_read_be(I, &c);
+    memset(I, 0, sizeof(I));
+    if (!bn_is_less(&c, &curve->order)) {
+        return false;
+    }
+    if (p->gen) {
+        ecmult_gen_var(p->gen, &c, &child);
+    } else {
+        scalar_multiply(curve, &c, &child);
+    }
+    point_add(curve, &p->point, &child);
+    if (point_is_infinity(&child)) {
+        return false;
+    }
+    pubkey[0] = 0x02 | (child.y.val[0] & 0x01);
+    bn_write_be(&child.x, pubkey + 1);
+    return true;
+}
+
+enum {
+    RangePubkey = 0,
+    RangeHash160 = 1,
+    RangeAddress = 2,
+};
+
+/// def derive_range(self, start: int, count: int, kind: int = HDNode.PUBKEY, version: int = 0) -> Union[bytes, List[str]]:
+///     '''
+///     Derive the non-hardened children start .. start+count-1 of this node,
+///     which is left unchanged, and return for each of them, in order:
+///       HDNode.PUBKEY: the compressed public key, packed in one bytes
+///       HDNode.HASH160: the HASH160 of the public key, packed in one bytes
+///       HDNode.ADDRESS: the address for version, as address(), in a list
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_HDNode_derive_range(size_t n_args, const mp_obj_t *args) {
+    mp_obj_HDNode_t *o = MP_OBJ_TO_PTR(args[0]);
+    mp_int_t start = mp_obj_get_int(args[1]);
+    mp_int_t count = mp_obj_get_int(args[2]);
+    mp_int_t kind = (n_args > 3) ? mp_obj_get_int(args[3]) : RangePubkey;
+    uint32_t version = (n_args > 4) ? mp_obj_get_int_truncated(args[4]) : 0;
+
+    if (start < 0 || count < 0 || (uint64_t)start + (uint64_t)count > 0x80000000ULL) {
+        mp_raise_ValueError("Range must be non-hardened indexes");
+    }
+    if (kind < RangePubkey || kind > RangeAddress) {
+        mp_raise_ValueError("Invalid kind");
+    }
+
+    bip32_public_parent_t parent;
+    if (!bip32_public_parent_init(&parent, &o->hdnode)) {
+        mp_raise_ValueError("Curve does not support public derivation");
+    }
+
+    size_t item_len = (kind == RangePubkey) ? 33 : 20;
+    vstr_t vstr;
+    mp_obj_t list = MP_OBJ_NULL;
+    uint8_t *out = NULL;
+    if (kind == RangeAddress) {
+        list = mp_obj_new_list(0, NULL);
+    } else {
+        vstr_init_len(&vstr, item_len * count);
+        out = (uint8_t *)vstr.buf;
+    }
+
+    // only its curve and public key are used, for addresses
+    HDNode child;
+    memset(&child, 0, sizeof(child));
+    for (mp_int_t n = 0; n < count; n++) {
+        uint8_t pubkey[33];
+        if (!bip32_public_child(&parent, start + n, pubkey)) {
+            memset(&parent, 0, sizeof(parent));
+            mp_raise_ValueError("Failed to derive");
+        }
+        if (kind == RangePubkey) {
+            memcpy(out + n * item_len, pubkey, 33);
+        } else if (kind == RangeHash160) {
+            bip32_hash160(pubkey, out + n * item_len);
+        } else {
+            char address[ADDRESS_MAXLEN];
+            child.curve = parent.info;
+            memcpy(child.public_key, pubkey, 33);
+            hdnode_get_address(&child, version, address, ADDRESS_MAXLEN);
+            mp_obj_list_append(list, mp_obj_new_str(address, strlen(address)));
+        }
+    }
+    memset(&parent, 0, sizeof(parent));
+
+    return (kind == RangeAddress) ? list : mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_HDNode_derive_range_obj, 3, 5, mod_trezorcrypto_HDNode_derive_range);
+
 STATIC mp_obj_t serialize_public_private(mp_obj_t self, bool use_public, uint32_t version) {
     mp_obj_HDNode_t *o = MP_OBJ_TO_PTR(self);
     char xpub[XPUB_MAXLEN];
@@ -226,10 +420,83 @@ STATIC mp_obj_t mod_trezorcrypto_HDNode_clone(mp_obj_t self) {
     copy->hdnode = o->hdnode;
     copy->have_private = o->have_private;
     copy->fingerprint = o->fingerprint;
+    copy->cached = o->cached;
+    memcpy(copy->pubkey_hash, o->pubkey_hash, sizeof(o->pubkey_hash));
     return MP_OBJ_FROM_PTR(copy);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_HDNode_clone_obj, mod_trezorcrypto_HDNode_clone);
 
+// to_bytes() / from_bytes() format, all integers big-endian:
+//   0  format (HDNODE_BYTES_FORMAT)
+//   1  curve, index in hdnode_bytes_curves[]
+//   2  flags: 1 = private key
+//   3  depth (4)
+//   7  fingerprint (4)
+//  11  child_num (4)
+//  15  chain code (32)
+//  47  public key, or 0x00 and the private key (33)
+//  80  optional: CRC32 of the above (4)
+#define HDNODE_BYTES_FORMAT     1
+#define HDNODE_BYTES_LEN        80
+#define HDNODE_BYTES_CRC_LEN    (HDNODE_BYTES_LEN + 4)
+
+STATIC const char *const hdnode_bytes_curves[] = {
+    SECP256K1_NAME,
+    NIST256P1_NAME,
+    ED25519_NAME,
+};
+
+STATIC void hdnode_bytes_write32(uint8_t *p, uint32_t v) {
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+STATIC uint32_t hdnode_bytes_read32(const uint8_t *p) {
+    return ((uint32_t)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/// def to_bytes(self, checksum: bool = False) -> bytes:
+///     '''
+///     Returns the node in a fixed-size binary form for bip32.from_bytes(),
+///     80 bytes, or 84 with a CRC32 to catch storage errors. Holds the
+///     private key if there is one.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_HDNode_to_bytes(size_t n_args, const mp_obj_t *args) {
+    mp_obj_HDNode_t *o = MP_OBJ_TO_PTR(args[0]);
+    bool checksum = (n_args > 1) && mp_obj_is_true(args[1]);
+
+    size_t curve;
+    for (curve = 0; curve < MP_ARRAY_SIZE(hdnode_bytes_curves); curve++) {
+        if (o->hdnode.curve && o->hdnode.curve == get_curve_by_name(hdnode_bytes_curves[curve])) {
+            break;
+        }
+    }
+    if (curve == MP_ARRAY_SIZE(hdnode_bytes_curves)) {
+        mp_raise_ValueError("Curve not supported");
+    }
+
+    vstr_t vstr;
+    vstr_init_len(&vstr, checksum ? HDNODE_BYTES_CRC_LEN : HDNODE_BYTES_LEN);
+    uint8_t *out = (uint8_t *)vstr.buf;
+    out[0] = HDNODE_BYTES_FORMAT;
+    out[1] = curve;
+    out[2] = o->have_private ? 1 : 0;
+    hdnode_bytes_write32(out + 3, o->hdnode.depth);
+    hdnode_bytes_write32(out + 7, o->fingerprint);
+    hdnode_bytes_write32(out + 11, o->hdnode.child_num);
+    memcpy(out + 15, o->hdnode.chain_code, 32);
+    if (o->have_private) {
+        out[47] = 0;
+        memcpy(out + 48, o->hdnode.private_key, 32);
+    } else {
+        memcpy(out + 47, o->hdnode.public_key, 33);
+    }
+    if (checksum) {
+        hdnode_bytes_write32(out + HDNODE_BYTES_LEN, crc32(out, HDNODE_BYTES_LEN, 0xffffffff) ^ 0xffffffff);
+    }
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_HDNode_to_bytes_obj, 1, 2, mod_trezorcrypto_HDNode_to_bytes);
+
 /// def blank(self) -> HDNode:
 ///     '''
 ///     Blank out sensitive values in self. Object useless afterwards.
@@ -240,6 +507,8 @@ STATIC mp_obj_t modtcc_HDNode_blank(mp_obj_t self) {
     memset(&o->hdnode, 0, sizeof(HDNode));
     o->fingerprint = 0;
     o->have_private = false;
+    o->cached = 0;
+    memset(o->pubkey_hash, 0, sizeof(o->pubkey_hash));
 
     return mp_const_none;
 
@@ -273,7 +542,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_HDNode_fingerprint_obj, mod_tr
 ///     '''
 STATIC mp_obj_t mod_trezorcrypto_HDNode_my_fingerprint(mp_obj_t self) {
     mp_obj_HDNode_t *o = MP_OBJ_TO_PTR(self);
-    uint32_t fp = hdnode_fingerprint(&o->hdnode);
+    uint32_t fp = HDNode_fingerprint(o);
     return mp_obj_new_int_from_uint(__builtin_bswap32(fp));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_HDNode_my_fingerprint_obj, mod_trezorcrypto_HDNode_my_fingerprint);
@@ -332,9 +601,22 @@ STATIC mp_obj_t mod_trezorcrypto_HDNode_address(mp_obj_t self, mp_obj_t version)
     mp_obj_HDNode_t *o = MP_OBJ_TO_PTR(self);
 
     uint32_t v = mp_obj_get_int_truncated(version);
-    char address[ADDRESS_MAXLEN];
-    hdnode_get_address(&o->hdnode, v, address, ADDRESS_MAXLEN);
-    return mp_obj_new_str(address, strlen(address));
+
+    // version prefix (1 to 4 bytes, big-endian) then the cached HASH160
+    uint8_t raw[4 + 20];
+    size_t plen = (v > 0xffffff) ? 4 : (v > 0xffff) ? 3 : (v > 0xff) ? 2 : 1;
+    for (size_t i = 0; i < plen; i++) {
+        raw[i] = v >> (8 * (plen - 1 - i));
+    }
+    memcpy(raw + plen, HDNode_pubkey_hash(o), 20);
+
+    char address[B58_ENCODED_MAX(sizeof(raw) + B58_CHECK_LEN)];
+    uint32_t limbs[B58_ENCODE_LIMBS(sizeof(raw) + B58_CHECK_LEN)];
+    int len = b58_encode_check(raw, plen + 20, address, sizeof(address), limbs);
+    if (len < 0) {
+        mp_raise_ValueError(NULL);
+    }
+    return mp_obj_new_str(address, len);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_HDNode_address_obj, mod_trezorcrypto_HDNode_address);
 
@@ -344,10 +626,7 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_HDNode_address_obj, mod_trezor
 ///     '''
 STATIC mp_obj_t mod_trezorcrypto_HDNode_address_raw(mp_obj_t self) {
     mp_obj_HDNode_t *o = MP_OBJ_TO_PTR(self);
-    // API requires a version, but we'll use zero and remove it.
-    uint8_t raw[21];
-    hdnode_get_address_raw(&o->hdnode, 0x0, raw);
-    return mp_obj_new_bytes(raw+1, 20);
+    return mp_obj_new_bytes(HDNode_pubkey_hash(o), 20);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_HDNode_address_raw_obj, mod_trezorcrypto_HDNode_address_raw);
 
@@ -369,10 +648,12 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_HDNode_ethereum_pubkeyhash_obj
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_HDNode_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_derive), MP_ROM_PTR(&mod_trezorcrypto_HDNode_derive_obj) },
     { MP_ROM_QSTR(MP_QSTR_derive_path), MP_ROM_PTR(&mod_trezorcrypto_HDNode_derive_path_obj) },
+    { MP_ROM_QSTR(MP_QSTR_derive_range), MP_ROM_PTR(&mod_trezorcrypto_HDNode_derive_range_obj) },
     { MP_ROM_QSTR(MP_QSTR_serialize_private), MP_ROM_PTR(&mod_trezorcrypto_HDNode_serialize_private_obj) },
     { MP_ROM_QSTR(MP_QSTR_serialize_public), MP_ROM_PTR(&mod_trezorcrypto_HDNode_serialize_public_obj) },
 
     { MP_ROM_QSTR(MP_QSTR_clone), MP_ROM_PTR(&mod_trezorcrypto_HDNode_clone_obj) },
+    { MP_ROM_QSTR(MP_QSTR_to_bytes), MP_ROM_PTR(&mod_trezorcrypto_HDNode_to_bytes_obj) },
     { MP_ROM_QSTR(MP_QSTR_depth), MP_ROM_PTR(&mod_trezorcrypto_HDNode_depth_obj) },
     { MP_ROM_QSTR(MP_QSTR_fingerprint), MP_ROM_PTR(&mod_trezorcrypto_HDNode_fingerprint_obj) },
     { MP_ROM_QSTR(MP_QSTR_my_fingerprint), MP_ROM_PTR(&mod_trezorcrypto_HDNode_my_fingerprint_obj) },
@@ -383,6 +664,9 @@ STATIC const mp_rom_map_elem_t mod_trezorcrypto_HDNode_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_address), MP_ROM_PTR(&mod_trezorcrypto_HDNode_address_obj) },
     { MP_ROM_QSTR(MP_QSTR_address_raw), MP_ROM_PTR(&mod_trezorcrypto_HDNode_address_raw_obj) },
     { MP_ROM_QSTR(MP_QSTR_blank), MP_ROM_PTR(&modtcc_HDNode_blank_obj) },
+    { MP_ROM_QSTR(MP_QSTR_PUBKEY), MP_OBJ_NEW_SMALL_INT(RangePubkey) },
+    { MP_ROM_QSTR(MP_QSTR_HASH160), MP_OBJ_NEW_SMALL_INT(RangeHash160) },
+    { MP_ROM_QSTR(MP_QSTR_ADDRESS), MP_OBJ_NEW_SMALL_INT(RangeAddress) },
 #if USE_ETHEREUM
     { MP_ROM_QSTR(MP_QSTR_ethereum_pubkeyhash), MP_ROM_PTR(&mod_trezorcrypto_HDNode_ethereum_pubkeyhash_obj) },
 #endif
@@ -418,6 +702,7 @@ STATIC mp_obj_t mod_trezorcrypto_bip32_deserialize(mp_obj_t value, mp_obj_t vers
     o->base.type = &mod_trezorcrypto_HDNode_type;
     o->hdnode = hdnode;
     o->fingerprint = fingerprint;
+    o->cached = 0;
 
     o->have_private = false;
     for(int j=0; j<32; j++) {
@@ -454,15 +739,345 @@ STATIC mp_obj_t mod_trezorcrypto_bip32_from_seed(mp_obj_t seed, mp_obj_t curve_n
     o->base.type = &mod_trezorcrypto_HDNode_type;
     o->hdnode = hdnode;
     o->have_private = true;
+    o->cached = 0;
     return MP_OBJ_FROM_PTR(o);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_bip32_from_seed_obj, mod_trezorcrypto_bip32_from_seed);
 
+/// def from_bytes(data: bytes) -> HDNode:
+///     '''
+///     Construct a BIP0032 HD node from the output of HDNode.to_bytes(),
+///     checking its CRC32 if it has one, and that its key is valid for the
+///     curve.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_bip32_from_bytes(mp_obj_t data) {
+    mp_buffer_info_t buf;
+    mp_get_buffer_raise(data, &buf, MP_BUFFER_READ);
+    const uint8_t *in = buf.buf;
+    if (buf.len != HDNODE_BYTES_LEN && buf.len != HDNODE_BYTES_CRC_LEN) {
+        mp_raise_ValueError("Invalid length");
+    }
+    if (buf.len == HDNODE_BYTES_CRC_LEN
+            && hdnode_bytes_read32(in + HDNODE_BYTES_LEN) != (crc32(in, HDNODE_BYTES_LEN, 0xffffffff) ^ 0xffffffff)) {
+        mp_raise_ValueError("Invalid checksum");
+    }
+    if (in[0] != HDNODE_BYTES_FORMAT || in[1] >= MP_ARRAY_SIZE(hdnode_bytes_curves) || in[2] > 1) {
+        mp_raise_ValueError("Invalid value");
+    }
+    bool have_private = in[2];
+    if (have_private && in[47] != 0) {
+        mp_raise_ValueError("Invalid value");
+    }
+
+    // the key must be one the curve can use: 0 < private key < order, or
+    // a compressed public key on the curve (ed25519: 0x01 and the key)
+    const curve_info *curve = get_curve_by_name(hdnode_bytes_curves[in[1]]);
+    if (curve->params) {
+        if (have_private) {
+            bignum256 k;
+            bn_read_be(in + 48, &k);
+            bool ok = !bn_is_zero(&k) && bn_is_less(&k, &curve->params->order);
+            memset(&k, 0, sizeof(k));
+            if (!ok) {
+                mp_raise_ValueError("Invalid private key");
+            }
+        } else {
+            curve_point pub;
+            if ((in[47] != 0x02 && in[47] != 0x03) || !ecdsa_read_pubkey(curve->params, in + 47, &pub)) {
+                mp_raise_ValueError("Invalid public key");
+            }
+        }
+    } else if (!have_private && in[47] != 0x01) {
+        mp_raise_ValueError("Invalid public key");
+    }
+
+    mp_obj_HDNode_t *o = m_new_obj(mp_obj_HDNode_t);
+    o->base.type = &mod_trezorcrypto_HDNode_type;
+    memset(&o->hdnode, 0, sizeof(HDNode));
+    o->hdnode.curve = curve;
+    o->hdnode.depth = hdnode_bytes_read32(in + 3);
+    o->fingerprint = hdnode_bytes_read32(in + 7);
+    o->hdnode.child_num = hdnode_bytes_read32(in + 11);
+    memcpy(o->hdnode.chain_code, in + 15, 32);
+    if (have_private) {
+        // the public key is worked out when needed
+        memcpy(o->hdnode.private_key, in + 48, 32);
+    } else {
+        memcpy(o->hdnode.public_key, in + 47, 33);
+    }
+    o->have_private = have_private;
+    o->cached = 0;
+    return MP_OBJ_FROM_PTR(o);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_bip32_from_bytes_obj, mod_trezorcrypto_bip32_from_bytes);
+
+// scan(): indexes are handed out in chunks to the calling thread and worker
+// threads by modtcc_run_workers(), as in bip39.seed_many(). Only the calling
+// thread touches Python objects.
+
+#define BIP32_SCAN_CHUNK 256
+
+typedef struct {
+    uint32_t index;
+    uint8_t hash[20];
+} bip32_scan_hit_t;
+
+typedef struct {
+    const bip32_public_parent_t *parent;
+    uint64_t start;
+    uint64_t end;
+    const uint8_t *targets;     // packed HASH160s
+    const uint32_t *slots;      // open addressing: target number + 1, or 0
+    uint32_t mask;
+    bip32_scan_hit_t *hits;
+    size_t max_hits;
+    uint64_t next;              // these two are shared between threads
+    size_t found;
+} bip32_scan_t;
+
+STATIC uint32_t bip32_scan_slot(const uint8_t *hash) {
+    // HASH160s are uniform already
+    return hash[0] | (hash[1] << 8) | (hash[2] << 16) | ((uint32_t)hash[3] << 24);
+}
+
+STATIC bool bip32_scan_lookup(const bip32_scan_t *s, const uint8_t *hash) {
+    for (uint32_t i = bip32_scan_slot(hash) & s->mask; s->slots[i]; i = (i + 1) & s->mask) {
+        if (memcmp(s->targets + 20 * (s->slots[i] - 1), hash, 20) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+STATIC void bip32_scan_run(void *arg) {
+    bip32_scan_t *s = arg;
+    uint64_t first;
+    while ((first = __atomic_fetch_add(&s->next, BIP32_SCAN_CHUNK, __ATOMIC_RELAXED)) < s->end) {
+        uint64_t last = first + BIP32_SCAN_CHUNK < s->end ? first + BIP32_SCAN_CHUNK : s->end;
+        for (uint64_t i = first; i < last; i++) {
+            uint8_t pubkey[33], hash[20];
+            if (!bip32_public_child(s->parent, i, pubkey)) {
+                // no such child in BIP32
+                continue;
+            }
+            bip32_hash160(pubkey, hash);
+            if (bip32_scan_lookup(s, hash)) {
+                size_t n = __atomic_fetch_add(&s->found, 1, __ATOMIC_RELAXED);
+                if (n < s->max_hits) {
+                    s->hits[n].index = i;
+                    memcpy(s->hits[n].hash, hash, 20);
+                }
+            }
+        }
+    }
+}
+
+/// def scan(xpub: Union[HDNode, str], path_prefix: List[int], start: int, count: int, targets: Union[bytes, List[bytes]], threads: int = 0) -> List[Tuple[int, bytes]]:
+///     '''
+///     Derive path_prefix from xpub (an HDNode, or a serialized public node
+///     on secp256k1; a serialized private one raises ValueError), then its
+///     non-hardened children start .. start+count-1, looking for the given
+///     HASH160s of public keys, passed as a list or packed in one bytes.
+///     Uses all CPUs, or the given number of threads, on unix hosts. Returns
+///     (index, hash) for each child found, by index.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_bip32_scan(size_t n_args, const mp_obj_t *args) {
+    HDNode node;
+    bool have_private;
+    if (MP_OBJ_IS_TYPE(args[0], &mod_trezorcrypto_HDNode_type)) {
+        mp_obj_HDNode_t *o = MP_OBJ_TO_PTR(args[0]);
+        node = o->hdnode;
+        have_private = o->have_private;
+    } else {
+        // take the version from the string; hdnode_deserialize() checks the rest
+        const char *str = mp_obj_str_get_str(args[0]);
+        uint8_t raw[78 + 4];
+        size_t raw_len = sizeof(raw);
+        uint32_t fingerprint;
+        if (!b58tobin(raw, &raw_len, str) || raw_len != sizeof(raw)) {
+            memset(raw, 0, sizeof(raw));
+            mp_raise_ValueError("Invalid xpub");
+        }
+        // key data of a private node is 0x00 then the key, of a public one 02/03
+        bool is_private = (raw[45] == 0x00);
+        uint32_t version = ((uint32_t)raw[0] << 24) | (raw[1] << 16) | (raw[2] << 8) | raw[3];
+        memset(raw, 0, sizeof(raw));
+        if (is_private) {
+            mp_raise_ValueError("Private node given: pass an xpub, or an HDNode to use its private key");
+        }
+        if (hdnode_deserialize(str, version, version, SECP256K1_NAME, &node, &fingerprint) < 0) {
+            mp_raise_ValueError("Invalid xpub");
+        }
+        have_private = false;
+    }
+
+    size_t plen;
+    mp_obj_t *pitems;
+    mp_obj_get_array(args[1], &plen, &pitems);
+    for (size_t i = 0; i < plen; i++) {
+        if (!bip32_cache_ckd(&node, have_private, mp_obj_get_int_truncated(pitems[i]), NULL)) {
+            memset(&node, 0, sizeof(node));
+            mp_raise_ValueError("Failed to derive path");
+        }
+    }
+
+    mp_int_t start = mp_obj_get_int(args[2]);
+    mp_int_t count = mp_obj_get_int(args[3]);
+    mp_int_t threads = (n_args > 5) ? mp_obj_get_int(args[5]) : 0;
+    if (start < 0 || count < 0 || (uint64_t)start + (uint64_t)count > 0x80000000ULL) {
+        memset(&node, 0, sizeof(node));
+        mp_raise_ValueError("Range must be non-hardened indexes");
+    }
+
+    // targets, packed
+    size_t ntargets;
+    uint8_t *targets;
+    mp_buffer_info_t buf;
+    if (mp_get_buffer(args[4], &buf, MP_BUFFER_READ)) {
+        if (buf.len % 20) {
+            mp_raise_ValueError("Targets must be 20 bytes each");
+        }
+        ntargets = buf.len / 20;
+        targets = m_new(uint8_t, buf.len);
+        memcpy(targets, buf.buf, buf.len);
+    } else {
+        mp_obj_t *items;
+        mp_obj_get_array(args[4], &ntargets, &items);
+        targets = m_new(uint8_t, 20 * ntargets);
+        for (size_t i = 0; i < ntargets; i++) {
+            mp_get_buffer_raise(items[i], &buf, MP_BUFFER_READ);
+            if (buf.len != 20) {
+                mp_raise_ValueError("Targets must be 20 bytes each");
+            }
+            memcpy(targets + 20 * i, buf.buf, 20);
+        }
+    }
+
+    bip32_public_parent_t parent;
+    bool ok = bip32_public_parent_init(&parent, &node);
+    memset(&node, 0, sizeof(node));
+    if (!ok) {
+        mp_raise_ValueError("Curve does not support public derivation");
+    }
+    if (ntargets == 0 || count == 0) {
+        memset(&parent, 0, sizeof(parent));
+        return mp_obj_new_list(0, NULL);
+    }
+
+    // at most half full
+    size_t nslots = 4;
+    while (nslots < 2 * ntargets) {
+        nslots <<= 1;
+    }
+
+    bip32_scan_t s;
+    memset(&s, 0, sizeof(s));
+    s.parent = &parent;
+    s.start = s.next = start;
+    s.end = start + count;
+    s.targets = targets;
+    uint32_t *slots = m_new(uint32_t, nslots);
+    memset(slots, 0, nslots * sizeof(uint32_t));
+    s.slots = slots;
+    s.mask = nslots - 1;
+    for (size_t i = 0; i < ntargets; i++) {
+        if (!bip32_scan_lookup(&s, targets + 20 * i)) {
+            uint32_t j = bip32_scan_slot(targets + 20 * i) & s.mask;
+            while (slots[j]) {
+                j = (j + 1) & s.mask;
+            }
+            slots[j] = i + 1;
+        }
+    }
+    // a target is met at most once, short of a HASH160 collision
+    s.max_hits = ntargets;
+    s.hits = m_new(bip32_scan_hit_t, ntargets);
+
+    // trezor-crypto's scalar_multiply() draws random numbers, from state
+    // that isn't safe to share between threads
+    if (!parent.gen) {
+        threads = 1;
+    }
+    modtcc_run_workers(bip32_scan_run, &s, threads, (count + BIP32_SCAN_CHUNK - 1) / BIP32_SCAN_CHUNK, NULL);
+    memset(&parent, 0, sizeof(parent));
+
+    size_t found = s.found < s.max_hits ? s.found : s.max_hits;
+    // by index; there are few
+    for (size_t i = 1; i < found; i++) {
+        bip32_scan_hit_t hit = s.hits[i];
+        size_t j = i;
+        for (; j > 0 && s.hits[j - 1].index > hit.index; j--) {
+            s.hits[j] = s.hits[j - 1];
+        }
+        s.hits[j] = hit;
+    }
+
+    mp_obj_t result = mp_obj_new_list(0, NULL);
+    for (size_t i = 0; i < found; i++) {
+        mp_obj_t tuple[2] = {
+            mp_obj_new_int_from_uint(s.hits[i].index),
+            mp_obj_new_bytes(s.hits[i].hash, 20),
+        };
+        mp_obj_list_append(result, mp_obj_new_tuple(2, tuple));
+    }
+    m_del(bip32_scan_hit_t, s.hits, ntargets);
+    m_del(uint32_t, slots, nslots);
+    m_del(uint8_t, targets, 20 * ntargets);
+    return result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_bip32_scan_obj, 5, 6, mod_trezorcrypto_bip32_scan);
+
+/// def cache_clear() -> None:
+///     '''
+///     Wipes the cache of derived nodes, which holds private keys, and
+///     zeroes its counters.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_bip32_cache_clear(void) {
+    bip32_cache_clear();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_trezorcrypto_bip32_cache_clear_obj, mod_trezorcrypto_bip32_cache_clear);
+
+/// def cache_configure(size: int) -> None:
+///     '''
+///     Sets how many derived nodes are kept; 0 turns the cache off. Cannot
+///     exceed the size compiled in (BIP32_CACHE_SIZE).
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_bip32_cache_configure(mp_obj_t size) {
+    if (!bip32_cache_configure(mp_obj_get_int(size))) {
+        mp_raise_ValueError("Cache size not supported by this build");
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_bip32_cache_configure_obj, mod_trezorcrypto_bip32_cache_configure);
+
+/// def cache_stats() -> Tuple[int, int, int]:
+///     '''
+///     Returns (hits, misses, size) of the cache of derived nodes.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_bip32_cache_stats(void) {
+    uint32_t hits, misses;
+    int size;
+    bip32_cache_stats(&hits, &misses, &size);
+    mp_obj_t tuple[3] = {
+        mp_obj_new_int_from_uint(hits),
+        mp_obj_new_int_from_uint(misses),
+        MP_OBJ_NEW_SMALL_INT(size),
+    };
+    return mp_obj_new_tuple(3, tuple);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_trezorcrypto_bip32_cache_stats_obj, mod_trezorcrypto_bip32_cache_stats);
+
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_bip32_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_bip32) },
     { MP_ROM_QSTR(MP_QSTR_HDNode), MP_ROM_PTR(&mod_trezorcrypto_HDNode_type) },
     { MP_ROM_QSTR(MP_QSTR_deserialize), MP_ROM_PTR(&mod_trezorcrypto_bip32_deserialize_obj) },
     { MP_ROM_QSTR(MP_QSTR_from_seed), MP_ROM_PTR(&mod_trezorcrypto_bip32_from_seed_obj) },
+    { MP_ROM_QSTR(MP_QSTR_from_bytes), MP_ROM_PTR(&mod_trezorcrypto_bip32_from_bytes_obj) },
+    { MP_ROM_QSTR(MP_QSTR_scan), MP_ROM_PTR(&mod_trezorcrypto_bip32_scan_obj) },
+    { MP_ROM_QSTR(MP_QSTR_cache_clear), MP_ROM_PTR(&mod_trezorcrypto_bip32_cache_clear_obj) },
+    { MP_ROM_QSTR(MP_QSTR_cache_configure), MP_ROM_PTR(&mod_trezorcrypto_bip32_cache_configure_obj) },
+    { MP_ROM_QSTR(MP_QSTR_cache_stats), MP_ROM_PTR(&mod_trezorcrypto_bip32_cache_stats_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(mod_trezorcrypto_bip32_globals, mod_trezorcrypto_bip32_globals_table);
 
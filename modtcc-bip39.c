@@ -8,6 +8,65 @@
 #include "py/objstr.h"
 
 #include "bip39.h"
+#include "pbkdf2.h"
+#include "bip39_prefix.h"
+
+// The wordlist is in alphabetical order, so the words with any prefix are a
+// contiguous range of it: found by binary search within the first letter's
+// bucket. The 54-byte bucket table is made from bip39_english.h by
+// "make bip39_prefix.h", which also checks the order.
+
+// indexes [*lo, *hi) of the words that may start with pfx
+STATIC void bip39_prefix_range(const char *pfx, size_t len, int *lo, int *hi)
+{
+    const char * const *wl = mnemonic_wordlist();
+
+    uint8_t c = len ? pfx[0] - 'a' : 26;
+    if (c >= 26) {
+        *lo = *hi = 0;
+        return;
+    }
+
+    int end = bip39_bucket[c + 1];
+    int l = bip39_bucket[c], h = end;
+    while (l < h) {
+        int m = (l + h) / 2;
+        if (strncmp(wl[m], pfx, len) < 0) {
+            l = m + 1;
+        } else {
+            h = m;
+        }
+    }
+    *lo = l;
+    h = end;
+    while (l < h) {
+        int m = (l + h) / 2;
+        if (strncmp(wl[m], pfx, len) <= 0) {
+            l = m + 1;
+        } else {
+            h = m;
+        }
+    }
+    *hi = l;
+}
+
+// index of a whole word, or -1
+STATIC int bip39_word_index(const char *word, size_t len)
+{
+    const char * const *wl = mnemonic_wordlist();
+    int lo, hi;
+
+    if (len == 0) {
+        return -1;
+    }
+    bip39_prefix_range(word, len, &lo, &hi);
+    for (int i = lo; i < hi; i++) {
+        if ((strlen(wl[i]) == len) && (strncmp(wl[i], word, len) == 0)) {
+            return i;
+        }
+    }
+    return -1;
+}
 
 /// def lookup_nth(idx: int) -> str:
 ///     '''
@@ -38,16 +97,67 @@ STATIC mp_obj_t mod_tcc_bip39_lookup_word(mp_obj_t word)
     mp_buffer_info_t want;
     mp_get_buffer_raise(word, &want, MP_BUFFER_READ);
 
-    int i = 0;
-    for (const char * const *w = mnemonic_wordlist(); *w != 0; w++, i++) {
-        if ((strlen(*w) == want.len) && (strncmp(*w, want.buf, want.len) == 0)) {
-            return MP_OBJ_NEW_SMALL_INT(i);
+    int i = bip39_word_index(want.buf, want.len);
+    if (i < 0) {
+        mp_raise_ValueError("Unknown word");
+    }
+    return MP_OBJ_NEW_SMALL_INT(i);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_tcc_bip39_lookup_word_obj, mod_tcc_bip39_lookup_word);
+
+/// def decode_words(mnemonic: str) -> bytes:
+///     '''
+///     Return the 11-bit values of the words in mnemonic, packed big-endian
+///     and padded with zero bits to whole bytes: for a valid mnemonic, its
+///     entropy followed by the checksum. Raises ValueError for an unknown word.
+///     '''
+STATIC mp_obj_t mod_tcc_bip39_decode_words(mp_obj_t mnemonic)
+{
+    mp_buffer_info_t text;
+    mp_get_buffer_raise(mnemonic, &text, MP_BUFFER_READ);
+    const char *s = text.buf, *end = s + text.len;
+
+    size_t count = 0;
+    for (const char *p = s; p < end; p++) {
+        if (*p != ' ' && (p == s || p[-1] == ' ')) {
+            count++;
+        }
+    }
+
+    vstr_t vstr;
+    vstr_init_len(&vstr, (count * 11 + 7) / 8);
+    uint8_t *out = (uint8_t *)vstr.buf;
+    uint32_t acc = 0;
+    int bits = 0;
+
+    for (const char *p = s; p < end; ) {
+        if (*p == ' ') {
+            p++;
+            continue;
+        }
+        const char *w = p;
+        while (p < end && *p != ' ') {
+            p++;
+        }
+        int i = bip39_word_index(w, p - w);
+        if (i < 0) {
+            vstr_clear(&vstr);
+            mp_raise_ValueError("Unknown word");
+        }
+        acc = (acc << 11) | i;
+        bits += 11;
+        while (bits >= 8) {
+            bits -= 8;
+            *out++ = acc >> bits;
         }
     }
+    if (bits) {
+        *out = acc << (8 - bits);
+    }
 
-    mp_raise_ValueError("Unknown word");
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_tcc_bip39_lookup_word_obj, mod_tcc_bip39_lookup_word);
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_tcc_bip39_decode_words_obj, mod_tcc_bip39_decode_words);
 
 
 
@@ -62,9 +172,12 @@ STATIC mp_obj_t mod_trezorcrypto_bip39_find_word(mp_obj_t prefix)
     if (pfx.len == 0) {
         mp_raise_ValueError("Invalid word prefix");
     }
-    for (const char * const *w = mnemonic_wordlist(); *w != 0; w++) {
-        if (strncmp(*w, pfx.buf, pfx.len) == 0) {
-            return mp_obj_new_str(*w, strlen(*w));
+    const char * const *wl = mnemonic_wordlist();
+    int lo, hi;
+    bip39_prefix_range(pfx.buf, pfx.len, &lo, &hi);
+    for (int i = lo; i < hi; i++) {
+        if (strncmp(wl[i], pfx.buf, pfx.len) == 0) {
+            return mp_obj_new_str(wl[i], strlen(wl[i]));
         }
     }
     return mp_const_none;
@@ -89,9 +202,11 @@ STATIC mp_obj_t mod_trezorcrypto_bip39_complete_word(mp_obj_t prefix)
     uint32_t res = 0;
     uint8_t bit;
     const char *word;
-    const char *const *wlist;
-    for (wlist = mnemonic_wordlist(); *wlist != 0; wlist++) {
-        word = *wlist;
+    const char *const *wlist = mnemonic_wordlist();
+    int lo, hi;
+    bip39_prefix_range(pfx.buf, pfx.len, &lo, &hi);
+    for (int i = lo; i < hi; i++) {
+        word = wlist[i];
         if (strncmp(word, pfx.buf, pfx.len) == 0) {
             if(strlen(word) == pfx.len) {
                 res |= 1 << 26;
@@ -150,22 +265,203 @@ STATIC mp_obj_t mod_trezorcrypto_bip39_check(mp_obj_t mnemonic) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_bip39_check_obj, mod_trezorcrypto_bip39_check);
 
-/// def seed(mnemonic: str, passphrase: str) -> bytes:
+// Longest passphrase mnemonic_to_seed() uses; it ignores any more.
+#define BIP39_MAX_PASSPHRASE 256
+
+// Seeds are computed in this many steps, with a progress callback between.
+#define BIP39_SEED_STEPS 16
+
+STATIC void bip39_seed_begin(PBKDF2_HMAC_SHA512_CTX *pctx, const uint8_t *mnemonic, size_t mnemonic_len, const uint8_t *passphrase, size_t passphrase_len) {
+    uint8_t salt[8 + BIP39_MAX_PASSPHRASE];
+    memcpy(salt, "mnemonic", 8);
+    memcpy(salt + 8, passphrase, passphrase_len);
+    pbkdf2_hmac_sha512_Init(pctx, mnemonic, mnemonic_len, salt, 8 + passphrase_len);
+    memset(salt, 0, sizeof(salt));
+}
+
+/// def seed(mnemonic: str, passphrase: str, progress: Callable[[int, int], None] = None) -> bytes:
 ///     '''
-///     Generate seed from mnemonic and passphrase.
+///     Generate seed from mnemonic and passphrase. If given, progress(done, total)
+///     is called as the PBKDF2 rounds proceed; raise from it to abort.
+///     A passphrase over 256 bytes raises ValueError (it used to be cut to
+///     its first 256 bytes).
 ///     '''
-STATIC mp_obj_t mod_trezorcrypto_bip39_seed(mp_obj_t mnemonic, mp_obj_t passphrase) {
+STATIC mp_obj_t mod_trezorcrypto_bip39_seed(size_t n_args, const mp_obj_t *args) {
     mp_buffer_info_t mnemo;
     mp_buffer_info_t phrase;
-    mp_get_buffer_raise(mnemonic, &mnemo, MP_BUFFER_READ);
-    mp_get_buffer_raise(passphrase, &phrase, MP_BUFFER_READ);
+    mp_get_buffer_raise(args[0], &mnemo, MP_BUFFER_READ);
+    mp_get_buffer_raise(args[1], &phrase, MP_BUFFER_READ);
+    if (phrase.len > BIP39_MAX_PASSPHRASE) {
+        mp_raise_ValueError("Passphrase too long");
+    }
     uint8_t seed[64];
-    const char *pmnemonic = mnemo.len > 0 ? mnemo.buf : "";
-    const char *ppassphrase = phrase.len > 0 ? phrase.buf : "";
-    mnemonic_to_seed(pmnemonic, ppassphrase, seed, NULL); // no callback for now
+    if (n_args < 3 || args[2] == mp_const_none) {
+        const char *pmnemonic = mnemo.len > 0 ? mnemo.buf : "";
+        const char *ppassphrase = phrase.len > 0 ? phrase.buf : "";
+        mnemonic_to_seed(pmnemonic, ppassphrase, seed, NULL);
+        return mp_obj_new_bytes(seed, sizeof(seed));
+    }
+
+    mp_obj_t progress = args[2];
+    PBKDF2_HMAC_SHA512_CTX pctx;
+    nlr_buf_t nlr;
+    bip39_seed_begin(&pctx, mnemo.buf, mnemo.len, phrase.buf, phrase.len);
+    if (nlr_push(&nlr) == 0) {
+        mp_call_function_2(progress, MP_OBJ_NEW_SMALL_INT(0), MP_OBJ_NEW_SMALL_INT(BIP39_PBKDF2_ROUNDS));
+        for (int i = 1; i <= BIP39_SEED_STEPS; i++) {
+            pbkdf2_hmac_sha512_Update(&pctx, BIP39_PBKDF2_ROUNDS / BIP39_SEED_STEPS);
+            mp_call_function_2(progress, MP_OBJ_NEW_SMALL_INT(i * BIP39_PBKDF2_ROUNDS / BIP39_SEED_STEPS),
+                                         MP_OBJ_NEW_SMALL_INT(BIP39_PBKDF2_ROUNDS));
+        }
+        nlr_pop();
+    } else {
+        // aborted by the callback
+        memset(&pctx, 0, sizeof(pctx));
+        nlr_jump(nlr.ret_val);
+    }
+    pbkdf2_hmac_sha512_Final(&pctx, seed);
+    memset(&pctx, 0, sizeof(pctx));
     return mp_obj_new_bytes(seed, sizeof(seed));
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_bip39_seed_obj, mod_trezorcrypto_bip39_seed);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_bip39_seed_obj, 2, 3, mod_trezorcrypto_bip39_seed);
+
+// seed_many(): jobs are handed out to the calling thread and worker threads
+// by modtcc_run_workers(). Only the calling thread touches Python objects;
+// the workers see plain buffers, and the passphrases are copied into the
+// jobs, since progress() may drop the strings while they run.
+typedef struct {
+    const uint8_t *mnemonic;
+    size_t mnemonic_len;
+    size_t passphrase_len;
+    uint8_t passphrase[BIP39_MAX_PASSPHRASE];
+    uint8_t seed[64];
+} bip39_seed_job_t;
+
+typedef struct {
+    bip39_seed_job_t *jobs;
+    size_t count;
+    mp_obj_t progress;
+    void *exc;          // raised by progress(), if abort
+    size_t next;        // these three are shared between threads
+    size_t done;
+    int abort;
+} bip39_seed_queue_t;
+
+STATIC bip39_seed_job_t *bip39_seed_take(bip39_seed_queue_t *q) {
+    if (__atomic_load_n(&q->abort, __ATOMIC_RELAXED)) {
+        return NULL;
+    }
+    size_t i = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED);
+    return (i < q->count) ? &q->jobs[i] : NULL;
+}
+
+STATIC void bip39_seed_run(bip39_seed_queue_t *q, bip39_seed_job_t *job) {
+    PBKDF2_HMAC_SHA512_CTX pctx;
+    bip39_seed_begin(&pctx, job->mnemonic, job->mnemonic_len, job->passphrase, job->passphrase_len);
+    pbkdf2_hmac_sha512_Update(&pctx, BIP39_PBKDF2_ROUNDS);
+    pbkdf2_hmac_sha512_Final(&pctx, job->seed);
+    memset(&pctx, 0, sizeof(pctx));
+    __atomic_fetch_add(&q->done, 1, __ATOMIC_RELEASE);
+}
+
+STATIC void bip39_seed_work(void *arg) {
+    bip39_seed_queue_t *q = arg;
+    bip39_seed_job_t *job;
+    while ((job = bip39_seed_take(q)) != NULL) {
+        bip39_seed_run(q, job);
+    }
+}
+
+// the calling thread's share, with progress() between jobs
+STATIC void bip39_seed_work_caller(void *arg) {
+    bip39_seed_queue_t *q = arg;
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        bip39_seed_job_t *job;
+        while ((job = bip39_seed_take(q)) != NULL) {
+            bip39_seed_run(q, job);
+            if (q->progress != mp_const_none) {
+                size_t done = __atomic_load_n(&q->done, __ATOMIC_ACQUIRE);
+                mp_call_function_2(q->progress, mp_obj_new_int(done), mp_obj_new_int(q->count));
+            }
+        }
+        nlr_pop();
+    } else {
+        // aborted by the callback: stop handing out work
+        q->exc = nlr.ret_val;
+        __atomic_store_n(&q->abort, 1, __ATOMIC_RELAXED);
+    }
+}
+
+/// def seed_many(mnemonic: str, passphrases: List[str], progress: Callable[[int, int], None] = None, threads: int = 0) -> List[bytes]:
+///     '''
+///     Generate the seeds for one mnemonic and many passphrases, using all
+///     CPUs (or the given number of threads) on unix hosts. If given,
+///     progress(done, total) is called now and then; raise from it to abort.
+///     Passphrases over 256 bytes raise ValueError, as in seed().
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_bip39_seed_many(size_t n_args, const mp_obj_t *args) {
+    mp_buffer_info_t mnemo;
+    mp_get_buffer_raise(args[0], &mnemo, MP_BUFFER_READ);
+    size_t count;
+    mp_obj_t *items;
+    mp_obj_get_array(args[1], &count, &items);
+    mp_obj_t progress = (n_args > 2) ? args[2] : mp_const_none;
+    mp_int_t threads = (n_args > 3) ? mp_obj_get_int(args[3]) : 0;
+    if (count == 0) {
+        return mp_obj_new_list(0, NULL);
+    }
+
+    bip39_seed_queue_t q;
+    memset(&q, 0, sizeof(q));
+    q.jobs = m_new(bip39_seed_job_t, count);
+    q.count = count;
+    q.progress = progress;
+
+    // wipe what was copied so far if an item is not a buffer, or too long
+    nlr_buf_t nlr;
+    if (nlr_push(&nlr) == 0) {
+        for (size_t i = 0; i < count; i++) {
+            mp_buffer_info_t phrase;
+            mp_get_buffer_raise(items[i], &phrase, MP_BUFFER_READ);
+            if (phrase.len > BIP39_MAX_PASSPHRASE) {
+                mp_raise_ValueError("Passphrase too long");
+            }
+            q.jobs[i].mnemonic = mnemo.buf;
+            q.jobs[i].mnemonic_len = mnemo.len;
+            memcpy(q.jobs[i].passphrase, phrase.buf, phrase.len);
+            q.jobs[i].passphrase_len = phrase.len;
+        }
+        nlr_pop();
+    } else {
+        memset(q.jobs, 0, count * sizeof(bip39_seed_job_t));
+        m_del(bip39_seed_job_t, q.jobs, count);
+        nlr_jump(nlr.ret_val);
+    }
+
+    modtcc_run_workers(bip39_seed_work, &q, threads, count, bip39_seed_work_caller);
+    if (q.abort) {
+        memset(q.jobs, 0, count * sizeof(bip39_seed_job_t));
+        m_del(bip39_seed_job_t, q.jobs, count);
+        nlr_jump(q.exc);
+    }
+
+    mp_obj_t result = mp_obj_new_list(count, NULL);
+    size_t rlen;
+    mp_obj_t *ritems;
+    mp_obj_list_get(result, &rlen, &ritems);
+    for (size_t i = 0; i < count; i++) {
+        ritems[i] = mp_obj_new_bytes(q.jobs[i].seed, 64);
+    }
+    memset(q.jobs, 0, count * sizeof(bip39_seed_job_t));
+    m_del(bip39_seed_job_t, q.jobs, count);
+
+    if (progress != mp_const_none) {
+        mp_call_function_2(progress, mp_obj_new_int(count), mp_obj_new_int(count));
+    }
+    return result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_bip39_seed_many_obj, 2, 4, mod_trezorcrypto_bip39_seed_many);
 
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_bip39_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_bip39) },
@@ -175,8 +471,10 @@ STATIC const mp_rom_map_elem_t mod_trezorcrypto_bip39_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_from_data), MP_ROM_PTR(&mod_trezorcrypto_bip39_from_data_obj) },
     { MP_ROM_QSTR(MP_QSTR_check), MP_ROM_PTR(&mod_trezorcrypto_bip39_check_obj) },
     { MP_ROM_QSTR(MP_QSTR_seed), MP_ROM_PTR(&mod_trezorcrypto_bip39_seed_obj) },
+    { MP_ROM_QSTR(MP_QSTR_seed_many), MP_ROM_PTR(&mod_trezorcrypto_bip39_seed_many_obj) },
     { MP_ROM_QSTR(MP_QSTR_lookup_nth), MP_ROM_PTR(&mod_tcc_bip39_lookup_nth_obj) },
     { MP_ROM_QSTR(MP_QSTR_lookup_word), MP_ROM_PTR(&mod_tcc_bip39_lookup_word_obj) },
+    { MP_ROM_QSTR(MP_QSTR_decode_words), MP_ROM_PTR(&mod_tcc_bip39_decode_words_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(mod_trezorcrypto_bip39_globals, mod_trezorcrypto_bip39_globals_table);
 
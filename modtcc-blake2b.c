@@ -16,9 +16,12 @@
 typedef struct _mp_obj_Blake2b_t {
     mp_obj_base_t base;
     BLAKE2B_CTX ctx;
+    uint8_t key[BLAKE2B_KEY_LENGTH];       // for reset()
+    size_t key_len;
 } mp_obj_Blake2b_t;
 
 STATIC mp_obj_t mod_trezorcrypto_Blake2b_update(mp_obj_t self, mp_obj_t data);
+STATIC mp_obj_t mod_trezorcrypto_Blake2b_reset(mp_obj_t self);
 
 /// def __init__(self, data: bytes = None, key: bytes = None) -> None:
 ///     '''
@@ -28,14 +31,18 @@ STATIC mp_obj_t mod_trezorcrypto_Blake2b_make_new(const mp_obj_type_t *type, siz
     mp_arg_check_num(n_args, n_kw, 0, 2, false);
     mp_obj_Blake2b_t *o = m_new_obj(mp_obj_Blake2b_t);
     o->base.type = type;
+    o->key_len = 0;
     // constructor called with key argument set
     if (n_args == 2) {
         mp_buffer_info_t key;
         mp_get_buffer_raise(args[1], &key, MP_BUFFER_READ);
-        blake2b_InitKey(&(o->ctx), BLAKE2B_DIGEST_LENGTH, key.buf, key.len);
-    } else {
-        blake2b_Init(&(o->ctx), BLAKE2B_DIGEST_LENGTH);
+        if (key.len > BLAKE2B_KEY_LENGTH) {
+            mp_raise_ValueError("Invalid key length");
+        }
+        memcpy(o->key, key.buf, key.len);
+        o->key_len = key.len;
     }
+    mod_trezorcrypto_Blake2b_reset(MP_OBJ_FROM_PTR(o));
     // constructor called with data argument set
     if (n_args >= 1) {
         mod_trezorcrypto_Blake2b_update(MP_OBJ_FROM_PTR(o), args[0]);
@@ -58,6 +65,14 @@ STATIC mp_obj_t mod_trezorcrypto_Blake2b_update(mp_obj_t self, mp_obj_t data) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Blake2b_update_obj, mod_trezorcrypto_Blake2b_update);
 
+// Finishes a copy of the context, so it can take more data afterwards.
+STATIC void mod_trezorcrypto_Blake2b_final(mp_obj_Blake2b_t *o, uint8_t *out) {
+    BLAKE2B_CTX ctx;
+    memcpy(&ctx, &(o->ctx), sizeof(BLAKE2B_CTX));
+    blake2b_Final(&ctx, out, BLAKE2B_DIGEST_LENGTH);
+    memset(&ctx, 0, sizeof(BLAKE2B_CTX));
+}
+
 /// def digest(self) -> bytes:
 ///     '''
 ///     Returns the digest of hashed data.
@@ -65,17 +80,41 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Blake2b_update_obj, mod_trezor
 STATIC mp_obj_t mod_trezorcrypto_Blake2b_digest(mp_obj_t self) {
     mp_obj_Blake2b_t *o = MP_OBJ_TO_PTR(self);
     uint8_t out[BLAKE2B_DIGEST_LENGTH];
-    BLAKE2B_CTX ctx;
-    memcpy(&ctx, &(o->ctx), sizeof(BLAKE2B_CTX));
-    blake2b_Final(&ctx, out, BLAKE2B_DIGEST_LENGTH);
-    memset(&ctx, 0, sizeof(BLAKE2B_CTX));
+    mod_trezorcrypto_Blake2b_final(o, out);
     return mp_obj_new_bytes(out, sizeof(out));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Blake2b_digest_obj, mod_trezorcrypto_Blake2b_digest);
 
+/// def digest_into(self, buf: bytearray, offset: int = 0) -> None:
+///     '''
+///     Writes the digest of hashed data into buf, starting at offset.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Blake2b_digest_into(size_t n_args, const mp_obj_t *args) {
+    mp_obj_Blake2b_t *o = MP_OBJ_TO_PTR(args[0]);
+    mod_trezorcrypto_Blake2b_final(o, modtcc_get_digest_buffer(n_args - 1, args + 1, BLAKE2B_DIGEST_LENGTH));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_Blake2b_digest_into_obj, 2, 3, mod_trezorcrypto_Blake2b_digest_into);
+
+/// def reset(self) -> None:
+///     '''
+///     Starts over on a new message, as if the object was just created.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Blake2b_reset(mp_obj_t self) {
+    mp_obj_Blake2b_t *o = MP_OBJ_TO_PTR(self);
+    if (o->key_len) {
+        blake2b_InitKey(&(o->ctx), BLAKE2B_DIGEST_LENGTH, o->key, o->key_len);
+    } else {
+        blake2b_Init(&(o->ctx), BLAKE2B_DIGEST_LENGTH);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Blake2b_reset_obj, mod_trezorcrypto_Blake2b_reset);
+
 STATIC mp_obj_t mod_trezorcrypto_Blake2b___del__(mp_obj_t self) {
     mp_obj_Blake2b_t *o = MP_OBJ_TO_PTR(self);
     memset(&(o->ctx), 0, sizeof(BLAKE2B_CTX));
+    memset(o->key, 0, sizeof(o->key));
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Blake2b___del___obj, mod_trezorcrypto_Blake2b___del__);
@@ -83,6 +122,8 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Blake2b___del___obj, mod_trezo
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_Blake2b_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&mod_trezorcrypto_Blake2b_update_obj) },
     { MP_ROM_QSTR(MP_QSTR_digest), MP_ROM_PTR(&mod_trezorcrypto_Blake2b_digest_obj) },
+    { MP_ROM_QSTR(MP_QSTR_digest_into), MP_ROM_PTR(&mod_trezorcrypto_Blake2b_digest_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&mod_trezorcrypto_Blake2b_reset_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mod_trezorcrypto_Blake2b___del___obj) },
     { MP_ROM_QSTR(MP_QSTR_block_size), MP_OBJ_NEW_SMALL_INT(BLAKE2B_BLOCK_LENGTH) },
     { MP_ROM_QSTR(MP_QSTR_digest_size), MP_OBJ_NEW_SMALL_INT(BLAKE2B_DIGEST_LENGTH) },
@@ -7,7 +7,7 @@
 
 #include "py/objstr.h"
 
-#include "chacha20poly1305/rfc7539.h"
+#include "chacha_poly.h"
 
 /// class ChaCha20Poly1305:
 ///     '''
@@ -15,108 +15,360 @@
 ///     '''
 typedef struct _mp_obj_ChaCha20Poly1305_t {
     mp_obj_base_t base;
-    chacha20poly1305_ctx ctx;
-    int64_t alen, plen;
+    chacha_poly_ctx ctx;
+    uint8_t key[32];            // for XChaCha20 and STREAM, which derive their own
 } mp_obj_ChaCha20Poly1305_t;
 
+// A context for one whole message: a 12 byte nonce is RFC 7539, a 24 byte
+// one XChaCha20-Poly1305.
+STATIC void mod_trezorcrypto_ChaCha20Poly1305_start(chacha_poly_ctx *ctx, const uint8_t key[32], mp_obj_t nonce_obj) {
+    mp_buffer_info_t nonce;
+    mp_get_buffer_raise(nonce_obj, &nonce, MP_BUFFER_READ);
+    if (nonce.len == 12) {
+        chacha_poly_init(ctx, key, nonce.buf);
+    } else if (nonce.len == 24) {
+        xchacha_poly_init(ctx, key, nonce.buf);
+    } else {
+        mp_raise_ValueError("Invalid length of nonce");
+    }
+}
+
 /// def __init__(self, key: bytes, nonce: bytes) -> None:
 ///     '''
 ///     Initialize the ChaCha20 + Poly1305 context for encryption or decryption
-///     using a 32 byte key and 12 byte nonce as in the RFC 7539 style.
+///     using a 32 byte key and 12 byte nonce as in the RFC 7539 style, or a
+///     24 byte nonce for XChaCha20-Poly1305, which is safe to pick at random.
 ///     '''
 STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
     mp_arg_check_num(n_args, n_kw, 2, 2, false);
     mp_obj_ChaCha20Poly1305_t *o = m_new_obj(mp_obj_ChaCha20Poly1305_t);
     o->base.type = type;
-    mp_buffer_info_t key, nonce;
+    mp_buffer_info_t key;
     mp_get_buffer_raise(args[0], &key, MP_BUFFER_READ);
-    mp_get_buffer_raise(args[1], &nonce, MP_BUFFER_READ);
     if (key.len != 32) {
         mp_raise_ValueError("Invalid length of key");
     }
-    if (nonce.len != 12) {
-        mp_raise_ValueError("Invalid length of nonce");
-    }
-    rfc7539_init(&(o->ctx), key.buf, nonce.buf);
-    o->alen = 0;
-    o->plen = 0;
+    memcpy(o->key, key.buf, 32);
+    mod_trezorcrypto_ChaCha20Poly1305_start(&(o->ctx), o->key, args[1]);
     return MP_OBJ_FROM_PTR(o);
 }
 
 /// def encrypt(self, data: bytes) -> bytes:
 ///     '''
-///     Encrypt data (length of data must be divisible by 64 except for the final value).
+///     Encrypt data, of any length.
 ///     '''
 STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_encrypt(mp_obj_t self, mp_obj_t data) {
     mp_obj_ChaCha20Poly1305_t *o = MP_OBJ_TO_PTR(self);
+    if (o->ctx.finished) {
+        mp_raise_ValueError("finish() already called");
+    }
     mp_buffer_info_t in;
     mp_get_buffer_raise(data, &in, MP_BUFFER_READ);
     vstr_t vstr;
     vstr_init_len(&vstr, in.len);
-    chacha20poly1305_encrypt(&(o->ctx), in.buf, (uint8_t *)vstr.buf, in.len);
-    o->plen += in.len;
+    chacha_poly_encrypt(&(o->ctx), in.buf, (uint8_t *)vstr.buf, in.len);
     return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_ChaCha20Poly1305_encrypt_obj, mod_trezorcrypto_ChaCha20Poly1305_encrypt);
 
+/// def encrypt_into(self, data: bytes, out: bytearray) -> int:
+///     '''
+///     Same as encrypt(), but writes into a buffer of at least len(data) bytes
+///     instead of allocating. out may be data itself, to work in place.
+///     Returns the number of bytes written.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_encrypt_into(mp_obj_t self, mp_obj_t data, mp_obj_t out) {
+    mp_obj_ChaCha20Poly1305_t *o = MP_OBJ_TO_PTR(self);
+    if (o->ctx.finished) {
+        mp_raise_ValueError("finish() already called");
+    }
+    mp_buffer_info_t in;
+    mp_get_buffer_raise(data, &in, MP_BUFFER_READ);
+    uint8_t *dst = modtcc_get_output_buffer(out, &in);
+    chacha_poly_encrypt(&(o->ctx), in.buf, dst, in.len);
+    return mp_obj_new_int(in.len);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(mod_trezorcrypto_ChaCha20Poly1305_encrypt_into_obj, mod_trezorcrypto_ChaCha20Poly1305_encrypt_into);
+
 /// def decrypt(self, data: bytes) -> bytes:
 ///     '''
-///     Decrypt data (length of data must be divisible by 64 except for the final value).
+///     Decrypt data, of any length.
 ///     '''
 STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_decrypt(mp_obj_t self, mp_obj_t data) {
     mp_obj_ChaCha20Poly1305_t *o = MP_OBJ_TO_PTR(self);
+    if (o->ctx.finished) {
+        mp_raise_ValueError("finish() already called");
+    }
     mp_buffer_info_t in;
     mp_get_buffer_raise(data, &in, MP_BUFFER_READ);
     vstr_t vstr;
     vstr_init_len(&vstr, in.len);
-    chacha20poly1305_decrypt(&(o->ctx), in.buf, (uint8_t *)vstr.buf, in.len);
-    o->plen += in.len;
+    chacha_poly_decrypt(&(o->ctx), in.buf, (uint8_t *)vstr.buf, in.len);
     return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_ChaCha20Poly1305_decrypt_obj, mod_trezorcrypto_ChaCha20Poly1305_decrypt);
 
+/// def decrypt_into(self, data: bytes, out: bytearray) -> int:
+///     '''
+///     Same as decrypt(), but writes into a buffer of at least len(data) bytes
+///     instead of allocating. out may be data itself, to work in place.
+///     Returns the number of bytes written.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_decrypt_into(mp_obj_t self, mp_obj_t data, mp_obj_t out) {
+    mp_obj_ChaCha20Poly1305_t *o = MP_OBJ_TO_PTR(self);
+    if (o->ctx.finished) {
+        mp_raise_ValueError("finish() already called");
+    }
+    mp_buffer_info_t in;
+    mp_get_buffer_raise(data, &in, MP_BUFFER_READ);
+    uint8_t *dst = modtcc_get_output_buffer(out, &in);
+    chacha_poly_decrypt(&(o->ctx), in.buf, dst, in.len);
+    return mp_obj_new_int(in.len);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(mod_trezorcrypto_ChaCha20Poly1305_decrypt_into_obj, mod_trezorcrypto_ChaCha20Poly1305_decrypt_into);
+
 /// def auth(self, data: bytes) -> None:
 ///     '''
 ///     Include authenticated data in the Poly1305 MAC using the RFC 7539
-///     style with 16 byte padding. This must only be called once and prior
-///     to encryption or decryption.
+///     style with 16 byte padding. May be called more than once, but only
+///     before encryption or decryption.
 ///     '''
 STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_auth(mp_obj_t self, mp_obj_t data) {
     mp_obj_ChaCha20Poly1305_t *o = MP_OBJ_TO_PTR(self);
     mp_buffer_info_t in;
     mp_get_buffer_raise(data, &in, MP_BUFFER_READ);
-    rfc7539_auth(&(o->ctx), in.buf, in.len);
-    o->alen += in.len;
+    if (o->ctx.in_text || o->ctx.finished) {
+        mp_raise_ValueError("auth() must come before encryption/decryption");
+    }
+    chacha_poly_auth(&(o->ctx), in.buf, in.len);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_ChaCha20Poly1305_auth_obj, mod_trezorcrypto_ChaCha20Poly1305_auth);
 
 /// def finish(self) -> bytes:
 ///     '''
-///     Compute RFC 7539-style Poly1305 MAC.
+///     Compute RFC 7539-style Poly1305 MAC. Later calls return the same
+///     MAC; no more data can be added after the first.
 ///     '''
 STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_finish(mp_obj_t self) {
     mp_obj_ChaCha20Poly1305_t *o = MP_OBJ_TO_PTR(self);
     uint8_t out[16];
-    rfc7539_finish(&(o->ctx), o->alen, o->plen, out);
+    chacha_poly_finish(&(o->ctx), out);
     return mp_obj_new_bytes(out, sizeof(out));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_ChaCha20Poly1305_finish_obj, mod_trezorcrypto_ChaCha20Poly1305_finish);
 
+/// def verify(self, tag: bytes) -> bool:
+///     '''
+///     Compute the MAC as finish() does, and compare it with tag in
+///     constant time.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_verify(mp_obj_t self, mp_obj_t tag) {
+    mp_obj_ChaCha20Poly1305_t *o = MP_OBJ_TO_PTR(self);
+    mp_buffer_info_t t;
+    mp_get_buffer_raise(tag, &t, MP_BUFFER_READ);
+    if (t.len != 16) {
+        mp_raise_ValueError("Invalid length of tag");
+    }
+    return mp_obj_new_bool(chacha_poly_verify(&(o->ctx), t.buf));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_ChaCha20Poly1305_verify_obj, mod_trezorcrypto_ChaCha20Poly1305_verify);
+
+/// def seal(self, nonce: bytes, aad: bytes, data: bytes) -> bytes:
+///     '''
+///     Encrypt and authenticate a whole message with this key and the given
+///     12 or 24 byte nonce. Returns the ciphertext followed by the 16 byte tag.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_seal(size_t n_args, const mp_obj_t *args) {
+    mp_obj_ChaCha20Poly1305_t *o = MP_OBJ_TO_PTR(args[0]);
+    mp_buffer_info_t aad, in;
+    mp_get_buffer_raise(args[2], &aad, MP_BUFFER_READ);
+    mp_get_buffer_raise(args[3], &in, MP_BUFFER_READ);
+    chacha_poly_ctx ctx;
+    mod_trezorcrypto_ChaCha20Poly1305_start(&ctx, o->key, args[1]);
+    vstr_t vstr;
+    vstr_init_len(&vstr, in.len + 16);
+    uint8_t *out = (uint8_t *)vstr.buf;
+    chacha_poly_seal(&ctx, aad.buf, aad.len, in.buf, out, in.len, out + in.len);
+    memset(&ctx, 0, sizeof(ctx));
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_ChaCha20Poly1305_seal_obj, 4, 4, mod_trezorcrypto_ChaCha20Poly1305_seal);
+
+/// def open(self, nonce: bytes, aad: bytes, data: bytes) -> bytes:
+///     '''
+///     Check and decrypt what seal() made: ciphertext followed by the tag.
+///     Raises ValueError, and decrypts nothing, if the tag is wrong.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_open(size_t n_args, const mp_obj_t *args) {
+    mp_obj_ChaCha20Poly1305_t *o = MP_OBJ_TO_PTR(args[0]);
+    mp_buffer_info_t aad, in;
+    mp_get_buffer_raise(args[2], &aad, MP_BUFFER_READ);
+    mp_get_buffer_raise(args[3], &in, MP_BUFFER_READ);
+    if (in.len < 16) {
+        mp_raise_ValueError("Invalid length of data");
+    }
+    size_t len = in.len - 16;
+    const uint8_t *tag = (const uint8_t *)in.buf + len;
+    chacha_poly_ctx ctx;
+    mod_trezorcrypto_ChaCha20Poly1305_start(&ctx, o->key, args[1]);
+    vstr_t vstr;
+    vstr_init_len(&vstr, len);
+    bool ok = chacha_poly_open(&ctx, aad.buf, aad.len, in.buf, (uint8_t *)vstr.buf, len, tag);
+    memset(&ctx, 0, sizeof(ctx));
+    if (!ok) {
+        vstr_clear(&vstr);
+        mp_raise_ValueError("Invalid tag");
+    }
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_ChaCha20Poly1305_open_obj, 4, 4, mod_trezorcrypto_ChaCha20Poly1305_open);
+
+// stream_encrypt() and stream_decrypt(): each segment is sealed or opened on
+// its own, so they are handed out to modtcc_run_workers(); the workers see
+// only plain buffers.
+typedef struct {
+    const uint8_t *key;
+    const uint8_t *prefix;
+    const uint8_t *in;
+    uint8_t *out;
+    size_t len;         // plaintext, all segments
+    size_t seg;         // plaintext of a full segment
+    uint32_t start;     // index of the first segment
+    size_t count;
+    bool final;         // the last segment ends the stream
+    bool decrypt;
+    size_t next;        // these two are shared between threads
+    int bad;
+} chacha_stream_queue_t;
+
+STATIC void chacha_stream_run(void *arg) {
+    chacha_stream_queue_t *q = arg;
+    size_t i;
+    while ((i = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED)) < q->count) {
+        size_t pos = i * q->seg;
+        size_t len = (q->len - pos < q->seg) ? q->len - pos : q->seg;
+        bool last = q->final && i == q->count - 1;
+        if (q->decrypt) {
+            if (!chacha_stream_open(q->key, q->prefix, q->start + i, last, q->in + pos + 16 * i, q->out + pos, len)) {
+                __atomic_store_n(&q->bad, 1, __ATOMIC_RELAXED);
+            }
+        } else {
+            chacha_stream_seal(q->key, q->prefix, q->start + i, last, q->in + pos, q->out + pos + 16 * i, len);
+        }
+    }
+}
+
+STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_stream(size_t n_args, const mp_obj_t *args, bool decrypt) {
+    mp_obj_ChaCha20Poly1305_t *o = MP_OBJ_TO_PTR(args[0]);
+    mp_buffer_info_t prefix, in;
+    mp_get_buffer_raise(args[1], &prefix, MP_BUFFER_READ);
+    mp_get_buffer_raise(args[2], &in, MP_BUFFER_READ);
+    mp_int_t seg = mp_obj_get_int(args[3]);
+    mp_int_t start = (n_args > 4) ? mp_obj_get_int(args[4]) : 0;
+    bool final = (n_args > 5) ? mp_obj_is_true(args[5]) : true;
+    mp_int_t threads = (n_args > 6) ? mp_obj_get_int(args[6]) : 0;
+    if (prefix.len != CHACHA_STREAM_PREFIX) {
+        mp_raise_ValueError("Invalid length of prefix");
+    }
+    if (seg <= 0) {
+        mp_raise_ValueError("Invalid segment size");
+    }
+
+    // only the last segment of the stream may be short (or empty)
+    chacha_stream_queue_t q;
+    memset(&q, 0, sizeof(q));
+    size_t step = decrypt ? (size_t)seg + 16 : (size_t)seg;
+    if (!final) {
+        if (in.len % step) {
+            mp_raise_ValueError("Invalid length of data");
+        }
+        q.count = in.len / step;
+    } else if (decrypt) {
+        if (in.len < 16 || (in.len % step && in.len % step < 16)) {
+            mp_raise_ValueError("Invalid length of data");
+        }
+        q.count = (in.len - 16) / step + 1;
+    } else {
+        q.count = in.len ? (in.len + seg - 1) / seg : 1;
+    }
+    q.len = decrypt ? in.len - 16 * q.count : in.len;
+    if (start < 0 || (uint64_t)start + q.count > (uint64_t)UINT32_MAX + 1) {
+        mp_raise_ValueError("Invalid segment index");
+    }
+
+    vstr_t vstr;
+    vstr_init_len(&vstr, decrypt ? q.len : q.len + 16 * q.count);
+    q.key = o->key;
+    q.prefix = prefix.buf;
+    q.in = in.buf;
+    q.out = (uint8_t *)vstr.buf;
+    q.seg = seg;
+    q.start = start;
+    q.final = final;
+    q.decrypt = decrypt;
+
+    modtcc_run_workers(chacha_stream_run, &q, threads, q.count, NULL);
+
+    if (q.bad) {
+        memset(vstr.buf, 0, vstr.len);
+        vstr_clear(&vstr);
+        mp_raise_ValueError("Invalid tag");
+    }
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+
+/// def stream_encrypt(self, prefix: bytes, data: bytes, segment_size: int, start: int = 0, final: bool = True, threads: int = 0) -> bytes:
+///     '''
+///     Encrypt data as segments of a STREAM under this key and a 19 byte
+///     nonce prefix, numbered from start, each segment_size bytes of
+///     plaintext followed by a 16 byte tag. Unless final is false, the last
+///     segment (which may be short) ends the stream; otherwise data must be
+///     whole segments, and more may follow in another call. Segments are
+///     done in parallel, using all CPUs or the given number of threads on
+///     unix hosts. Never reuse a prefix for a second stream under the same
+///     key; a fresh random prefix per stream is the intended use. Segment
+///     nonces are XChaCha nonces, so seal() with 24 byte nonces must not
+///     share the key with streams either.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_stream_encrypt(size_t n_args, const mp_obj_t *args) {
+    return mod_trezorcrypto_ChaCha20Poly1305_stream(n_args, args, false);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_ChaCha20Poly1305_stream_encrypt_obj, 4, 7, mod_trezorcrypto_ChaCha20Poly1305_stream_encrypt);
+
+/// def stream_decrypt(self, prefix: bytes, data: bytes, segment_size: int, start: int = 0, final: bool = True, threads: int = 0) -> bytes:
+///     '''
+///     Check and decrypt segments made by stream_encrypt(), with the same
+///     prefix, segment_size, and start and final saying where they are in
+///     the stream; any segment can be read on its own this way. Raises
+///     ValueError, and returns nothing, if any tag is wrong, so a stream
+///     that was cut short, reordered or spliced is rejected.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305_stream_decrypt(size_t n_args, const mp_obj_t *args) {
+    return mod_trezorcrypto_ChaCha20Poly1305_stream(n_args, args, true);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_ChaCha20Poly1305_stream_decrypt_obj, 4, 7, mod_trezorcrypto_ChaCha20Poly1305_stream_decrypt);
+
 STATIC mp_obj_t mod_trezorcrypto_ChaCha20Poly1305___del__(mp_obj_t self) {
     mp_obj_ChaCha20Poly1305_t *o = MP_OBJ_TO_PTR(self);
-    memset(&(o->ctx), 0, sizeof(chacha20poly1305_ctx));
-    o->alen = 0;
-    o->plen = 0;
+    memset(&(o->ctx), 0, sizeof(chacha_poly_ctx));
+    memset(o->key, 0, sizeof(o->key));
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_ChaCha20Poly1305___del___obj, mod_trezorcrypto_ChaCha20Poly1305___del__);
 
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_ChaCha20Poly1305_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_encrypt), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305_encrypt_obj) },
+    { MP_ROM_QSTR(MP_QSTR_encrypt_into), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305_encrypt_into_obj) },
     { MP_ROM_QSTR(MP_QSTR_decrypt), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305_decrypt_obj) },
+    { MP_ROM_QSTR(MP_QSTR_decrypt_into), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305_decrypt_into_obj) },
     { MP_ROM_QSTR(MP_QSTR_auth), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305_auth_obj) },
     { MP_ROM_QSTR(MP_QSTR_finish), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305_finish_obj) },
+    { MP_ROM_QSTR(MP_QSTR_verify), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305_verify_obj) },
+    { MP_ROM_QSTR(MP_QSTR_seal), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305_seal_obj) },
+    { MP_ROM_QSTR(MP_QSTR_open), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305_open_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stream_encrypt), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305_stream_encrypt_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stream_decrypt), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305_stream_decrypt_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mod_trezorcrypto_ChaCha20Poly1305___del___obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(mod_trezorcrypto_ChaCha20Poly1305_locals_dict, mod_trezorcrypto_ChaCha20Poly1305_locals_dict_table);
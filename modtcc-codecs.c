@@ -14,7 +14,8 @@
 #include "hasher.h"
 #include "base58.h"
 #include "base32.h"
-#include "segwit_addr.h"
+#include "b58_fast.h"
+#include "bech32_fast.h"
 
 /*
 int base58_encode_check(const uint8_t *data, int len, HasherType hasher_type, char *str, int strsize);
@@ -28,47 +29,145 @@ uint8_t *base32_decode(const char *in, size_t inlen, uint8_t *out, size_t outlen
 // Base 58
 //
 
-STATIC mp_obj_t modtcc_b58_encode(mp_obj_t data)
+// scratch for b58_fast.c, on the stack for the usual sizes (~230 bytes)
+#define B58_STACK_LIMBS 64
+
+STATIC mp_obj_t modtcc_b58_encode_buf(const uint8_t *data, size_t len, bool check)
 {
-    mp_buffer_info_t buf;
-    mp_get_buffer_raise(data, &buf, MP_BUFFER_READ);
-    if (buf.len == 0) {
-        // there is an encoding for empty string (4 bytes of fixed checksum) but not useful
-        mp_raise_ValueError(NULL);
-    }
+    size_t nlimbs = B58_ENCODE_LIMBS(len + B58_CHECK_LEN);
+    uint32_t stack_limbs[B58_STACK_LIMBS];
+    uint32_t *limbs = (nlimbs <= B58_STACK_LIMBS) ? stack_limbs : m_new(uint32_t, nlimbs);
 
     vstr_t vstr;
-    vstr_init_len(&vstr, (buf.len*2)+10);
+    vstr_init_len(&vstr, B58_ENCODED_MAX(len + B58_CHECK_LEN));
 
-    int rl = base58_encode_check(buf.buf, buf.len, HASHER_SHA2, vstr.buf, vstr.len);
+    int rl = check ? b58_encode_check(data, len, vstr.buf, vstr.len, limbs)
+                   : b58_encode(data, len, vstr.buf, vstr.len, limbs);
+    if (limbs != stack_limbs) {
+        m_del(uint32_t, limbs, nlimbs);
+    }
 
-    if(rl < 1) {
+    if(rl < 0) {
         // unlikely
         mp_raise_ValueError(NULL);
     }
 
-    vstr.len = rl-1;        // strip NUL
-    
+    vstr.len = rl;
     return mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(modtcc_b58_encode_obj, modtcc_b58_encode);
 
-STATIC mp_obj_t modtcc_b58_decode(mp_obj_t enc)
+// decode into out, returning its length
+STATIC size_t modtcc_b58_decode_buf(mp_obj_t enc, uint8_t *out, size_t outsize, bool check)
 {
-    const char *s = mp_obj_str_get_str(enc);
+    size_t slen;
+    const char *s = mp_obj_str_get_data(enc, &slen);
 
-    uint8_t tmp[128];
+    size_t nlimbs = B58_DECODE_LIMBS(slen);
+    uint32_t stack_limbs[B58_STACK_LIMBS];
+    uint32_t *limbs = (nlimbs <= B58_STACK_LIMBS) ? stack_limbs : m_new(uint32_t, nlimbs);
 
-    int rl = base58_decode_check(s, HASHER_SHA2, tmp, sizeof(tmp));
+    int rl = check ? b58_decode_check(s, slen, out, outsize, limbs)
+                   : b58_decode(s, slen, out, outsize, limbs);
+    if (limbs != stack_limbs) {
+        m_del(uint32_t, limbs, nlimbs);
+    }
 
-    if(rl <= 0) {
+    if(rl == -2) {
+        mp_raise_ValueError("Output buffer too small");
+    }
+    if(rl < 0) {
         // transcription error from user is very likely
         mp_raise_ValueError("corrupt base58");
     }
-    
-    return mp_obj_new_bytes(tmp, rl);
+    return rl;
+}
+
+STATIC mp_obj_t modtcc_b58_decode_bytes(mp_obj_t enc, bool check)
+{
+    size_t slen;
+    mp_obj_str_get_data(enc, &slen);
+
+    vstr_t vstr;
+    vstr_init_len(&vstr, B58_DECODED_MAX(slen));
+    vstr.len = modtcc_b58_decode_buf(enc, (uint8_t *)vstr.buf, vstr.len, check);
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+
+// base58check (double SHA-256) encoding, or plain base58 if check is False
+STATIC mp_obj_t modtcc_b58_encode(size_t n_args, const mp_obj_t *args)
+{
+    bool check = (n_args < 2) || mp_obj_is_true(args[1]);
+    mp_buffer_info_t buf;
+    mp_get_buffer_raise(args[0], &buf, MP_BUFFER_READ);
+    if (check && buf.len == 0) {
+        // there is an encoding for empty string (4 bytes of fixed checksum) but not useful
+        mp_raise_ValueError(NULL);
+    }
+
+    return modtcc_b58_encode_buf(buf.buf, buf.len, check);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(modtcc_b58_encode_obj, 1, 2, modtcc_b58_encode);
+
+// base58 decoding, verifying and removing the checksum if check
+STATIC mp_obj_t modtcc_b58_decode(size_t n_args, const mp_obj_t *args)
+{
+    bool check = (n_args < 2) || mp_obj_is_true(args[1]);
+    return modtcc_b58_decode_bytes(args[0], check);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(modtcc_b58_decode_obj, 1, 2, modtcc_b58_decode);
+
+// as b58_decode(), into a buffer (with room for the checksum too); returns the length
+STATIC mp_obj_t modtcc_b58_decode_into(size_t n_args, const mp_obj_t *args)
+{
+    bool check = (n_args < 3) || mp_obj_is_true(args[2]);
+    mp_buffer_info_t buf;
+    mp_get_buffer_raise(args[1], &buf, MP_BUFFER_WRITE);
+    return MP_OBJ_NEW_SMALL_INT(modtcc_b58_decode_buf(args[0], buf.buf, buf.len, check));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(modtcc_b58_decode_into_obj, 2, 3, modtcc_b58_decode_into);
+
+// b58_encode() of each item in a list
+STATIC mp_obj_t modtcc_b58_encode_many(size_t n_args, const mp_obj_t *args)
+{
+    bool check = (n_args < 2) || mp_obj_is_true(args[1]);
+    size_t count;
+    mp_obj_t *items;
+    mp_obj_get_array(args[0], &count, &items);
+
+    mp_obj_t result = mp_obj_new_list(count, NULL);
+    size_t rlen;
+    mp_obj_t *ritems;
+    mp_obj_list_get(result, &rlen, &ritems);
+    for (size_t i = 0; i < count; i++) {
+        mp_buffer_info_t buf;
+        mp_get_buffer_raise(items[i], &buf, MP_BUFFER_READ);
+        if (check && buf.len == 0) {
+            mp_raise_ValueError(NULL);
+        }
+        ritems[i] = modtcc_b58_encode_buf(buf.buf, buf.len, check);
+    }
+    return result;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_1(modtcc_b58_decode_obj, modtcc_b58_decode);
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(modtcc_b58_encode_many_obj, 1, 2, modtcc_b58_encode_many);
+
+// b58_decode() of each item in a list
+STATIC mp_obj_t modtcc_b58_decode_many(size_t n_args, const mp_obj_t *args)
+{
+    bool check = (n_args < 2) || mp_obj_is_true(args[1]);
+    size_t count;
+    mp_obj_t *items;
+    mp_obj_get_array(args[0], &count, &items);
+
+    mp_obj_t result = mp_obj_new_list(count, NULL);
+    size_t rlen;
+    mp_obj_t *ritems;
+    mp_obj_list_get(result, &rlen, &ritems);
+    for (size_t i = 0; i < count; i++) {
+        ritems[i] = modtcc_b58_decode_bytes(items[i], check);
+    }
+    return result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(modtcc_b58_decode_many_obj, 1, 2, modtcc_b58_decode_many);
 
 //
 // Base 32
@@ -118,150 +217,99 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(modtcc_b32_decode_obj, modtcc_b32_decode);
 //
 // 
 // Bech32 aka. Segwit addresses, but hopefylly not specific to segwit addresses only.
+// Version 0 uses the bech32 checksum, later versions bech32m (BIP350).
 //
 //
 
-// pack and unpack bits; probably 5 or 8...
-//
-    STATIC inline int
-sw_convert_bits(
-    uint8_t* out, size_t* outlen,
-    const int outbits,
-    const uint8_t* in, size_t inlen,
-    const int inbits, bool pad
-) {
-    uint32_t val = 0;
-    int bits = 0;
-    uint32_t maxv = (((uint32_t)1) << outbits) - 1;
-    while (inlen--) {
-        val = (val << inbits) | *(in++);
-        bits += inbits;
-        while (bits >= outbits) {
-            bits -= outbits;
-            out[(*outlen)++] = (val >> bits) & maxv;
-        }
+STATIC mp_obj_t modtcc_bech32_encode_buf(const char *hrp, size_t hrp_len, uint32_t segwit_version, const uint8_t *data, size_t len)
+{
+    char out[BECH32_MAX_LEN + 1];
+
+    if(segwit_version > 16) {
+        mp_raise_ValueError("sw version");
     }
-    if (pad) {
-        if (bits) {
-            out[(*outlen)++] = (val << (outbits - bits)) & maxv;
-        }
-    } else if (((val << (outbits - bits)) & maxv) || bits >= inbits) {
-        return 0;
+
+    // too long for BIP173, or a bad hrp
+    int rv = bech32_fast_segwit_encode(out, hrp, hrp_len, segwit_version, data, len);
+    if(rv < 0) {
+        mp_raise_ValueError("encode fail");
     }
-    return 1;
+
+    return mp_obj_new_str(out, rv);
 }
 
 STATIC mp_obj_t modtcc_bech32_encode(mp_obj_t hrp_obj, mp_obj_t segwit_version_obj, mp_obj_t data_obj)
 {
-    const char *hrp = mp_obj_str_get_str(hrp_obj);
+    size_t hrp_len;
+    const char *hrp = mp_obj_str_get_data(hrp_obj, &hrp_len);
     uint32_t segwit_version = mp_obj_int_get_checked(segwit_version_obj);
 
     mp_buffer_info_t buf;
     mp_get_buffer_raise(data_obj, &buf, MP_BUFFER_READ);
 
-    // low-level bech32 functions want 5-bit data unpacked into bytes. first value is
-    // the version number (5 bits), and remainder is packed data.
-
-    if(segwit_version > 16) {
-        mp_raise_ValueError("sw version");
-    }
-
-    uint8_t data[buf.len + 1];
-    size_t  data_len = 0;
-    data[0] = segwit_version;
-    int cv_ok = sw_convert_bits(data + 1, &data_len, 5, buf.buf, buf.len, 8, true);
-
-    if(cv_ok != 1) {
-        mp_raise_ValueError("pack fail");
-    }
-
-    // we already prefixed the version number
-    data_len += 1;
+    return modtcc_bech32_encode_buf(hrp, hrp_len, segwit_version, buf.buf, buf.len);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(modtcc_bech32_encode_obj, modtcc_bech32_encode);
 
-    vstr_t vstr;
-    vstr_init_len(&vstr, strlen(hrp) + data_len + 8);
-
-    /** Encode a Bech32 string
-     *
-     *  Out: output:  Pointer to a buffer of size strlen(hrp) + data_len + 8 that
-     *                will be updated to contain the null-terminated Bech32 string.
-     *  In: hrp :     Pointer to the null-terminated human readable part.
-     *      data :    Pointer to an array of 5-bit values.
-     *      data_len: Length of the data array.
-     *  Returns 1 if successful.
-
-        int bech32_encode(
-            char *output,
-            const char *hrp,
-            const uint8_t *data,
-            size_t data_len);
-     */
-    int rv = bech32_encode(vstr.buf, hrp, data, data_len);
-
-    if(rv != 1) {
-        mp_raise_ValueError("encode fail");
+// bech32_encode() of each program in a list, same hrp and version
+STATIC mp_obj_t modtcc_bech32_encode_many(mp_obj_t hrp_obj, mp_obj_t segwit_version_obj, mp_obj_t data_obj)
+{
+    size_t hrp_len;
+    const char *hrp = mp_obj_str_get_data(hrp_obj, &hrp_len);
+    uint32_t segwit_version = mp_obj_int_get_checked(segwit_version_obj);
+    size_t count;
+    mp_obj_t *items;
+    mp_obj_get_array(data_obj, &count, &items);
+
+    mp_obj_t result = mp_obj_new_list(count, NULL);
+    size_t rlen;
+    mp_obj_t *ritems;
+    mp_obj_list_get(result, &rlen, &ritems);
+    for (size_t i = 0; i < count; i++) {
+        mp_buffer_info_t buf;
+        mp_get_buffer_raise(items[i], &buf, MP_BUFFER_READ);
+        ritems[i] = modtcc_bech32_encode_buf(hrp, hrp_len, segwit_version, buf.buf, buf.len);
     }
-
-    vstr.len = strlen(vstr.buf);
-    
-    return mp_obj_new_str_from_vstr(&mp_type_str, &vstr);
+    return result;
 }
-STATIC MP_DEFINE_CONST_FUN_OBJ_3(modtcc_bech32_encode_obj, modtcc_bech32_encode);
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(modtcc_bech32_encode_many_obj, modtcc_bech32_encode_many);
 
 STATIC mp_obj_t modtcc_bech32_decode(mp_obj_t enc)
 {
-    const char *s = mp_obj_str_get_str(enc);
+    size_t len;
+    const char *s = mp_obj_str_get_data(enc, &len);
 
-/** Decode a Bech32 string
- *
- *  Out: hrp:      Pointer to a buffer of size strlen(input) - 6. Will be
- *                 updated to contain the null-terminated human readable part.
- *       data:     Pointer to a buffer of size strlen(input) - 8 that will
- *                 hold the encoded 5-bit data values.
- *       data_len: Pointer to a size_t that will be updated to be the number
- *                 of entries in data.
- *  In: input:     Pointer to a null-terminated Bech32 string.
- *  Returns 1 if succesful.
-int bech32_decode(
-    char *hrp,
-    uint8_t *data,
-    size_t *data_len,
-    const char *input
-);
- */
-
-    char  hrp[strlen(s) + 16];
-    uint8_t tmp[strlen(s) + 16];         // actually 8-bit
-    size_t  tmp_len = 0;
+    char hrp[BECH32_MAX_LEN + 1];
+    uint8_t packed[BECH32_MAX_LEN];
+    int version;
 
-    int rv = bech32_decode(hrp, tmp, &tmp_len, s);
+    int rv = bech32_fast_segwit_decode(s, len, hrp, &version, packed);
 
-    if(rv != 1) {
+    if(rv == -1) {
         // probably transcription error from user
         mp_raise_ValueError("corrupt bech32");
     }
 
-    if(tmp_len <= 1) {
+    if(rv == -2) {
         // lots of valid Bech32 strings, but invalid for segwit puposes
         // can end up here; but don't care.
         mp_raise_ValueError("no sw verion and/or data");
     }
 
-    // re-pack 5-bit data into 8-bit bytes (after version)
-    uint8_t packed[tmp_len];
-    size_t packed_len = 0;
-
-    int cv_ok = sw_convert_bits(packed, &packed_len, 8, tmp + 1, tmp_len - 1, 5, false);
+    if(rv == -4) {
+        // checksum is fine, but no such segwit program
+        mp_raise_ValueError("bad sw version or length");
+    }
 
-    if(cv_ok != 1) {
+    if(rv < 0) {
         mp_raise_ValueError("repack fail");
     }
 
     // return a tuple: (hrp, version, data)
     mp_obj_t tuple[3] = {
         mp_obj_new_str(hrp, strlen(hrp)),
-        MP_OBJ_NEW_SMALL_INT(tmp[0]),
-        mp_obj_new_bytes(packed, packed_len),
+        MP_OBJ_NEW_SMALL_INT(version),
+        mp_obj_new_bytes(packed, rv),
     };
 
     return mp_obj_new_tuple(3, tuple);
@@ -272,9 +320,13 @@ STATIC const mp_rom_map_elem_t modtcc_codecs_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_codecs) },
     { MP_ROM_QSTR(MP_QSTR_b58_encode), MP_ROM_PTR(&modtcc_b58_encode_obj) },
     { MP_ROM_QSTR(MP_QSTR_b58_decode), MP_ROM_PTR(&modtcc_b58_decode_obj) },
+    { MP_ROM_QSTR(MP_QSTR_b58_decode_into), MP_ROM_PTR(&modtcc_b58_decode_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_b58_encode_many), MP_ROM_PTR(&modtcc_b58_encode_many_obj) },
+    { MP_ROM_QSTR(MP_QSTR_b58_decode_many), MP_ROM_PTR(&modtcc_b58_decode_many_obj) },
     { MP_ROM_QSTR(MP_QSTR_b32_encode), MP_ROM_PTR(&modtcc_b32_encode_obj) },
     { MP_ROM_QSTR(MP_QSTR_b32_decode), MP_ROM_PTR(&modtcc_b32_decode_obj) },
     { MP_ROM_QSTR(MP_QSTR_bech32_encode), MP_ROM_PTR(&modtcc_bech32_encode_obj) },
+    { MP_ROM_QSTR(MP_QSTR_bech32_encode_many), MP_ROM_PTR(&modtcc_bech32_encode_many_obj) },
     { MP_ROM_QSTR(MP_QSTR_bech32_decode), MP_ROM_PTR(&modtcc_bech32_decode_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(modtcc_codecs_globals, modtcc_codecs_globals_table);
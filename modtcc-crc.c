@@ -17,9 +17,23 @@ mp_obj_t mod_trezorcrypto_crc_crc32(size_t n_args, const mp_obj_t *args) {
 }
 MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_crc_crc32_obj, 1, 2, mod_trezorcrypto_crc_crc32);
 
+/// def crc32_combine(crc_a: int, crc_b: int, len_b: int) -> int:
+///     '''
+///     Combine CRC32 values of two consecutive chunks into the CRC32 of both,
+///     without touching the data again. len_b is the length of the second chunk.
+///     '''
+mp_obj_t mod_trezorcrypto_crc_crc32_combine(mp_obj_t crc_a, mp_obj_t crc_b, mp_obj_t len_b) {
+    uint32_t a = mp_obj_get_int_truncated(crc_a);
+    uint32_t b = mp_obj_get_int_truncated(crc_b);
+    uint32_t len = mp_obj_get_int_truncated(len_b);
+    return mp_obj_new_int_from_uint(crc32_combine(a, b, len));
+}
+MP_DEFINE_CONST_FUN_OBJ_3(mod_trezorcrypto_crc_crc32_combine_obj, mod_trezorcrypto_crc_crc32_combine);
+
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_crc_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_crc) },
     { MP_ROM_QSTR(MP_QSTR_crc32), MP_ROM_PTR(&mod_trezorcrypto_crc_crc32_obj) },
+    { MP_ROM_QSTR(MP_QSTR_crc32_combine), MP_ROM_PTR(&mod_trezorcrypto_crc_crc32_combine_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(mod_trezorcrypto_crc_globals, mod_trezorcrypto_crc_globals_table);
 
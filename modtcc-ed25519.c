@@ -8,6 +8,7 @@
 #include "py/objstr.h"
 
 #include "ed25519-donna/ed25519.h"
+#include "ed25519_fast.h"
 
 #include "rand.h"
 
@@ -67,7 +68,8 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_ed25519_sign_obj, mod_trezorcr
 /// def verify(public_key: bytes, signature: bytes, message: bytes) -> bool:
 ///     '''
 ///     Uses public key to verify the signature of the message.
-///     Returns True on success.
+///     Returns True on success. The check is cofactored (8*s*B = 8*R +
+///     8*h*A) and strict about encodings, the same as verify_batch().
 ///     '''
 STATIC mp_obj_t mod_trezorcrypto_ed25519_verify(mp_obj_t public_key, mp_obj_t signature, mp_obj_t message) {
     mp_buffer_info_t pk, sig, msg;
@@ -83,10 +85,73 @@ STATIC mp_obj_t mod_trezorcrypto_ed25519_verify(mp_obj_t public_key, mp_obj_t si
     if (msg.len == 0) {
         mp_raise_ValueError("Empty data to verify");
     }
-    return (0 == ed25519_sign_open(msg.buf, msg.len, *(const ed25519_public_key *)pk.buf, *(const ed25519_signature *)sig.buf)) ? mp_const_true : mp_const_false;
+    return ed25519_fast_verify(msg.buf, msg.len, pk.buf, sig.buf) ? mp_const_true : mp_const_false;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(mod_trezorcrypto_ed25519_verify_obj, mod_trezorcrypto_ed25519_verify);
 
+/// def verify_batch(public_keys: List[bytes], signatures: List[bytes], messages: List[bytes]) -> List[bool]:
+///     '''
+///     Verify many signatures at once, each of messages[i] under
+///     public_keys[i]. Returns a list of what verify() would return for
+///     each. Valid signatures are checked together, in batches, for a
+///     fraction of the cost; a batch with a bad signature in it is checked
+///     one by one.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ed25519_verify_batch(mp_obj_t public_keys, mp_obj_t signatures, mp_obj_t messages) {
+    size_t n, nsig, nmsg;
+    mp_obj_t *pkitems, *sigitems, *msgitems;
+    mp_obj_get_array(public_keys, &n, &pkitems);
+    mp_obj_get_array(signatures, &nsig, &sigitems);
+    mp_obj_get_array(messages, &nmsg, &msgitems);
+    if (nsig != n || nmsg != n) {
+        mp_raise_ValueError("Lists must be the same length");
+    }
+    if (n == 0) {
+        return mp_obj_new_list(0, NULL);
+    }
+
+    const uint8_t **pk = m_new(const uint8_t *, 3 * n);
+    const uint8_t **sig = pk + n, **msg = pk + 2 * n;
+    size_t *mlen = m_new(size_t, n);
+    for (size_t i = 0; i < n; i++) {
+        mp_buffer_info_t buf;
+        mp_get_buffer_raise(pkitems[i], &buf, MP_BUFFER_READ);
+        if (buf.len != 32) {
+            mp_raise_ValueError("Invalid length of public key");
+        }
+        pk[i] = buf.buf;
+        mp_get_buffer_raise(sigitems[i], &buf, MP_BUFFER_READ);
+        if (buf.len != 64) {
+            mp_raise_ValueError("Invalid length of signature");
+        }
+        sig[i] = buf.buf;
+        mp_get_buffer_raise(msgitems[i], &buf, MP_BUFFER_READ);
+        if (buf.len == 0) {
+            mp_raise_ValueError("Empty data to verify");
+        }
+        msg[i] = buf.buf;
+        mlen[i] = buf.len;
+    }
+
+    bool *valid = m_new(bool, n);
+    ed25519_batch_scratch *scratch = m_new(ed25519_batch_scratch, 1);
+    ed25519_fast_verify_batch(scratch, msg, mlen, pk, sig, n, valid);
+    m_del(ed25519_batch_scratch, scratch, 1);
+
+    mp_obj_t result = mp_obj_new_list(n, NULL);
+    size_t rlen;
+    mp_obj_t *ritems;
+    mp_obj_list_get(result, &rlen, &ritems);
+    for (size_t i = 0; i < n; i++) {
+        ritems[i] = mp_obj_new_bool(valid[i]);
+    }
+    m_del(bool, valid, n);
+    m_del(size_t, mlen, n);
+    m_del(const uint8_t *, pk, 3 * n);
+    return result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(mod_trezorcrypto_ed25519_verify_batch_obj, mod_trezorcrypto_ed25519_verify_batch);
+
 /// def cosi_combine_publickeys(public_keys: List[bytes]) -> bytes:
 ///     '''
 ///     Combines a list of public keys used in COSI cosigning scheme.
@@ -175,12 +240,131 @@ STATIC mp_obj_t mod_trezorcrypto_ed25519_cosi_sign(size_t n_args, const mp_obj_t
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_ed25519_cosi_sign_obj, 5, 5, mod_trezorcrypto_ed25519_cosi_sign);
 
+/// class SigningKey:
+///     '''
+///     A secret key expanded once (SHA-512 of it, the clamped scalar and
+///     nonce prefix, and the public key), for signing many messages.
+///     '''
+typedef struct _mp_obj_Ed25519SigningKey_t {
+    mp_obj_base_t base;
+    bool wiped;
+    ed25519_fast_key key;
+} mp_obj_Ed25519SigningKey_t;
+
+STATIC mp_obj_Ed25519SigningKey_t *mod_trezorcrypto_ed25519_SigningKey_get(mp_obj_t self) {
+    mp_obj_Ed25519SigningKey_t *o = MP_OBJ_TO_PTR(self);
+    if (o->wiped) {
+        mp_raise_ValueError("Key was wiped");
+    }
+    return o;
+}
+
+/// def __init__(self, secret_key: bytes) -> None:
+///     '''
+///     Expand secret key.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ed25519_SigningKey_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 1, 1, false);
+    mp_buffer_info_t sk;
+    mp_get_buffer_raise(args[0], &sk, MP_BUFFER_READ);
+    if (sk.len != 32) {
+        mp_raise_ValueError("Invalid length of secret key");
+    }
+    // with a finaliser, or __del__ is never called
+    mp_obj_Ed25519SigningKey_t *o = m_new_obj_with_finaliser(mp_obj_Ed25519SigningKey_t);
+    o->base.type = type;
+    o->wiped = false;
+    ed25519_fast_key_init(&(o->key), sk.buf);
+    return MP_OBJ_FROM_PTR(o);
+}
+
+/// def public_key(self) -> bytes:
+///     '''
+///     Public key, as publickey() gives.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ed25519_SigningKey_public_key(mp_obj_t self) {
+    mp_obj_Ed25519SigningKey_t *o = mod_trezorcrypto_ed25519_SigningKey_get(self);
+    return mp_obj_new_bytes(o->key.public_key, 32);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_ed25519_SigningKey_public_key_obj, mod_trezorcrypto_ed25519_SigningKey_public_key);
+
+STATIC mp_obj_t mod_trezorcrypto_ed25519_SigningKey_sign_one(mp_obj_Ed25519SigningKey_t *o, mp_obj_t message) {
+    mp_buffer_info_t msg;
+    mp_get_buffer_raise(message, &msg, MP_BUFFER_READ);
+    if (msg.len == 0) {
+        mp_raise_ValueError("Empty data to sign");
+    }
+    uint8_t out[64];
+    ed25519_fast_sign(&(o->key), msg.buf, msg.len, out);
+    return mp_obj_new_bytes(out, sizeof(out));
+}
+
+/// def sign(self, message: bytes) -> bytes:
+///     '''
+///     Produce the signature of message, the same as sign() with the
+///     secret key would, for half the work.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ed25519_SigningKey_sign(mp_obj_t self, mp_obj_t message) {
+    return mod_trezorcrypto_ed25519_SigningKey_sign_one(mod_trezorcrypto_ed25519_SigningKey_get(self), message);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_ed25519_SigningKey_sign_obj, mod_trezorcrypto_ed25519_SigningKey_sign);
+
+/// def sign_many(self, messages: List[bytes]) -> List[bytes]:
+///     '''
+///     Produce the signatures of a list of messages.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ed25519_SigningKey_sign_many(mp_obj_t self, mp_obj_t messages) {
+    mp_obj_Ed25519SigningKey_t *o = mod_trezorcrypto_ed25519_SigningKey_get(self);
+    size_t count;
+    mp_obj_t *items;
+    mp_obj_get_array(messages, &count, &items);
+    mp_obj_t result = mp_obj_new_list(count, NULL);
+    size_t rlen;
+    mp_obj_t *ritems;
+    mp_obj_list_get(result, &rlen, &ritems);
+    for (size_t i = 0; i < count; i++) {
+        ritems[i] = mod_trezorcrypto_ed25519_SigningKey_sign_one(o, items[i]);
+    }
+    return result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_ed25519_SigningKey_sign_many_obj, mod_trezorcrypto_ed25519_SigningKey_sign_many);
+
+/// def wipe(self) -> None:
+///     '''
+///     Erase the expanded key now; the object can't be used after.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_ed25519_SigningKey_wipe(mp_obj_t self) {
+    mp_obj_Ed25519SigningKey_t *o = MP_OBJ_TO_PTR(self);
+    memset(&(o->key), 0, sizeof(ed25519_fast_key));
+    o->wiped = true;
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_ed25519_SigningKey_wipe_obj, mod_trezorcrypto_ed25519_SigningKey_wipe);
+
+STATIC const mp_rom_map_elem_t mod_trezorcrypto_ed25519_SigningKey_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_public_key), MP_ROM_PTR(&mod_trezorcrypto_ed25519_SigningKey_public_key_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sign), MP_ROM_PTR(&mod_trezorcrypto_ed25519_SigningKey_sign_obj) },
+    { MP_ROM_QSTR(MP_QSTR_sign_many), MP_ROM_PTR(&mod_trezorcrypto_ed25519_SigningKey_sign_many_obj) },
+    { MP_ROM_QSTR(MP_QSTR_wipe), MP_ROM_PTR(&mod_trezorcrypto_ed25519_SigningKey_wipe_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mod_trezorcrypto_ed25519_SigningKey_wipe_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(mod_trezorcrypto_ed25519_SigningKey_locals_dict, mod_trezorcrypto_ed25519_SigningKey_locals_dict_table);
+
+STATIC const mp_obj_type_t mod_trezorcrypto_ed25519_SigningKey_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_SigningKey,
+    .make_new = mod_trezorcrypto_ed25519_SigningKey_make_new,
+    .locals_dict = (void*)&mod_trezorcrypto_ed25519_SigningKey_locals_dict,
+};
+
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_ed25519_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_ed25519) },
     { MP_ROM_QSTR(MP_QSTR_generate_secret), MP_ROM_PTR(&mod_trezorcrypto_ed25519_generate_secret_obj) },
     { MP_ROM_QSTR(MP_QSTR_publickey), MP_ROM_PTR(&mod_trezorcrypto_ed25519_publickey_obj) },
     { MP_ROM_QSTR(MP_QSTR_sign), MP_ROM_PTR(&mod_trezorcrypto_ed25519_sign_obj) },
     { MP_ROM_QSTR(MP_QSTR_verify), MP_ROM_PTR(&mod_trezorcrypto_ed25519_verify_obj) },
+    { MP_ROM_QSTR(MP_QSTR_verify_batch), MP_ROM_PTR(&mod_trezorcrypto_ed25519_verify_batch_obj) },
+    { MP_ROM_QSTR(MP_QSTR_SigningKey), MP_ROM_PTR(&mod_trezorcrypto_ed25519_SigningKey_type) },
     { MP_ROM_QSTR(MP_QSTR_cosi_combine_publickeys), MP_ROM_PTR(&mod_trezorcrypto_ed25519_cosi_combine_publickeys_obj) },
     { MP_ROM_QSTR(MP_QSTR_cosi_combine_signatures), MP_ROM_PTR(&mod_trezorcrypto_ed25519_cosi_combine_signatures_obj) },
     { MP_ROM_QSTR(MP_QSTR_cosi_sign), MP_ROM_PTR(&mod_trezorcrypto_ed25519_cosi_sign_obj) },
@@ -11,6 +11,10 @@
 #include "rand.h"
 #include "nist256p1.h"
 
+#include "ecmult_gen.h"
+
+ECMULT_GEN_TABLE(nist256p1_gen, nist256p1);
+
 /// def generate_secret() -> bytes:
 ///     '''
 ///     Generate secret key.
@@ -41,11 +45,11 @@ STATIC mp_obj_t mod_trezorcrypto_nist256p1_publickey(size_t n_args, const mp_obj
     bool compressed = n_args < 2 || args[1] == mp_const_true;
     if (compressed) {
         uint8_t out[33];
-        ecdsa_get_public_key33(&nist256p1, (const uint8_t *)sk.buf, out);
+        ecmult_gen_get_public_key33(&nist256p1_gen, (const uint8_t *)sk.buf, out);
         return mp_obj_new_bytes(out, sizeof(out));
     } else {
         uint8_t out[65];
-        ecdsa_get_public_key65(&nist256p1, (const uint8_t *)sk.buf, out);
+        ecmult_gen_get_public_key65(&nist256p1_gen, (const uint8_t *)sk.buf, out);
         return mp_obj_new_bytes(out, sizeof(out));
     }
 }
@@ -67,7 +71,7 @@ STATIC mp_obj_t mod_trezorcrypto_nist256p1_sign(size_t n_args, const mp_obj_t *a
         mp_raise_ValueError("Invalid length of digest");
     }
     uint8_t out[65], pby;
-    if (0 != ecdsa_sign_digest(&nist256p1, (const uint8_t *)sk.buf, (const uint8_t *)dig.buf, out + 1, &pby, NULL)) {
+    if (0 != ecmult_gen_sign_digest(&nist256p1_gen, (const uint8_t *)sk.buf, (const uint8_t *)dig.buf, out + 1, &pby, NULL)) {
         mp_raise_ValueError("Signing failed");
     }
     out[0] = 27 + pby + compressed * 4;
@@ -156,6 +160,20 @@ STATIC mp_obj_t mod_trezorcrypto_nist256p1_multiply(mp_obj_t secret_key, mp_obj_
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_nist256p1_multiply_obj, mod_trezorcrypto_nist256p1_multiply);
 
+/// def precompute(level: int) -> None:
+///     '''
+///     Select the size of the table used to speed up publickey() and sign():
+///     0 (none) to 3 (largest). The table is built now, which is slow, instead
+///     of on first use. The largest level allowed is set at build time.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_nist256p1_precompute(mp_obj_t level) {
+    if (!ecmult_gen_build(&nist256p1_gen, mp_obj_get_int(level))) {
+        mp_raise_ValueError("Level not supported by this build");
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_nist256p1_precompute_obj, mod_trezorcrypto_nist256p1_precompute);
+
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_nist256p1_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_nist256p1) },
     { MP_ROM_QSTR(MP_QSTR_generate_secret), MP_ROM_PTR(&mod_trezorcrypto_nist256p1_generate_secret_obj) },
@@ -164,6 +182,7 @@ STATIC const mp_rom_map_elem_t mod_trezorcrypto_nist256p1_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_verify), MP_ROM_PTR(&mod_trezorcrypto_nist256p1_verify_obj) },
     { MP_ROM_QSTR(MP_QSTR_verify_recover), MP_ROM_PTR(&mod_trezorcrypto_nist256p1_verify_recover_obj) },
     { MP_ROM_QSTR(MP_QSTR_multiply), MP_ROM_PTR(&mod_trezorcrypto_nist256p1_multiply_obj) },
+    { MP_ROM_QSTR(MP_QSTR_precompute), MP_ROM_PTR(&mod_trezorcrypto_nist256p1_precompute_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(mod_trezorcrypto_nist256p1_globals, mod_trezorcrypto_nist256p1_globals_table);
 
@@ -51,6 +51,14 @@ STATIC mp_obj_t mod_trezorcrypto_Ripemd160_update(mp_obj_t self, mp_obj_t data)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Ripemd160_update_obj, mod_trezorcrypto_Ripemd160_update);
 
+// Finishes a copy of the context, so it can take more data afterwards.
+STATIC void mod_trezorcrypto_Ripemd160_final(mp_obj_Ripemd160_t *o, uint8_t *out) {
+    RIPEMD160_CTX ctx;
+    memcpy(&ctx, &(o->ctx), sizeof(RIPEMD160_CTX));
+    ripemd160_Final(&ctx, out);
+    memset(&ctx, 0, sizeof(RIPEMD160_CTX));
+}
+
 /// def digest(self) -> bytes:
 ///     '''
 ///     Returns the digest of hashed data.
@@ -58,14 +66,33 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Ripemd160_update_obj, mod_trez
 STATIC mp_obj_t mod_trezorcrypto_Ripemd160_digest(mp_obj_t self) {
     mp_obj_Ripemd160_t *o = MP_OBJ_TO_PTR(self);
     uint8_t out[RIPEMD160_DIGEST_LENGTH];
-    RIPEMD160_CTX ctx;
-    memcpy(&ctx, &(o->ctx), sizeof(RIPEMD160_CTX));
-    ripemd160_Final(&ctx, out);
-    memset(&ctx, 0, sizeof(RIPEMD160_CTX));
+    mod_trezorcrypto_Ripemd160_final(o, out);
     return mp_obj_new_bytes(out, sizeof(out));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Ripemd160_digest_obj, mod_trezorcrypto_Ripemd160_digest);
 
+/// def digest_into(self, buf: bytearray, offset: int = 0) -> None:
+///     '''
+///     Writes the digest of hashed data into buf, starting at offset.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Ripemd160_digest_into(size_t n_args, const mp_obj_t *args) {
+    mp_obj_Ripemd160_t *o = MP_OBJ_TO_PTR(args[0]);
+    mod_trezorcrypto_Ripemd160_final(o, modtcc_get_digest_buffer(n_args - 1, args + 1, RIPEMD160_DIGEST_LENGTH));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_Ripemd160_digest_into_obj, 2, 3, mod_trezorcrypto_Ripemd160_digest_into);
+
+/// def reset(self) -> None:
+///     '''
+///     Starts over on a new message, as if the object was just created.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Ripemd160_reset(mp_obj_t self) {
+    mp_obj_Ripemd160_t *o = MP_OBJ_TO_PTR(self);
+    ripemd160_Init(&(o->ctx));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Ripemd160_reset_obj, mod_trezorcrypto_Ripemd160_reset);
+
 STATIC mp_obj_t mod_trezorcrypto_Ripemd160___del__(mp_obj_t self) {
     mp_obj_Ripemd160_t *o = MP_OBJ_TO_PTR(self);
     memset(&(o->ctx), 0, sizeof(RIPEMD160_CTX));
@@ -76,6 +103,8 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Ripemd160___del___obj, mod_tre
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_Ripemd160_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&mod_trezorcrypto_Ripemd160_update_obj) },
     { MP_ROM_QSTR(MP_QSTR_digest), MP_ROM_PTR(&mod_trezorcrypto_Ripemd160_digest_obj) },
+    { MP_ROM_QSTR(MP_QSTR_digest_into), MP_ROM_PTR(&mod_trezorcrypto_Ripemd160_digest_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&mod_trezorcrypto_Ripemd160_reset_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mod_trezorcrypto_Ripemd160___del___obj) },
     { MP_ROM_QSTR(MP_QSTR_block_size), MP_OBJ_NEW_SMALL_INT(RIPEMD160_BLOCK_LENGTH) },
     { MP_ROM_QSTR(MP_QSTR_digest_size), MP_OBJ_NEW_SMALL_INT(RIPEMD160_DIGEST_LENGTH) },
@@ -10,6 +10,10 @@
 #include "ecdsa.h"
 #include "secp256k1.h"
 
+#include "ecmult_gen.h"
+
+ECMULT_GEN_TABLE(secp256k1_gen, secp256k1);
+
 /// def generate_secret() -> bytes:
 ///     '''
 ///     Generate secret key.
@@ -40,11 +44,11 @@ STATIC mp_obj_t mod_trezorcrypto_secp256k1_publickey(size_t n_args, const mp_obj
     bool compressed = n_args < 2 || args[1] == mp_const_true;
     if (compressed) {
         uint8_t out[33];
-        ecdsa_get_public_key33(&secp256k1, (const uint8_t *)sk.buf, out);
+        ecmult_gen_get_public_key33(&secp256k1_gen, (const uint8_t *)sk.buf, out);
         return mp_obj_new_bytes(out, sizeof(out));
     } else {
         uint8_t out[65];
-        ecdsa_get_public_key65(&secp256k1, (const uint8_t *)sk.buf, out);
+        ecmult_gen_get_public_key65(&secp256k1_gen, (const uint8_t *)sk.buf, out);
         return mp_obj_new_bytes(out, sizeof(out));
     }
 }
@@ -66,7 +70,7 @@ STATIC mp_obj_t mod_trezorcrypto_secp256k1_sign(size_t n_args, const mp_obj_t *a
         mp_raise_ValueError("Invalid length of digest");
     }
     uint8_t out[65], pby;
-    if (0 != ecdsa_sign_digest(&secp256k1, (const uint8_t *)sk.buf, (const uint8_t *)dig.buf, out + 1, &pby, NULL)) {
+    if (0 != ecmult_gen_sign_digest(&secp256k1_gen, (const uint8_t *)sk.buf, (const uint8_t *)dig.buf, out + 1, &pby, NULL)) {
         mp_raise_ValueError("Signing failed");
     }
     out[0] = 27 + pby + compressed * 4;
@@ -98,6 +102,226 @@ STATIC mp_obj_t mod_trezorcrypto_secp256k1_verify(mp_obj_t public_key, mp_obj_t
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_3(mod_trezorcrypto_secp256k1_verify_obj, mod_trezorcrypto_secp256k1_verify);
 
+typedef struct {
+    const uint8_t *pk;
+    const uint8_t *sig;
+    const uint8_t *dig;
+    size_t pk_len;
+    bool ok;
+    bignum256 s;        // s, then s^-1 after the batched inversion, then r/s
+    bignum256 acc;      // running product s_0 * ... * s_i, then digest/s
+} secp256k1_batch_item_t;
+
+// items whose points are worked out together
+#define SECP256K1_BATCH_CHUNK 32
+
+typedef struct {
+    size_t idx[SECP256K1_BATCH_CHUNK];
+    ecmult_gen_jacobian jac[SECP256K1_BATCH_CHUNK * ECMULT_STRAUSS_Q_POINTS];
+    curve_point aff[SECP256K1_BATCH_CHUNK * ECMULT_STRAUSS_Q_POINTS];
+    bignum256 scratch[SECP256K1_BATCH_CHUNK * ECMULT_STRAUSS_Q_POINTS];
+} secp256k1_batch_scratch_t;
+
+// Verify items[0..count), as ecdsa_verify_digest() would. u1*G + u2*Q is one
+// Strauss/Shamir ladder per item, and the affine conversions are shared:
+// one inversion for the odd multiples of every Q in the chunk, and one for
+// all the results.
+STATIC void secp256k1_verify_batch_chunk(secp256k1_batch_item_t *items, size_t count, secp256k1_batch_scratch_t *sc) {
+    const ecdsa_curve *curve = &secp256k1;
+    const uint8_t *last_pk = NULL;
+    size_t last_pk_len = 0;
+    bool pub_ok = false;
+    curve_point pub;
+    bignum256 r;
+    size_t n = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        secp256k1_batch_item_t *it = &items[i];
+        if (!it->ok) continue;
+
+        if (last_pk == NULL || last_pk_len != it->pk_len || memcmp(last_pk, it->pk, it->pk_len) != 0) {
+            pub_ok = ecdsa_read_pubkey(curve, it->pk, &pub);
+            last_pk = it->pk;
+            last_pk_len = it->pk_len;
+        }
+        if (!pub_ok) {
+            it->ok = false;
+            continue;
+        }
+
+        // u1 = digest / s, u2 = r / s
+        bn_read_be(it->dig, &it->acc);
+        bn_multiply(&it->s, &it->acc, &curve->order);
+        bn_mod(&it->acc, &curve->order);
+        bn_read_be(it->sig, &r);
+        bn_multiply(&r, &it->s, &curve->order);
+        bn_mod(&it->s, &curve->order);
+        if (bn_is_zero(&it->acc)) {
+            // message hashes to zero; ecdsa_verify_digest() rejects it too
+            it->ok = false;
+            continue;
+        }
+
+        ecmult_gen_odd_multiples(curve, &pub, &sc->jac[n * ECMULT_STRAUSS_Q_POINTS], ECMULT_STRAUSS_Q_POINTS);
+        sc->idx[n++] = i;
+    }
+    if (n == 0) {
+        return;
+    }
+    ecmult_gen_batch_affine(curve, sc->jac, sc->aff, n * ECMULT_STRAUSS_Q_POINTS, sc->scratch);
+
+    for (size_t k = 0; k < n; k++) {
+        secp256k1_batch_item_t *it = &items[sc->idx[k]];
+        ecmult_gen_strauss(&secp256k1_gen, &it->acc, &it->s, &sc->aff[k * ECMULT_STRAUSS_Q_POINTS], &sc->jac[k]);
+    }
+    // the odd multiples are done with, so their room takes the results
+    ecmult_gen_batch_affine(curve, sc->jac, sc->aff, n, sc->scratch);
+
+    for (size_t k = 0; k < n; k++) {
+        secp256k1_batch_item_t *it = &items[sc->idx[k]];
+        if (point_is_infinity(&sc->aff[k])) {
+            it->ok = false;
+            continue;
+        }
+        bn_read_be(it->sig, &r);
+        bn_mod(&sc->aff[k].x, &curve->order);
+        it->ok = bn_is_equal(&sc->aff[k].x, &r);
+    }
+}
+
+// Verify all items: one modular inversion of the s values for the whole
+// batch (Montgomery's trick), then the points a chunk at a time.
+STATIC void secp256k1_verify_batch_items(secp256k1_batch_item_t *items, size_t count) {
+    const ecdsa_curve *curve = &secp256k1;
+    bignum256 r, z, inv;
+
+    bn_one(&inv);
+    for (size_t i = 0; i < count; i++) {
+        secp256k1_batch_item_t *it = &items[i];
+        bn_read_be(it->sig, &r);
+        bn_read_be(it->sig + 32, &it->s);
+        it->ok = !(bn_is_zero(&r) || bn_is_zero(&it->s)
+                    || !bn_is_less(&r, &curve->order) || !bn_is_less(&it->s, &curve->order));
+        if (!it->ok) {
+            // keep the product invertible
+            bn_one(&it->s);
+        }
+        bn_copy(&inv, &it->acc);
+        bn_multiply(&it->s, &it->acc, &curve->order);
+        bn_mod(&it->acc, &curve->order);
+        bn_copy(&it->acc, &inv);
+    }
+
+    // inv = 1 / (s_0 * ... * s_n-1), then peel off one s at a time
+    bn_inverse(&inv, &curve->order);
+    for (size_t i = count; i-- > 0; ) {
+        secp256k1_batch_item_t *it = &items[i];
+        if (i > 0) {
+            // s_i^-1 = inv * acc_i-1, and inv becomes 1 / acc_i-1
+            bn_copy(&items[i - 1].acc, &z);
+            bn_multiply(&inv, &z, &curve->order);
+            bn_mod(&z, &curve->order);
+            bn_multiply(&it->s, &inv, &curve->order);
+            bn_mod(&inv, &curve->order);
+            bn_copy(&z, &it->s);
+        } else {
+            bn_copy(&inv, &it->s);
+        }
+    }
+
+    secp256k1_batch_scratch_t *sc = m_new(secp256k1_batch_scratch_t, 1);
+    for (size_t i = 0; i < count; i += SECP256K1_BATCH_CHUNK) {
+        size_t n = count - i < SECP256K1_BATCH_CHUNK ? count - i : SECP256K1_BATCH_CHUNK;
+        secp256k1_verify_batch_chunk(items + i, n, sc);
+    }
+    m_del(secp256k1_batch_scratch_t, sc, 1);
+}
+
+/// def verify_batch(items: list, signatures: bytes = None, digests: bytes = None) -> List[bool]:
+///     '''
+///     Verify many signatures in one call. Pass either a list of
+///     (public_key, signature, digest) tuples, or three buffers holding
+///     concatenated fixed-size values: public keys (33 or 65 bytes each),
+///     signatures (64 or 65 bytes each) and digests (32 bytes each).
+///     Returns a list of booleans, one per signature.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_secp256k1_verify_batch(size_t n_args, const mp_obj_t *args) {
+    size_t count;
+    secp256k1_batch_item_t *items;
+
+    if (n_args == 1) {
+        mp_obj_t *objs;
+        mp_obj_get_array(args[0], &count, &objs);
+        items = m_new(secp256k1_batch_item_t, count);
+        for (size_t i = 0; i < count; i++) {
+            mp_obj_t *triple;
+            mp_buffer_info_t pk, sig, dig;
+            mp_obj_get_array_fixed_n(objs[i], 3, &triple);
+            mp_get_buffer_raise(triple[0], &pk, MP_BUFFER_READ);
+            mp_get_buffer_raise(triple[1], &sig, MP_BUFFER_READ);
+            mp_get_buffer_raise(triple[2], &dig, MP_BUFFER_READ);
+            if (pk.len != 33 && pk.len != 65) {
+                mp_raise_ValueError("Invalid length of public key");
+            }
+            if (sig.len != 64 && sig.len != 65) {
+                mp_raise_ValueError("Invalid length of signature");
+            }
+            if (dig.len != 32) {
+                mp_raise_ValueError("Invalid length of digest");
+            }
+            items[i].pk = pk.buf;
+            items[i].pk_len = pk.len;
+            items[i].sig = (const uint8_t *)sig.buf + (sig.len - 64);
+            items[i].dig = dig.buf;
+        }
+    } else if (n_args == 3) {
+        mp_buffer_info_t pks, sigs, digs;
+        mp_get_buffer_raise(args[0], &pks, MP_BUFFER_READ);
+        mp_get_buffer_raise(args[1], &sigs, MP_BUFFER_READ);
+        mp_get_buffer_raise(args[2], &digs, MP_BUFFER_READ);
+        if (digs.len % 32) {
+            mp_raise_ValueError("Invalid length of digest");
+        }
+        count = digs.len / 32;
+        if (count == 0) {
+            return mp_obj_new_list(0, NULL);
+        }
+        size_t pk_len = pks.len / count;
+        size_t sig_len = sigs.len / count;
+        if ((pk_len != 33 && pk_len != 65) || pks.len != pk_len * count) {
+            mp_raise_ValueError("Invalid length of public key");
+        }
+        if ((sig_len != 64 && sig_len != 65) || sigs.len != sig_len * count) {
+            mp_raise_ValueError("Invalid length of signature");
+        }
+        items = m_new(secp256k1_batch_item_t, count);
+        for (size_t i = 0; i < count; i++) {
+            items[i].pk = (const uint8_t *)pks.buf + (i * pk_len);
+            items[i].pk_len = pk_len;
+            items[i].sig = (const uint8_t *)sigs.buf + (i * sig_len) + (sig_len - 64);
+            items[i].dig = (const uint8_t *)digs.buf + (i * 32);
+        }
+    } else {
+        mp_raise_TypeError("Expected a list, or three buffers");
+    }
+
+    if (count) {
+        secp256k1_verify_batch_items(items, count);
+    }
+
+    mp_obj_t result = mp_obj_new_list(count, NULL);
+    size_t rlen;
+    mp_obj_t *ritems;
+    mp_obj_list_get(result, &rlen, &ritems);
+    for (size_t i = 0; i < count; i++) {
+        ritems[i] = mp_obj_new_bool(items[i].ok);
+    }
+    m_del(secp256k1_batch_item_t, items, count);
+
+    return result;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_secp256k1_verify_batch_obj, 1, 3, mod_trezorcrypto_secp256k1_verify_batch);
+
 /// def verify_recover(signature: bytes, digest: bytes) -> bytes:
 ///     '''
 ///     Uses signature of the digest to verify the digest and recover the public key.
@@ -155,14 +379,30 @@ STATIC mp_obj_t mod_trezorcrypto_secp256k1_multiply(mp_obj_t secret_key, mp_obj_
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_secp256k1_multiply_obj, mod_trezorcrypto_secp256k1_multiply);
 
+/// def precompute(level: int) -> None:
+///     '''
+///     Select the size of the table used to speed up publickey() and sign():
+///     0 (none) to 3 (largest). The table is built now, which is slow, instead
+///     of on first use. The largest level allowed is set at build time.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_secp256k1_precompute(mp_obj_t level) {
+    if (!ecmult_gen_build(&secp256k1_gen, mp_obj_get_int(level))) {
+        mp_raise_ValueError("Level not supported by this build");
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_secp256k1_precompute_obj, mod_trezorcrypto_secp256k1_precompute);
+
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_secp256k1_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_secp256k1) },
     { MP_ROM_QSTR(MP_QSTR_generate_secret), MP_ROM_PTR(&mod_trezorcrypto_secp256k1_generate_secret_obj) },
     { MP_ROM_QSTR(MP_QSTR_publickey), MP_ROM_PTR(&mod_trezorcrypto_secp256k1_publickey_obj) },
     { MP_ROM_QSTR(MP_QSTR_sign), MP_ROM_PTR(&mod_trezorcrypto_secp256k1_sign_obj) },
     { MP_ROM_QSTR(MP_QSTR_verify), MP_ROM_PTR(&mod_trezorcrypto_secp256k1_verify_obj) },
+    { MP_ROM_QSTR(MP_QSTR_verify_batch), MP_ROM_PTR(&mod_trezorcrypto_secp256k1_verify_batch_obj) },
     { MP_ROM_QSTR(MP_QSTR_verify_recover), MP_ROM_PTR(&mod_trezorcrypto_secp256k1_verify_recover_obj) },
     { MP_ROM_QSTR(MP_QSTR_multiply), MP_ROM_PTR(&mod_trezorcrypto_secp256k1_multiply_obj) },
+    { MP_ROM_QSTR(MP_QSTR_precompute), MP_ROM_PTR(&mod_trezorcrypto_secp256k1_precompute_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(mod_trezorcrypto_secp256k1_globals, mod_trezorcrypto_secp256k1_globals_table);
 
@@ -8,6 +8,7 @@
 #include "py/objstr.h"
 
 #include "sha2.h"
+#include "sha_hw.h"
 
 /// class Sha1:
 ///     '''
@@ -45,12 +46,20 @@ STATIC mp_obj_t mod_trezorcrypto_Sha1_update(mp_obj_t self, mp_obj_t data) {
     mp_buffer_info_t msg;
     mp_get_buffer_raise(data, &msg, MP_BUFFER_READ);
     if (msg.len > 0) {
-        sha1_Update(&(o->ctx), msg.buf, msg.len);
+        sha1_hw_update(&(o->ctx), msg.buf, msg.len);
     }
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Sha1_update_obj, mod_trezorcrypto_Sha1_update);
 
+// Finishes a copy of the context, so it can take more data afterwards.
+STATIC void mod_trezorcrypto_Sha1_final(mp_obj_Sha1_t *o, uint8_t *out) {
+    SHA1_CTX ctx;
+    memcpy(&ctx, &(o->ctx), sizeof(SHA1_CTX));
+    sha1_hw_final(&ctx, out);
+    memset(&ctx, 0, sizeof(SHA1_CTX));
+}
+
 /// def digest(self) -> bytes:
 ///     '''
 ///     Returns the digest of hashed data.
@@ -58,14 +67,33 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Sha1_update_obj, mod_trezorcry
 STATIC mp_obj_t mod_trezorcrypto_Sha1_digest(mp_obj_t self) {
     mp_obj_Sha1_t *o = MP_OBJ_TO_PTR(self);
     uint8_t out[SHA1_DIGEST_LENGTH];
-    SHA1_CTX ctx;
-    memcpy(&ctx, &(o->ctx), sizeof(SHA1_CTX));
-    sha1_Final(&ctx, out);
-    memset(&ctx, 0, sizeof(SHA1_CTX));
+    mod_trezorcrypto_Sha1_final(o, out);
     return mp_obj_new_bytes(out, sizeof(out));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha1_digest_obj, mod_trezorcrypto_Sha1_digest);
 
+/// def digest_into(self, buf: bytearray, offset: int = 0) -> None:
+///     '''
+///     Writes the digest of hashed data into buf, starting at offset.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha1_digest_into(size_t n_args, const mp_obj_t *args) {
+    mp_obj_Sha1_t *o = MP_OBJ_TO_PTR(args[0]);
+    mod_trezorcrypto_Sha1_final(o, modtcc_get_digest_buffer(n_args - 1, args + 1, SHA1_DIGEST_LENGTH));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_Sha1_digest_into_obj, 2, 3, mod_trezorcrypto_Sha1_digest_into);
+
+/// def reset(self) -> None:
+///     '''
+///     Starts over on a new message, as if the object was just created.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha1_reset(mp_obj_t self) {
+    mp_obj_Sha1_t *o = MP_OBJ_TO_PTR(self);
+    sha1_Init(&(o->ctx));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha1_reset_obj, mod_trezorcrypto_Sha1_reset);
+
 STATIC mp_obj_t mod_trezorcrypto_Sha1___del__(mp_obj_t self) {
     mp_obj_Sha1_t *o = MP_OBJ_TO_PTR(self);
     memset(&(o->ctx), 0, sizeof(SHA1_CTX));
@@ -76,6 +104,8 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha1___del___obj, mod_trezorcr
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_Sha1_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&mod_trezorcrypto_Sha1_update_obj) },
     { MP_ROM_QSTR(MP_QSTR_digest), MP_ROM_PTR(&mod_trezorcrypto_Sha1_digest_obj) },
+    { MP_ROM_QSTR(MP_QSTR_digest_into), MP_ROM_PTR(&mod_trezorcrypto_Sha1_digest_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&mod_trezorcrypto_Sha1_reset_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mod_trezorcrypto_Sha1___del___obj) },
     { MP_ROM_QSTR(MP_QSTR_block_size), MP_OBJ_NEW_SMALL_INT(SHA1_BLOCK_LENGTH) },
     { MP_ROM_QSTR(MP_QSTR_digest_size), MP_OBJ_NEW_SMALL_INT(SHA1_DIGEST_LENGTH) },
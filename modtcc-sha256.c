@@ -8,6 +8,7 @@
 #include "py/objstr.h"
 
 #include "sha2.h"
+#include "sha_hw.h"
 
 /// class Sha256:
 ///     '''
@@ -60,12 +61,20 @@ STATIC mp_obj_t mod_trezorcrypto_Sha256_update(mp_obj_t self, mp_obj_t data) {
     mp_buffer_info_t msg;
     mp_get_buffer_raise(data, &msg, MP_BUFFER_READ);
     if (msg.len > 0) {
-        sha256_Update(&(o->ctx), msg.buf, msg.len);
+        sha256_hw_update(&(o->ctx), msg.buf, msg.len);
     }
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Sha256_update_obj, mod_trezorcrypto_Sha256_update);
 
+// Finishes a copy of the context, so it can take more data afterwards.
+STATIC void mod_trezorcrypto_Sha256_final(mp_obj_Sha256_t *o, uint8_t *out) {
+    SHA256_CTX ctx;
+    memcpy(&ctx, &(o->ctx), sizeof(SHA256_CTX));
+    sha256_hw_final(&ctx, out);
+    memset(&ctx, 0, sizeof(SHA256_CTX));
+}
+
 /// def digest(self) -> bytes:
 ///     '''
 ///     Returns the digest of hashed data.
@@ -73,14 +82,33 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Sha256_update_obj, mod_trezorc
 STATIC mp_obj_t mod_trezorcrypto_Sha256_digest(mp_obj_t self) {
     mp_obj_Sha256_t *o = MP_OBJ_TO_PTR(self);
     uint8_t out[SHA256_DIGEST_LENGTH];
-    SHA256_CTX ctx;
-    memcpy(&ctx, &(o->ctx), sizeof(SHA256_CTX));
-    sha256_Final(&ctx, out);
-    memset(&ctx, 0, sizeof(SHA256_CTX));
+    mod_trezorcrypto_Sha256_final(o, out);
     return mp_obj_new_bytes(out, sizeof(out));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha256_digest_obj, mod_trezorcrypto_Sha256_digest);
 
+/// def digest_into(self, buf: bytearray, offset: int = 0) -> None:
+///     '''
+///     Writes the digest of hashed data into buf, starting at offset.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha256_digest_into(size_t n_args, const mp_obj_t *args) {
+    mp_obj_Sha256_t *o = MP_OBJ_TO_PTR(args[0]);
+    mod_trezorcrypto_Sha256_final(o, modtcc_get_digest_buffer(n_args - 1, args + 1, SHA256_DIGEST_LENGTH));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_Sha256_digest_into_obj, 2, 3, mod_trezorcrypto_Sha256_digest_into);
+
+/// def reset(self) -> None:
+///     '''
+///     Starts over on a new message, as if the object was just created.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha256_reset(mp_obj_t self) {
+    mp_obj_Sha256_t *o = MP_OBJ_TO_PTR(self);
+    sha256_Init(&(o->ctx));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha256_reset_obj, mod_trezorcrypto_Sha256_reset);
+
 STATIC mp_obj_t mod_trezorcrypto_Sha256___del__(mp_obj_t self) {
     mp_obj_Sha256_t *o = MP_OBJ_TO_PTR(self);
     memset(&(o->ctx), 0, sizeof(SHA256_CTX));
@@ -88,11 +116,39 @@ STATIC mp_obj_t mod_trezorcrypto_Sha256___del__(mp_obj_t self) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha256___del___obj, mod_trezorcrypto_Sha256___del__);
 
+STATIC void mod_trezorcrypto_Sha256_many(const uint8_t *const *msg, const size_t *len, size_t count, uint8_t *out) {
+    sha256_many(msg, len, count, false, out);
+}
+
+STATIC void mod_trezorcrypto_Sha256d_many(const uint8_t *const *msg, const size_t *len, size_t count, uint8_t *out) {
+    sha256_many(msg, len, count, true, out);
+}
+
+/// @staticmethod
+/// def hash_many(items: List[bytes], double: bool = False) -> bytes:
+///     '''
+///     Hashes each buffer in the list and returns all the digests joined
+///     together, 32 bytes each. With double, each is SHA256(SHA256(item)).
+///     Several items are hashed at once where the CPU allows.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha256_hash_many(size_t n_args, const mp_obj_t *args) {
+    bool twice = (n_args > 1) && mp_obj_is_true(args[1]);
+    return modtcc_hash_many(args[0], SHA256_DIGEST_LENGTH,
+                            twice ? mod_trezorcrypto_Sha256d_many : mod_trezorcrypto_Sha256_many);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_Sha256_hash_many_fun_obj, 1, 2, mod_trezorcrypto_Sha256_hash_many);
+STATIC const mp_rom_obj_static_class_method_t mod_trezorcrypto_Sha256_hash_many_obj = {
+    {&mp_type_staticmethod}, MP_ROM_PTR(&mod_trezorcrypto_Sha256_hash_many_fun_obj)
+};
+
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_Sha256_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&mod_trezorcrypto_Sha256_update_obj) },
     { MP_ROM_QSTR(MP_QSTR_copy), MP_ROM_PTR(&mod_trezorcrypto_Sha256_copy_obj) },
     { MP_ROM_QSTR(MP_QSTR_digest), MP_ROM_PTR(&mod_trezorcrypto_Sha256_digest_obj) },
+    { MP_ROM_QSTR(MP_QSTR_digest_into), MP_ROM_PTR(&mod_trezorcrypto_Sha256_digest_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&mod_trezorcrypto_Sha256_reset_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mod_trezorcrypto_Sha256___del___obj) },
+    { MP_ROM_QSTR(MP_QSTR_hash_many), MP_ROM_PTR(&mod_trezorcrypto_Sha256_hash_many_obj) },
     { MP_ROM_QSTR(MP_QSTR_block_size), MP_OBJ_NEW_SMALL_INT(SHA256_BLOCK_LENGTH) },
     { MP_ROM_QSTR(MP_QSTR_digest_size), MP_OBJ_NEW_SMALL_INT(SHA256_DIGEST_LENGTH) },
 };
@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ */
+
+#include "py/objstr.h"
+
+#include "sha2.h"
+#include "sha_hw.h"
+
+// SHA256 of a SHA256 context's digest; the context is used up
+STATIC void sha256d_final(SHA256_CTX *ctx, uint8_t out[SHA256_DIGEST_LENGTH]) {
+    uint8_t h[SHA256_DIGEST_LENGTH];
+    sha256_hw_final(ctx, h);
+    sha256_hw_raw(h, sizeof(h), out);
+    memset(h, 0, sizeof(h));
+}
+
+/// class Sha256d:
+///     '''
+///     Double SHA256 context: SHA256(SHA256(data)).
+///     '''
+typedef struct _mp_obj_Sha256d_t {
+    mp_obj_base_t base;
+    SHA256_CTX ctx;
+} mp_obj_Sha256d_t;
+
+STATIC mp_obj_t mod_trezorcrypto_Sha256d_update(mp_obj_t self, mp_obj_t data);
+
+/// def __init__(self, data: bytes = None) -> None:
+///     '''
+///     Creates a hash context object.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha256d_make_new(const mp_obj_type_t *type, size_t n_args, size_t n_kw, const mp_obj_t *args) {
+    mp_arg_check_num(n_args, n_kw, 0, 1, false);
+    mp_obj_Sha256d_t *o = m_new_obj(mp_obj_Sha256d_t);
+    o->base.type = type;
+    sha256_Init(&(o->ctx));
+    // constructor called with bytes/str as first parameter
+    if (n_args == 1) {
+        mod_trezorcrypto_Sha256d_update(MP_OBJ_FROM_PTR(o), args[0]);
+    }
+    return MP_OBJ_FROM_PTR(o);
+}
+
+/// def copy(self) -> Sha256d:
+///     '''
+///     Copy the hash context and make independant instance
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha256d_copy(mp_obj_t self) {
+    mp_obj_Sha256d_t *existing = MP_OBJ_TO_PTR(self);
+    mp_obj_Sha256d_t *copy = m_new_obj(mp_obj_Sha256d_t);
+
+    copy->base.type = existing->base.type;
+    copy->ctx = existing->ctx;
+
+    return MP_OBJ_FROM_PTR(copy);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha256d_copy_obj, mod_trezorcrypto_Sha256d_copy);
+
+/// def update(self, data: bytes) -> None:
+///     '''
+///     Update the hash context with hashed data.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha256d_update(mp_obj_t self, mp_obj_t data) {
+    mp_obj_Sha256d_t *o = MP_OBJ_TO_PTR(self);
+    mp_buffer_info_t msg;
+    mp_get_buffer_raise(data, &msg, MP_BUFFER_READ);
+    if (msg.len > 0) {
+        sha256_hw_update(&(o->ctx), msg.buf, msg.len);
+    }
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Sha256d_update_obj, mod_trezorcrypto_Sha256d_update);
+
+// Finishes a copy of the context, so it can take more data afterwards.
+STATIC void mod_trezorcrypto_Sha256d_final(mp_obj_Sha256d_t *o, uint8_t *out) {
+    SHA256_CTX ctx;
+    memcpy(&ctx, &(o->ctx), sizeof(SHA256_CTX));
+    sha256d_final(&ctx, out);
+    memset(&ctx, 0, sizeof(SHA256_CTX));
+}
+
+/// def digest(self) -> bytes:
+///     '''
+///     Returns the digest of hashed data.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha256d_digest(mp_obj_t self) {
+    mp_obj_Sha256d_t *o = MP_OBJ_TO_PTR(self);
+    uint8_t out[SHA256_DIGEST_LENGTH];
+    mod_trezorcrypto_Sha256d_final(o, out);
+    return mp_obj_new_bytes(out, sizeof(out));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha256d_digest_obj, mod_trezorcrypto_Sha256d_digest);
+
+/// def digest_into(self, buf: bytearray, offset: int = 0) -> None:
+///     '''
+///     Writes the digest of hashed data into buf, starting at offset.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha256d_digest_into(size_t n_args, const mp_obj_t *args) {
+    mp_obj_Sha256d_t *o = MP_OBJ_TO_PTR(args[0]);
+    mod_trezorcrypto_Sha256d_final(o, modtcc_get_digest_buffer(n_args - 1, args + 1, SHA256_DIGEST_LENGTH));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_Sha256d_digest_into_obj, 2, 3, mod_trezorcrypto_Sha256d_digest_into);
+
+/// def reset(self) -> None:
+///     '''
+///     Starts over on a new message, as if the object was just created.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha256d_reset(mp_obj_t self) {
+    mp_obj_Sha256d_t *o = MP_OBJ_TO_PTR(self);
+    sha256_Init(&(o->ctx));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha256d_reset_obj, mod_trezorcrypto_Sha256d_reset);
+
+STATIC mp_obj_t mod_trezorcrypto_Sha256d___del__(mp_obj_t self) {
+    mp_obj_Sha256d_t *o = MP_OBJ_TO_PTR(self);
+    memset(&(o->ctx), 0, sizeof(SHA256_CTX));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha256d___del___obj, mod_trezorcrypto_Sha256d___del__);
+
+/// @staticmethod
+/// def hash_many(items: List[bytes]) -> bytes:
+///     '''
+///     Same as sha256.hash_many(items, True).
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha256d_hash_many(mp_obj_t items) {
+    return modtcc_hash_many(items, SHA256_DIGEST_LENGTH, mod_trezorcrypto_Sha256d_many);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha256d_hash_many_fun_obj, mod_trezorcrypto_Sha256d_hash_many);
+STATIC const mp_rom_obj_static_class_method_t mod_trezorcrypto_Sha256d_hash_many_obj = {
+    {&mp_type_staticmethod}, MP_ROM_PTR(&mod_trezorcrypto_Sha256d_hash_many_fun_obj)
+};
+
+STATIC const mp_rom_map_elem_t mod_trezorcrypto_Sha256d_locals_dict_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&mod_trezorcrypto_Sha256d_update_obj) },
+    { MP_ROM_QSTR(MP_QSTR_copy), MP_ROM_PTR(&mod_trezorcrypto_Sha256d_copy_obj) },
+    { MP_ROM_QSTR(MP_QSTR_digest), MP_ROM_PTR(&mod_trezorcrypto_Sha256d_digest_obj) },
+    { MP_ROM_QSTR(MP_QSTR_digest_into), MP_ROM_PTR(&mod_trezorcrypto_Sha256d_digest_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&mod_trezorcrypto_Sha256d_reset_obj) },
+    { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mod_trezorcrypto_Sha256d___del___obj) },
+    { MP_ROM_QSTR(MP_QSTR_hash_many), MP_ROM_PTR(&mod_trezorcrypto_Sha256d_hash_many_obj) },
+    { MP_ROM_QSTR(MP_QSTR_block_size), MP_OBJ_NEW_SMALL_INT(SHA256_BLOCK_LENGTH) },
+    { MP_ROM_QSTR(MP_QSTR_digest_size), MP_OBJ_NEW_SMALL_INT(SHA256_DIGEST_LENGTH) },
+};
+STATIC MP_DEFINE_CONST_DICT(mod_trezorcrypto_Sha256d_locals_dict, mod_trezorcrypto_Sha256d_locals_dict_table);
+
+STATIC const mp_obj_type_t mod_trezorcrypto_Sha256d_type = {
+    { &mp_type_type },
+    .name = MP_QSTR_Sha256d,
+    .make_new = mod_trezorcrypto_Sha256d_make_new,
+    .locals_dict = (void*)&mod_trezorcrypto_Sha256d_locals_dict,
+};
+
+/// def sha256d(data: bytes, buf: bytearray = None, offset: int = 0) -> Optional[bytes]:
+///     '''
+///     Returns SHA256(SHA256(data)), or writes it into buf at offset
+///     and returns None.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_sha256d(size_t n_args, const mp_obj_t *args) {
+    mp_buffer_info_t msg;
+    mp_get_buffer_raise(args[0], &msg, MP_BUFFER_READ);
+    uint8_t out[SHA256_DIGEST_LENGTH];
+    uint8_t *dest = out;
+    if (n_args > 1 && args[1] != mp_const_none) {
+        dest = modtcc_get_digest_buffer(n_args - 1, args + 1, SHA256_DIGEST_LENGTH);
+    }
+    SHA256_CTX ctx;
+    sha256_Init(&ctx);
+    sha256_hw_update(&ctx, msg.buf, msg.len);
+    sha256d_final(&ctx, dest);
+    return (dest == out) ? mp_obj_new_bytes(out, sizeof(out)) : mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_sha256d_obj, 1, 3, mod_trezorcrypto_sha256d);
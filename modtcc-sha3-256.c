@@ -51,25 +51,53 @@ STATIC mp_obj_t mod_trezorcrypto_Sha3_256_update(mp_obj_t self, mp_obj_t data) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Sha3_256_update_obj, mod_trezorcrypto_Sha3_256_update);
 
-/// def digest(self, keccak: bool = False) -> bytes:
-///     '''
-///     Returns the digest of hashed data.
-///     '''
-STATIC mp_obj_t mod_trezorcrypto_Sha3_256_digest(size_t n_args, const mp_obj_t *args) {
-    mp_obj_Sha3_256_t *o = MP_OBJ_TO_PTR(args[0]);
-    uint8_t out[SHA3_256_DIGEST_LENGTH];
+// Finishes a copy of the context, so it can take more data afterwards.
+STATIC void mod_trezorcrypto_Sha3_256_final(mp_obj_Sha3_256_t *o, uint8_t *out, bool keccak) {
     SHA3_CTX ctx;
     memcpy(&ctx, &(o->ctx), sizeof(SHA3_CTX));
-    if (n_args >= 1 && args[1] == mp_const_true) {
+    if (keccak) {
         keccak_Final(&ctx, out);
     } else {
         sha3_Final(&ctx, out);
     }
     memset(&ctx, 0, sizeof(SHA3_CTX));
+}
+
+/// def digest(self, keccak: bool = False) -> bytes:
+///     '''
+///     Returns the digest of hashed data.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha3_256_digest(size_t n_args, const mp_obj_t *args) {
+    mp_obj_Sha3_256_t *o = MP_OBJ_TO_PTR(args[0]);
+    uint8_t out[SHA3_256_DIGEST_LENGTH];
+    mod_trezorcrypto_Sha3_256_final(o, out, n_args > 1 && args[1] == mp_const_true);
     return mp_obj_new_bytes(out, sizeof(out));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_Sha3_256_digest_obj, 1, 2, mod_trezorcrypto_Sha3_256_digest);
 
+/// def digest_into(self, buf: bytearray, offset: int = 0, keccak: bool = False) -> None:
+///     '''
+///     Writes the digest of hashed data into buf, starting at offset.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha3_256_digest_into(size_t n_args, const mp_obj_t *args) {
+    mp_obj_Sha3_256_t *o = MP_OBJ_TO_PTR(args[0]);
+    uint8_t *out = modtcc_get_digest_buffer(n_args - 1, args + 1, SHA3_256_DIGEST_LENGTH);
+    mod_trezorcrypto_Sha3_256_final(o, out, n_args > 3 && args[3] == mp_const_true);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_Sha3_256_digest_into_obj, 2, 4, mod_trezorcrypto_Sha3_256_digest_into);
+
+/// def reset(self) -> None:
+///     '''
+///     Starts over on a new message, as if the object was just created.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha3_256_reset(mp_obj_t self) {
+    mp_obj_Sha3_256_t *o = MP_OBJ_TO_PTR(self);
+    sha3_256_Init(&(o->ctx));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha3_256_reset_obj, mod_trezorcrypto_Sha3_256_reset);
+
 STATIC mp_obj_t mod_trezorcrypto_Sha3_256___del__(mp_obj_t self) {
     mp_obj_Sha3_256_t *o = MP_OBJ_TO_PTR(self);
     memset(&(o->ctx), 0, sizeof(SHA3_CTX));
@@ -80,6 +108,8 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha3_256___del___obj, mod_trez
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_Sha3_256_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&mod_trezorcrypto_Sha3_256_update_obj) },
     { MP_ROM_QSTR(MP_QSTR_digest), MP_ROM_PTR(&mod_trezorcrypto_Sha3_256_digest_obj) },
+    { MP_ROM_QSTR(MP_QSTR_digest_into), MP_ROM_PTR(&mod_trezorcrypto_Sha3_256_digest_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&mod_trezorcrypto_Sha3_256_reset_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mod_trezorcrypto_Sha3_256___del___obj) },
     { MP_ROM_QSTR(MP_QSTR_block_size), MP_OBJ_NEW_SMALL_INT(SHA3_256_BLOCK_LENGTH) },
     { MP_ROM_QSTR(MP_QSTR_digest_size), MP_OBJ_NEW_SMALL_INT(SHA3_256_DIGEST_LENGTH) },
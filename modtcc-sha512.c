@@ -50,6 +50,14 @@ STATIC mp_obj_t mod_trezorcrypto_Sha512_update(mp_obj_t self, mp_obj_t data) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Sha512_update_obj, mod_trezorcrypto_Sha512_update);
 
+// Finishes a copy of the context, so it can take more data afterwards.
+STATIC void mod_trezorcrypto_Sha512_final(mp_obj_Sha512_t *o, uint8_t *out) {
+    SHA512_CTX ctx;
+    memcpy(&ctx, &(o->ctx), sizeof(SHA512_CTX));
+    sha512_Final(&ctx, out);
+    memset(&ctx, 0, sizeof(SHA512_CTX));
+}
+
 /// def digest(self) -> bytes:
 ///     '''
 ///     Returns the digest of hashed data.
@@ -57,14 +65,33 @@ STATIC MP_DEFINE_CONST_FUN_OBJ_2(mod_trezorcrypto_Sha512_update_obj, mod_trezorc
 STATIC mp_obj_t mod_trezorcrypto_Sha512_digest(mp_obj_t self) {
     mp_obj_Sha512_t *o = MP_OBJ_TO_PTR(self);
     uint8_t out[SHA512_DIGEST_LENGTH];
-    SHA512_CTX ctx;
-    memcpy(&ctx, &(o->ctx), sizeof(SHA512_CTX));
-    sha512_Final(&ctx, out);
-    memset(&ctx, 0, sizeof(SHA512_CTX));
+    mod_trezorcrypto_Sha512_final(o, out);
     return mp_obj_new_bytes(out, sizeof(out));
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha512_digest_obj, mod_trezorcrypto_Sha512_digest);
 
+/// def digest_into(self, buf: bytearray, offset: int = 0) -> None:
+///     '''
+///     Writes the digest of hashed data into buf, starting at offset.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha512_digest_into(size_t n_args, const mp_obj_t *args) {
+    mp_obj_Sha512_t *o = MP_OBJ_TO_PTR(args[0]);
+    mod_trezorcrypto_Sha512_final(o, modtcc_get_digest_buffer(n_args - 1, args + 1, SHA512_DIGEST_LENGTH));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(mod_trezorcrypto_Sha512_digest_into_obj, 2, 3, mod_trezorcrypto_Sha512_digest_into);
+
+/// def reset(self) -> None:
+///     '''
+///     Starts over on a new message, as if the object was just created.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha512_reset(mp_obj_t self) {
+    mp_obj_Sha512_t *o = MP_OBJ_TO_PTR(self);
+    sha512_Init(&(o->ctx));
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha512_reset_obj, mod_trezorcrypto_Sha512_reset);
+
 STATIC mp_obj_t mod_trezorcrypto_Sha512___del__(mp_obj_t self) {
     mp_obj_Sha512_t *o = MP_OBJ_TO_PTR(self);
     memset(&(o->ctx), 0, sizeof(SHA512_CTX));
@@ -72,10 +99,27 @@ STATIC mp_obj_t mod_trezorcrypto_Sha512___del__(mp_obj_t self) {
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha512___del___obj, mod_trezorcrypto_Sha512___del__);
 
+/// @staticmethod
+/// def hash_many(items: List[bytes]) -> bytes:
+///     '''
+///     Hashes each buffer in the list and returns all the digests joined
+///     together, 64 bytes each.
+///     '''
+STATIC mp_obj_t mod_trezorcrypto_Sha512_hash_many(mp_obj_t items) {
+    return modtcc_hash_many(items, SHA512_DIGEST_LENGTH, sha512_many);
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(mod_trezorcrypto_Sha512_hash_many_fun_obj, mod_trezorcrypto_Sha512_hash_many);
+STATIC const mp_rom_obj_static_class_method_t mod_trezorcrypto_Sha512_hash_many_obj = {
+    {&mp_type_staticmethod}, MP_ROM_PTR(&mod_trezorcrypto_Sha512_hash_many_fun_obj)
+};
+
 STATIC const mp_rom_map_elem_t mod_trezorcrypto_Sha512_locals_dict_table[] = {
     { MP_ROM_QSTR(MP_QSTR_update), MP_ROM_PTR(&mod_trezorcrypto_Sha512_update_obj) },
     { MP_ROM_QSTR(MP_QSTR_digest), MP_ROM_PTR(&mod_trezorcrypto_Sha512_digest_obj) },
+    { MP_ROM_QSTR(MP_QSTR_digest_into), MP_ROM_PTR(&mod_trezorcrypto_Sha512_digest_into_obj) },
+    { MP_ROM_QSTR(MP_QSTR_reset), MP_ROM_PTR(&mod_trezorcrypto_Sha512_reset_obj) },
     { MP_ROM_QSTR(MP_QSTR___del__), MP_ROM_PTR(&mod_trezorcrypto_Sha512___del___obj) },
+    { MP_ROM_QSTR(MP_QSTR_hash_many), MP_ROM_PTR(&mod_trezorcrypto_Sha512_hash_many_obj) },
     { MP_ROM_QSTR(MP_QSTR_block_size), MP_OBJ_NEW_SMALL_INT(SHA512_BLOCK_LENGTH) },
     { MP_ROM_QSTR(MP_QSTR_digest_size), MP_OBJ_NEW_SMALL_INT(SHA512_DIGEST_LENGTH) },
 };
@@ -11,13 +11,137 @@
 
 #include "py/runtime.h"
 
+#include "sha_mb.h"
+
+// Output buffer for the *_into() methods: writable, at least as long as
+// the input, and either the input itself or not overlapping it at all.
+STATIC uint8_t *modtcc_get_output_buffer(mp_obj_t out, const mp_buffer_info_t *in) {
+    mp_buffer_info_t buf;
+    mp_get_buffer_raise(out, &buf, MP_BUFFER_WRITE);
+    if (buf.len < in->len) {
+        mp_raise_ValueError("Output buffer too small");
+    }
+    const uint8_t *i = in->buf, *o = buf.buf;
+    if (o != i && o < i + in->len && i < o + in->len) {
+        mp_raise_ValueError("Output buffer overlaps input");
+    }
+    return buf.buf;
+}
+
+// Output for the digest_into() methods, args being (buf[, offset]): room for
+// digest_len bytes in a writable buffer, from offset on.
+STATIC uint8_t *modtcc_get_digest_buffer(size_t n_args, const mp_obj_t *args, size_t digest_len) {
+    mp_buffer_info_t buf;
+    mp_get_buffer_raise(args[0], &buf, MP_BUFFER_WRITE);
+    mp_int_t offset = (n_args > 1) ? mp_obj_get_int(args[1]) : 0;
+    if (offset < 0) {
+        mp_raise_ValueError("Invalid offset");
+    }
+    if ((size_t)offset > buf.len || buf.len - offset < digest_len) {
+        mp_raise_ValueError("Output buffer too small");
+    }
+    return (uint8_t *)buf.buf + offset;
+}
+
+// Shared by the hash_many() static methods: hash each buffer of a list or
+// tuple with fn(), a chunk at a time, and return all the digests as one bytes.
+#define MODTCC_HASH_MANY_CHUNK 32
+typedef void (*modtcc_hash_many_fn_t)(const uint8_t *const *msg, const size_t *len, size_t count, uint8_t *out);
+
+STATIC mp_obj_t modtcc_hash_many(mp_obj_t items, size_t digest_len, modtcc_hash_many_fn_t fn) {
+    size_t count;
+    mp_obj_t *objs;
+    mp_obj_get_array(items, &count, &objs);
+
+    vstr_t vstr;
+    vstr_init_len(&vstr, digest_len * count);
+    uint8_t *out = (uint8_t *)vstr.buf;
+
+    const uint8_t *msg[MODTCC_HASH_MANY_CHUNK];
+    size_t len[MODTCC_HASH_MANY_CHUNK];
+    for (size_t i = 0; i < count; i += MODTCC_HASH_MANY_CHUNK) {
+        size_t n = count - i < MODTCC_HASH_MANY_CHUNK ? count - i : MODTCC_HASH_MANY_CHUNK;
+        for (size_t j = 0; j < n; j++) {
+            mp_buffer_info_t buf;
+            mp_get_buffer_raise(objs[i + j], &buf, MP_BUFFER_READ);
+            msg[j] = buf.buf;
+            len[j] = buf.len;
+        }
+        fn(msg, len, n, out + digest_len * i);
+    }
+    return mp_obj_new_str_from_vstr(&mp_type_bytes, &vstr);
+}
+
+// Thread pool for the batch functions: run work(arg) on up to threads - 1
+// worker threads (one per CPU if threads <= 0, and no more than max) and on
+// the calling thread, which runs caller(arg) instead if that is given.
+// Returns when all have finished. Only the calling thread may touch Python
+// objects, and neither function may raise. Off unix hosts, or with
+// MODTCC_NO_THREADS, it all runs on the calling thread.
+#if (defined(__unix__) || defined(__APPLE__)) && !defined(MODTCC_NO_THREADS)
+#define MODTCC_THREADS
+#define MODTCC_MAX_THREADS 64
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+typedef void (*modtcc_work_fn_t)(void *arg);
+
+#ifdef MODTCC_THREADS
+typedef struct {
+    modtcc_work_fn_t work;
+    void *arg;
+} modtcc_worker_t;
+
+STATIC void *modtcc_worker(void *p) {
+    modtcc_worker_t *w = p;
+    w->work(w->arg);
+    return NULL;
+}
+#endif
+
+STATIC void modtcc_run_workers(modtcc_work_fn_t work, void *arg, mp_int_t threads, size_t max, modtcc_work_fn_t caller) {
+#ifdef MODTCC_THREADS
+    pthread_t workers[MODTCC_MAX_THREADS];
+    modtcc_worker_t w = { work, arg };
+    int started = 0;
+    if (threads <= 0) {
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if ((size_t)threads > max) {
+        threads = max;
+    }
+    if (threads > MODTCC_MAX_THREADS) {
+        threads = MODTCC_MAX_THREADS;
+    }
+    // this thread works too, so start one fewer; fewer still if we can't
+    while (started < threads - 1) {
+        if (pthread_create(&workers[started], NULL, modtcc_worker, &w) != 0) {
+            break;
+        }
+        started++;
+    }
+#else
+    (void)threads;
+    (void)max;
+#endif
+
+    (caller ? caller : work)(arg);
+
+#ifdef MODTCC_THREADS
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+#endif
+}
+
 // NOTE: These are not header files, but C files.
 
 #ifndef EXCLUDE_AES
 #include "modtcc-aes.c"
+#include "modtcc-aesgcm.c"
 #endif
 #include "modtcc-crc.c"
-#include "modtcc-bip32.c"
 #include "modtcc-bip39.c"
 #include "modtcc-nist256p1.c"
 #include "modtcc-pbkdf2.c"
@@ -25,9 +149,12 @@
 #include "modtcc-rfc6979.c"
 #include "modtcc-ripemd160.c"
 #include "modtcc-secp256k1.c"
+#include "modtcc-bip32.c"        // after the k*G tables
 #include "modtcc-sha1.c"
 #include "modtcc-sha256.c"
 #include "modtcc-sha512.c"
+#include "modtcc-sha256d.c"
+#include "modtcc-hash160.c"
 #include "modtcc-codecs.c"
 
 #if 1
@@ -47,6 +174,7 @@ STATIC const mp_rom_map_elem_t mp_module_tcc_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__), MP_ROM_QSTR(MP_QSTR_trezorcrypto) },
 #ifndef EXCLUDE_AES
     { MP_ROM_QSTR(MP_QSTR_AES), MP_ROM_PTR(&mod_trezorcrypto_AES_type) },
+    { MP_ROM_QSTR(MP_QSTR_AESGCM), MP_ROM_PTR(&mod_trezorcrypto_AESGCM_type) },
 #endif
     { MP_ROM_QSTR(MP_QSTR_crc), MP_ROM_PTR(&mod_trezorcrypto_crc_module) },
     { MP_ROM_QSTR(MP_QSTR_bip32), MP_ROM_PTR(&mod_trezorcrypto_bip32_module) },
@@ -60,6 +188,10 @@ STATIC const mp_rom_map_elem_t mp_module_tcc_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_sha1), MP_ROM_PTR(&mod_trezorcrypto_Sha1_type) },
     { MP_ROM_QSTR(MP_QSTR_sha256), MP_ROM_PTR(&mod_trezorcrypto_Sha256_type) },
     { MP_ROM_QSTR(MP_QSTR_sha512), MP_ROM_PTR(&mod_trezorcrypto_Sha512_type) },
+    { MP_ROM_QSTR(MP_QSTR_Sha256d), MP_ROM_PTR(&mod_trezorcrypto_Sha256d_type) },
+    { MP_ROM_QSTR(MP_QSTR_sha256d), MP_ROM_PTR(&mod_trezorcrypto_sha256d_obj) },
+    { MP_ROM_QSTR(MP_QSTR_Hash160), MP_ROM_PTR(&mod_trezorcrypto_Hash160_type) },
+    { MP_ROM_QSTR(MP_QSTR_hash160), MP_ROM_PTR(&mod_trezorcrypto_hash160_obj) },
     { MP_ROM_QSTR(MP_QSTR_codecs), MP_ROM_PTR(&modtcc_codecs_module) },
 #if 1
     { MP_ROM_QSTR(MP_QSTR_blake256), MP_ROM_PTR(&mod_trezorcrypto_Blake256_type) },
@@ -81,3 +213,7 @@ const mp_obj_module_t mp_module_tcc = {
     .globals = (mp_obj_dict_t*)&mp_module_tcc_globals,
 };
 
+#ifdef MODULE_TCC_ENABLED
+// host builds via USER_C_MODULES (see micropython.mk); firmware lists us in mpconfigport.h
+MP_REGISTER_MODULE(MP_QSTR_tcc, mp_module_tcc, MODULE_TCC_ENABLED);
+#endif
@@ -0,0 +1,369 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * SHA-1 and SHA-256 using the CPU's instructions: the SHA extensions on x86-64
+ * (checked at runtime), or ARMv8's when the compiler targets them.
+ *
+ * Only the compression function differs from trezor-crypto: the contexts keep
+ * its layout (state words in host order, pending bytes as-is in the buffer),
+ * so a context can be started by one and carried on by the other.
+ *
+ */
+
+#include "sha_hw.h"
+
+#include <string.h>
+
+#ifdef SHA_HW
+
+#if defined(__clang__)
+#define SHA_HW_UNROLL   _Pragma("unroll")
+#elif defined(__GNUC__) && __GNUC__ >= 8
+#define SHA_HW_UNROLL   _Pragma("GCC unroll 20")
+#else
+#define SHA_HW_UNROLL
+#endif
+
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+#include <cpuid.h>
+
+#define SHA_HW_TARGET   __attribute__((target("sha,sse4.1")))
+
+SHA_HW_TARGET
+static void sha256_blocks(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // the instructions want the state as ABEF and CDGH
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1);
+    __m128i s1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B);
+    __m128i s0 = _mm_alignr_epi8(tmp, s1, 8);
+    s1 = _mm_blend_epi16(s1, tmp, 0xF0);
+
+    for (; blocks; blocks--, data += 64) {
+        __m128i save0 = s0, save1 = s1;
+        __m128i w[4];
+
+        for (int i = 0; i < 4; i++) {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * i)), bswap);
+        }
+
+        SHA_HW_UNROLL
+        for (int g = 0; g < 16; g++) {
+            if (g >= 4) {
+                // w[g & 3] holds W[g - 4], and becomes W[g]
+                __m128i x = _mm_sha256msg1_epu32(w[g & 3], w[(g + 1) & 3]);
+                x = _mm_add_epi32(x, _mm_alignr_epi8(w[(g + 3) & 3], w[(g + 2) & 3], 4));
+                w[g & 3] = _mm_sha256msg2_epu32(x, w[(g + 3) & 3]);
+            }
+            __m128i m = _mm_add_epi32(w[g & 3], _mm_loadu_si128((const __m128i *)&K256[4 * g]));
+            s1 = _mm_sha256rnds2_epu32(s1, s0, m);
+            s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(m, 0x0E));
+        }
+
+        s0 = _mm_add_epi32(s0, save0);
+        s1 = _mm_add_epi32(s1, save1);
+    }
+
+    tmp = _mm_shuffle_epi32(s0, 0x1B);
+    s1 = _mm_shuffle_epi32(s1, 0xB1);
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, s1, 0xF0));
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(s1, tmp, 8));
+}
+
+SHA_HW_TARGET
+static void sha1_blocks(uint32_t state[5], const uint8_t *data, size_t blocks)
+{
+    const __m128i bswap = _mm_set_epi64x(0x0001020304050607ULL, 0x08090a0b0c0d0e0fULL);
+
+    __m128i abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)state), 0x1B);
+    __m128i e0 = _mm_set_epi32((int)state[4], 0, 0, 0);
+
+    for (; blocks; blocks--, data += 64) {
+        __m128i save_abcd = abcd, save_e = e0;
+        __m128i w[4], e1;
+
+        for (int i = 0; i < 4; i++) {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * i)), bswap);
+        }
+
+        SHA_HW_UNROLL
+        for (int g = 0; g < 20; g++) {
+            if (g >= 4) {
+                __m128i x = _mm_sha1msg1_epu32(w[g & 3], w[(g + 1) & 3]);
+                x = _mm_xor_si128(x, w[(g + 2) & 3]);
+                w[g & 3] = _mm_sha1msg2_epu32(x, w[(g + 3) & 3]);
+            }
+            // e0 is E for this group: added directly at first, then derived
+            // from the A that the previous group started with
+            e0 = g ? _mm_sha1nexte_epu32(e1, w[g & 3]) : _mm_add_epi32(e0, w[0]);
+            e1 = abcd;
+            switch (g / 5) {
+                case 0: abcd = _mm_sha1rnds4_epu32(abcd, e0, 0); break;
+                case 1: abcd = _mm_sha1rnds4_epu32(abcd, e0, 1); break;
+                case 2: abcd = _mm_sha1rnds4_epu32(abcd, e0, 2); break;
+                default: abcd = _mm_sha1rnds4_epu32(abcd, e0, 3); break;
+            }
+        }
+
+        e0 = _mm_sha1nexte_epu32(e1, save_e);
+        abcd = _mm_add_epi32(abcd, save_abcd);
+    }
+
+    _mm_storeu_si128((__m128i *)state, _mm_shuffle_epi32(abcd, 0x1B));
+    state[4] = (uint32_t)_mm_extract_epi32(e0, 3);
+}
+
+static int cpu_sha = -1;
+
+bool sha_hw_available(void)
+{
+    if (cpu_sha < 0) {
+        unsigned int a, b, c, d;
+        __builtin_cpu_init();
+        // SHA is CPUID leaf 7, EBX bit 29; older compilers can't name it
+        cpu_sha = __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1u << 29))
+                    && __builtin_cpu_supports("sse4.1");
+    }
+    return cpu_sha;
+}
+
+#elif defined(__aarch64__)
+
+#include <arm_neon.h>
+
+static void sha256_blocks(uint32_t state[8], const uint8_t *data, size_t blocks)
+{
+    uint32x4_t s0 = vld1q_u32(&state[0]);
+    uint32x4_t s1 = vld1q_u32(&state[4]);
+
+    for (; blocks; blocks--, data += 64) {
+        uint32x4_t save0 = s0, save1 = s1;
+        uint32x4_t w[4];
+
+        for (int i = 0; i < 4; i++) {
+            w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+        }
+
+        SHA_HW_UNROLL
+        for (int g = 0; g < 16; g++) {
+            uint32x4_t m = vaddq_u32(w[g & 3], vld1q_u32(&K256[4 * g]));
+            uint32x4_t prev = s0;
+            s0 = vsha256hq_u32(s0, s1, m);
+            s1 = vsha256h2q_u32(s1, prev, m);
+            if (g < 12) {
+                // W[g] is used up; make W[g + 4] in its place
+                w[g & 3] = vsha256su1q_u32(vsha256su0q_u32(w[g & 3], w[(g + 1) & 3]),
+                                           w[(g + 2) & 3], w[(g + 3) & 3]);
+            }
+        }
+
+        s0 = vaddq_u32(s0, save0);
+        s1 = vaddq_u32(s1, save1);
+    }
+
+    vst1q_u32(&state[0], s0);
+    vst1q_u32(&state[4], s1);
+}
+
+static void sha1_blocks(uint32_t state[5], const uint8_t *data, size_t blocks)
+{
+    static const uint32_t k[4] = { 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xca62c1d6 };
+    uint32x4_t abcd = vld1q_u32(state);
+    uint32_t e = state[4];
+
+    for (; blocks; blocks--, data += 64) {
+        uint32x4_t save_abcd = abcd;
+        uint32_t save_e = e;
+        uint32x4_t w[4];
+
+        for (int i = 0; i < 4; i++) {
+            w[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+        }
+
+        SHA_HW_UNROLL
+        for (int g = 0; g < 20; g++) {
+            if (g >= 4) {
+                w[g & 3] = vsha1su1q_u32(vsha1su0q_u32(w[g & 3], w[(g + 1) & 3], w[(g + 2) & 3]),
+                                         w[(g + 3) & 3]);
+            }
+            uint32x4_t m = vaddq_u32(w[g & 3], vdupq_n_u32(k[g / 5]));
+            uint32_t next_e = vsha1h_u32(vgetq_lane_u32(abcd, 0));
+            if (g < 5) {
+                abcd = vsha1cq_u32(abcd, e, m);
+            } else if (g < 10 || g >= 15) {
+                abcd = vsha1pq_u32(abcd, e, m);
+            } else {
+                abcd = vsha1mq_u32(abcd, e, m);
+            }
+            e = next_e;
+        }
+
+        abcd = vaddq_u32(abcd, save_abcd);
+        e += save_e;
+    }
+
+    vst1q_u32(state, abcd);
+    state[4] = e;
+}
+
+bool sha_hw_available(void)
+{
+    return true;
+}
+
+#endif
+
+static inline void store_be32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24; p[1] = v >> 16; p[2] = v >> 8; p[3] = v;
+}
+
+typedef void (*blocks_fn_t)(uint32_t *state, const uint8_t *data, size_t blocks);
+
+// same buffering as trezor-crypto's sha*_Update()
+static void hw_update(blocks_fn_t fn, uint32_t *state, uint64_t *bitcount, uint8_t *buffer,
+                      const uint8_t *data, size_t len)
+{
+    size_t used = (*bitcount >> 3) % 64;
+
+    *bitcount += (uint64_t)len << 3;
+    if (used) {
+        size_t fill = 64 - used;
+        if (len < fill) {
+            memcpy(buffer + used, data, len);
+            return;
+        }
+        memcpy(buffer + used, data, fill);
+        fn(state, buffer, 1);
+        data += fill;
+        len -= fill;
+    }
+    if (len >= 64) {
+        fn(state, data, len / 64);
+        data += len & ~(size_t)63;
+        len &= 63;
+    }
+    memcpy(buffer, data, len);
+}
+
+static void hw_final(blocks_fn_t fn, uint32_t *state, int words, uint64_t bitcount, uint8_t *buffer,
+                     uint8_t *digest)
+{
+    size_t used = (bitcount >> 3) % 64;
+
+    buffer[used++] = 0x80;
+    if (used > 56) {
+        memset(buffer + used, 0, 64 - used);
+        fn(state, buffer, 1);
+        used = 0;
+    }
+    memset(buffer + used, 0, 56 - used);
+    store_be32(buffer + 56, (uint32_t)(bitcount >> 32));
+    store_be32(buffer + 60, (uint32_t)bitcount);
+    fn(state, buffer, 1);
+
+    for (int i = 0; i < words; i++) {
+        store_be32(digest + 4 * i, state[i]);
+    }
+}
+
+void sha256_hw_update(SHA256_CTX *ctx, const uint8_t *data, size_t len)
+{
+    if (!sha_hw_available()) {
+        sha256_Update(ctx, data, len);
+        return;
+    }
+    hw_update(sha256_blocks, ctx->state, &ctx->bitcount, (uint8_t *)ctx->buffer, data, len);
+}
+
+void sha256_hw_final(SHA256_CTX *ctx, uint8_t digest[SHA256_DIGEST_LENGTH])
+{
+    if (!sha_hw_available()) {
+        sha256_Final(ctx, digest);
+        return;
+    }
+    hw_final(sha256_blocks, ctx->state, 8, ctx->bitcount, (uint8_t *)ctx->buffer, digest);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+void sha1_hw_update(SHA1_CTX *ctx, const uint8_t *data, size_t len)
+{
+    if (!sha_hw_available()) {
+        sha1_Update(ctx, data, len);
+        return;
+    }
+    hw_update(sha1_blocks, ctx->state, &ctx->bitcount, (uint8_t *)ctx->buffer, data, len);
+}
+
+void sha1_hw_final(SHA1_CTX *ctx, uint8_t digest[SHA1_DIGEST_LENGTH])
+{
+    if (!sha_hw_available()) {
+        sha1_Final(ctx, digest);
+        return;
+    }
+    hw_final(sha1_blocks, ctx->state, 5, ctx->bitcount, (uint8_t *)ctx->buffer, digest);
+    memset(ctx, 0, sizeof(*ctx));
+}
+
+#else // SHA_HW
+
+bool sha_hw_available(void)
+{
+    return false;
+}
+
+void sha256_hw_update(SHA256_CTX *ctx, const uint8_t *data, size_t len)
+{
+    sha256_Update(ctx, data, len);
+}
+
+void sha256_hw_final(SHA256_CTX *ctx, uint8_t digest[SHA256_DIGEST_LENGTH])
+{
+    sha256_Final(ctx, digest);
+}
+
+void sha1_hw_update(SHA1_CTX *ctx, const uint8_t *data, size_t len)
+{
+    sha1_Update(ctx, data, len);
+}
+
+void sha1_hw_final(SHA1_CTX *ctx, uint8_t digest[SHA1_DIGEST_LENGTH])
+{
+    sha1_Final(ctx, digest);
+}
+
+#endif
+
+void sha256_hw_raw(const uint8_t *data, size_t len, uint8_t digest[SHA256_DIGEST_LENGTH])
+{
+    SHA256_CTX ctx;
+    sha256_Init(&ctx);
+    sha256_hw_update(&ctx, data, len);
+    sha256_hw_final(&ctx, digest);
+}
+
+void sha1_hw_raw(const uint8_t *data, size_t len, uint8_t digest[SHA1_DIGEST_LENGTH])
+{
+    SHA1_CTX ctx;
+    sha1_Init(&ctx);
+    sha1_hw_update(&ctx, data, len);
+    sha1_hw_final(&ctx, digest);
+}
@@ -0,0 +1,46 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * SHA-1 and SHA-256 using the CPU's instructions: the SHA extensions on x86-64
+ * (checked at runtime), or ARMv8's when the compiler targets them.
+ *
+ */
+
+#ifndef __SHA_HW_H__
+#define __SHA_HW_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "sha2.h"
+
+// define SHA_NO_HW to always use trezor-crypto's code
+#ifndef SHA_NO_HW
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define SHA_HW 1
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_CRYPTO) || defined(__ARM_FEATURE_SHA2))
+#define SHA_HW 1
+#endif
+#endif
+
+// true if the functions below will use the instructions
+bool sha_hw_available(void);
+
+// Drop-in for trezor-crypto's sha*_Update() and sha*_Final() on the same
+// contexts, so they can be mixed freely; they fall back to those functions
+// when the CPU lacks the instructions.
+void sha256_hw_update(SHA256_CTX *ctx, const uint8_t *data, size_t len);
+void sha256_hw_final(SHA256_CTX *ctx, uint8_t digest[SHA256_DIGEST_LENGTH]);
+void sha1_hw_update(SHA1_CTX *ctx, const uint8_t *data, size_t len);
+void sha1_hw_final(SHA1_CTX *ctx, uint8_t digest[SHA1_DIGEST_LENGTH]);
+
+// and for sha*_Raw()
+void sha256_hw_raw(const uint8_t *data, size_t len, uint8_t digest[SHA256_DIGEST_LENGTH]);
+void sha1_hw_raw(const uint8_t *data, size_t len, uint8_t digest[SHA1_DIGEST_LENGTH]);
+
+#endif
@@ -0,0 +1,396 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * Multi-buffer SHA-256 / SHA-512: many independent messages hashed side by
+ * side, one per SIMD lane.
+ *
+ * The compression functions are written once with the compiler's vector
+ * extensions (8 lanes of 32 bits for SHA-256, 4 lanes of 64 bits for SHA-512)
+ * and built twice on x86-64: for AVX2, picked at runtime, and for plain SSE2.
+ * On ARMv8 the same code becomes NEON. SHA-512 only wins with AVX2, so it is
+ * done one message at a time otherwise, as is everything on other targets.
+ * A CPU with SHA-256 instructions (sha_hw.c) is faster still, one at a time.
+ *
+ * Each lane takes the next message as soon as its own is done, so messages of
+ * different lengths keep all the lanes busy.
+ *
+ */
+
+#include "sha_mb.h"
+
+#include <string.h>
+
+#include "sha2.h"
+#include "sha_hw.h"
+
+#ifdef SHA_MB_SIMD
+
+typedef uint32_t v8u32 __attribute__((vector_size(32)));
+typedef uint64_t v4u64 __attribute__((vector_size(32)));
+
+#define SHA256_LANES    8
+#define SHA512_LANES    4
+
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+static const uint32_t IV256[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+static const uint64_t K512[80] = {
+    0x428a2f98d728ae22ULL, 0x7137449123ef65cdULL, 0xb5c0fbcfec4d3b2fULL, 0xe9b5dba58189dbbcULL,
+    0x3956c25bf348b538ULL, 0x59f111f1b605d019ULL, 0x923f82a4af194f9bULL, 0xab1c5ed5da6d8118ULL,
+    0xd807aa98a3030242ULL, 0x12835b0145706fbeULL, 0x243185be4ee4b28cULL, 0x550c7dc3d5ffb4e2ULL,
+    0x72be5d74f27b896fULL, 0x80deb1fe3b1696b1ULL, 0x9bdc06a725c71235ULL, 0xc19bf174cf692694ULL,
+    0xe49b69c19ef14ad2ULL, 0xefbe4786384f25e3ULL, 0x0fc19dc68b8cd5b5ULL, 0x240ca1cc77ac9c65ULL,
+    0x2de92c6f592b0275ULL, 0x4a7484aa6ea6e483ULL, 0x5cb0a9dcbd41fbd4ULL, 0x76f988da831153b5ULL,
+    0x983e5152ee66dfabULL, 0xa831c66d2db43210ULL, 0xb00327c898fb213fULL, 0xbf597fc7beef0ee4ULL,
+    0xc6e00bf33da88fc2ULL, 0xd5a79147930aa725ULL, 0x06ca6351e003826fULL, 0x142929670a0e6e70ULL,
+    0x27b70a8546d22ffcULL, 0x2e1b21385c26c926ULL, 0x4d2c6dfc5ac42aedULL, 0x53380d139d95b3dfULL,
+    0x650a73548baf63deULL, 0x766a0abb3c77b2a8ULL, 0x81c2c92e47edaee6ULL, 0x92722c851482353bULL,
+    0xa2bfe8a14cf10364ULL, 0xa81a664bbc423001ULL, 0xc24b8b70d0f89791ULL, 0xc76c51a30654be30ULL,
+    0xd192e819d6ef5218ULL, 0xd69906245565a910ULL, 0xf40e35855771202aULL, 0x106aa07032bbd1b8ULL,
+    0x19a4c116b8d2d0c8ULL, 0x1e376c085141ab53ULL, 0x2748774cdf8eeb99ULL, 0x34b0bcb5e19b48a8ULL,
+    0x391c0cb3c5c95a63ULL, 0x4ed8aa4ae3418acbULL, 0x5b9cca4f7763e373ULL, 0x682e6ff3d6b2b8a3ULL,
+    0x748f82ee5defb2fcULL, 0x78a5636f43172f60ULL, 0x84c87814a1f0ab72ULL, 0x8cc702081a6439ecULL,
+    0x90befffa23631e28ULL, 0xa4506cebde82bde9ULL, 0xbef9a3f7b2c67915ULL, 0xc67178f2e372532bULL,
+    0xca273eceea26619cULL, 0xd186b8c721c0c207ULL, 0xeada7dd6cde0eb1eULL, 0xf57d4f7fee6ed178ULL,
+    0x06f067aa72176fbaULL, 0x0a637dc5a2c898a6ULL, 0x113f9804bef90daeULL, 0x1b710b35131c471bULL,
+    0x28db77f523047d84ULL, 0x32caab7b40c72493ULL, 0x3c9ebe0a15c9bebcULL, 0x431d67c49c100d4cULL,
+    0x4cc5d4becb3e42b6ULL, 0x597f299cfc657e2aULL, 0x5fcb6fab3ad6faecULL, 0x6c44198c4a475817ULL,
+};
+
+static const uint64_t IV512[8] = {
+    0x6a09e667f3bcc908ULL, 0xbb67ae8584caa73bULL, 0x3c6ef372fe94f82bULL, 0xa54ff53a5f1d36f1ULL,
+    0x510e527fade682d1ULL, 0x9b05688c2b3e6c1fULL, 0x1f83d9abfb41bd6bULL, 0x5be0cd19137e2179ULL,
+};
+
+static inline uint32_t load_be32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return __builtin_bswap32(v);
+}
+
+static inline uint64_t load_be64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return __builtin_bswap64(v);
+}
+
+static inline void store_be32(uint8_t *p, uint32_t v)
+{
+    v = __builtin_bswap32(v);
+    memcpy(p, &v, 4);
+}
+
+static inline void store_be64(uint8_t *p, uint64_t v)
+{
+    v = __builtin_bswap64(v);
+    memcpy(p, &v, 8);
+}
+
+//
+// compression functions; st[i] holds state word i of every lane
+//
+
+#define ROTR32(x, n)    (((x) >> (n)) | ((x) << (32 - (n))))
+#define ROTR64(x, n)    (((x) >> (n)) | ((x) << (64 - (n))))
+
+#define CH(x, y, z)     ((z) ^ ((x) & ((y) ^ (z))))
+#define MAJ(x, y, z)    (((x) & (y)) | ((z) & ((x) | (y))))
+
+#define S256_0(x)       (ROTR32(x, 2) ^ ROTR32(x, 13) ^ ROTR32(x, 22))
+#define S256_1(x)       (ROTR32(x, 6) ^ ROTR32(x, 11) ^ ROTR32(x, 25))
+#define s256_0(x)       (ROTR32(x, 7) ^ ROTR32(x, 18) ^ ((x) >> 3))
+#define s256_1(x)       (ROTR32(x, 17) ^ ROTR32(x, 19) ^ ((x) >> 10))
+
+#define S512_0(x)       (ROTR64(x, 28) ^ ROTR64(x, 34) ^ ROTR64(x, 39))
+#define S512_1(x)       (ROTR64(x, 14) ^ ROTR64(x, 18) ^ ROTR64(x, 41))
+#define s512_0(x)       (ROTR64(x, 1) ^ ROTR64(x, 8) ^ ((x) >> 7))
+#define s512_1(x)       (ROTR64(x, 19) ^ ROTR64(x, 61) ^ ((x) >> 6))
+
+// one round; the caller rotates the roles of a..h instead of moving values
+#define ROUND(S0, S1, s0, s1, K, a, b, c, d, e, f, g, h, t)                   \
+    do {                                                                        \
+        if ((t) >= 16) {                                                        \
+            w[(t) & 15] += s1(w[((t) - 2) & 15]) + w[((t) - 7) & 15]            \
+                            + s0(w[((t) - 15) & 15]);                           \
+        }                                                                       \
+        h += S1(e) + CH(e, f, g) + K[t] + w[(t) & 15];                          \
+        d += h;                                                                 \
+        h += S0(a) + MAJ(a, b, c);                                              \
+    } while (0)
+
+#define ROUNDS8(S0, S1, s0, s1, K, t)                                           \
+    do {                                                                        \
+        ROUND(S0, S1, s0, s1, K, a, b, c, d, e, f, g, h, (t) + 0);              \
+        ROUND(S0, S1, s0, s1, K, h, a, b, c, d, e, f, g, (t) + 1);              \
+        ROUND(S0, S1, s0, s1, K, g, h, a, b, c, d, e, f, (t) + 2);              \
+        ROUND(S0, S1, s0, s1, K, f, g, h, a, b, c, d, e, (t) + 3);              \
+        ROUND(S0, S1, s0, s1, K, e, f, g, h, a, b, c, d, (t) + 4);              \
+        ROUND(S0, S1, s0, s1, K, d, e, f, g, h, a, b, c, (t) + 5);              \
+        ROUND(S0, S1, s0, s1, K, c, d, e, f, g, h, a, b, (t) + 6);              \
+        ROUND(S0, S1, s0, s1, K, b, c, d, e, f, g, h, a, (t) + 7);              \
+    } while (0)
+
+static inline __attribute__((always_inline)) void sha256_x8_body(v8u32 *st, const uint8_t *const *blk)
+{
+    v8u32 w[16];
+    for (int t = 0; t < 16; t++) {
+        uint32_t col[SHA256_LANES];
+        for (int l = 0; l < SHA256_LANES; l++) col[l] = load_be32(blk[l] + 4 * t);
+        memcpy(&w[t], col, sizeof(col));
+    }
+
+    v8u32 a = st[0], b = st[1], c = st[2], d = st[3];
+    v8u32 e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int t = 0; t < 64; t += 8) {
+        ROUNDS8(S256_0, S256_1, s256_0, s256_1, K256, t);
+    }
+    st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+    st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+}
+
+static inline __attribute__((always_inline)) void sha512_x4_body(v4u64 *st, const uint8_t *const *blk)
+{
+    v4u64 w[16];
+    for (int t = 0; t < 16; t++) {
+        uint64_t col[SHA512_LANES];
+        for (int l = 0; l < SHA512_LANES; l++) col[l] = load_be64(blk[l] + 8 * t);
+        memcpy(&w[t], col, sizeof(col));
+    }
+
+    v4u64 a = st[0], b = st[1], c = st[2], d = st[3];
+    v4u64 e = st[4], f = st[5], g = st[6], h = st[7];
+    for (int t = 0; t < 80; t += 8) {
+        ROUNDS8(S512_0, S512_1, s512_0, s512_1, K512, t);
+    }
+    st[0] += a; st[1] += b; st[2] += c; st[3] += d;
+    st[4] += e; st[5] += f; st[6] += g; st[7] += h;
+}
+
+#if defined(__x86_64__)
+
+#define SHA_MB_AVX2     __attribute__((target("avx2")))
+
+SHA_MB_AVX2
+static void sha256_x8_avx2(void *st, const uint8_t *const *blk)
+{
+    sha256_x8_body(st, blk);
+}
+
+SHA_MB_AVX2
+static void sha512_x4_avx2(void *st, const uint8_t *const *blk)
+{
+    sha512_x4_body(st, blk);
+}
+
+#endif
+
+static void sha256_x8(void *st, const uint8_t *const *blk)
+{
+    sha256_x8_body(st, blk);
+}
+
+//
+// lanes: feed each lane its message a block at a time, then the next message
+//
+
+typedef struct {
+    const uint8_t *data;        // whole blocks of the message still to hash
+    size_t blocks;
+    uint8_t tail[256];          // padded last one or two blocks
+    int tail_blocks;            // ... how many, and how many are done
+    int tail_done;
+    size_t msg;                 // message this lane is hashing
+    bool busy;
+    bool second;                // sha256d: now hashing the first digest
+} lane_t;
+
+typedef struct {
+    int lanes;
+    size_t block;               // 64 or 128 bytes
+    size_t len_bytes;           // size of the length at the end of the padding
+    size_t digest;              // bytes of state output
+    void (*compress)(void *st, const uint8_t *const *blk);
+    void (*reset)(void *st, int lane);
+    void (*output)(const void *st, int lane, uint8_t *out);
+} mb_algo_t;
+
+static void lane_load(const mb_algo_t *alg, lane_t *ln, const uint8_t *msg, size_t len)
+{
+    size_t rem = len % alg->block;
+
+    ln->data = msg;
+    ln->blocks = len / alg->block;
+    ln->tail_blocks = (rem + 1 + alg->len_bytes > alg->block) ? 2 : 1;
+    ln->tail_done = 0;
+
+    size_t end = ln->tail_blocks * alg->block;
+    memcpy(ln->tail, msg + len - rem, rem);
+    ln->tail[rem] = 0x80;
+    memset(ln->tail + rem + 1, 0, end - rem - 1);
+    // bit length, big-endian; len < 2^61 so only the last 8 bytes can be set
+    store_be64(ln->tail + end - 8, (uint64_t)len << 3);
+}
+
+static void mb_run(const mb_algo_t *alg, void *st, const uint8_t *const *msg, const size_t *len,
+                   size_t count, bool twice, uint8_t *out)
+{
+    static const uint8_t idle[128];
+    lane_t lane[8];
+    const uint8_t *blk[8];
+    size_t next = 0;
+    int busy = 0;
+
+    for (int l = 0; l < alg->lanes; l++) {
+        lane[l].busy = (next < count);
+        if (lane[l].busy) {
+            lane[l].msg = next;
+            lane[l].second = false;
+            lane_load(alg, &lane[l], msg[next], len[next]);
+            alg->reset(st, l);
+            next++;
+            busy++;
+        }
+    }
+
+    while (busy) {
+        for (int l = 0; l < alg->lanes; l++) {
+            lane_t *ln = &lane[l];
+            if (!ln->busy) {
+                blk[l] = idle;
+            } else if (ln->blocks) {
+                blk[l] = ln->data;
+                ln->data += alg->block;
+                ln->blocks--;
+            } else {
+                blk[l] = ln->tail + alg->block * ln->tail_done++;
+            }
+        }
+
+        alg->compress(st, blk);
+
+        for (int l = 0; l < alg->lanes; l++) {
+            lane_t *ln = &lane[l];
+            if (!ln->busy || ln->blocks || ln->tail_done < ln->tail_blocks) continue;
+
+            if (twice && !ln->second) {
+                // hash the digest again, in this lane
+                uint8_t first[32];
+                alg->output(st, l, first);
+                ln->second = true;
+                lane_load(alg, ln, first, sizeof(first));
+                alg->reset(st, l);
+                memset(first, 0, sizeof(first));
+                continue;
+            }
+
+            alg->output(st, l, out + alg->digest * ln->msg);
+            if (next < count) {
+                ln->msg = next;
+                ln->second = false;
+                lane_load(alg, ln, msg[next], len[next]);
+                alg->reset(st, l);
+                next++;
+            } else {
+                ln->busy = false;
+                busy--;
+            }
+        }
+    }
+
+    memset(lane, 0, sizeof(lane));
+}
+
+static void sha256_reset(void *st, int l)
+{
+    v8u32 *s = st;
+    for (int i = 0; i < 8; i++) s[i][l] = IV256[i];
+}
+
+static void sha256_output(const void *st, int l, uint8_t *out)
+{
+    const v8u32 *s = st;
+    for (int i = 0; i < 8; i++) store_be32(out + 4 * i, s[i][l]);
+}
+
+#if defined(__x86_64__)
+static void sha512_reset(void *st, int l)
+{
+    v4u64 *s = st;
+    for (int i = 0; i < 8; i++) s[i][l] = IV512[i];
+}
+
+static void sha512_output(const void *st, int l, uint8_t *out)
+{
+    const v4u64 *s = st;
+    for (int i = 0; i < 8; i++) store_be64(out + 8 * i, s[i][l]);
+}
+
+static int cpu_avx2 = -1;
+
+static bool has_avx2(void)
+{
+    if (cpu_avx2 < 0) {
+        __builtin_cpu_init();
+        cpu_avx2 = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return cpu_avx2;
+}
+#endif
+
+#endif // SHA_MB_SIMD
+
+void sha256_many(const uint8_t *const *msg, const size_t *len, size_t count, bool twice, uint8_t *out)
+{
+#ifdef SHA_MB_SIMD
+    // a lone message gains nothing from the lanes
+    if (count > 1 && !sha_hw_available()) {
+        mb_algo_t alg = { SHA256_LANES, 64, 8, 32, sha256_x8, sha256_reset, sha256_output };
+        v8u32 st[8];
+#if defined(__x86_64__)
+        if (has_avx2()) alg.compress = sha256_x8_avx2;
+#endif
+        mb_run(&alg, st, msg, len, count, twice, out);
+        memset(st, 0, sizeof(st));
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        uint8_t *d = out + SHA256_DIGEST_LENGTH * i;
+        sha256_hw_raw(msg[i], len[i], d);
+        if (twice) sha256_hw_raw(d, SHA256_DIGEST_LENGTH, d);
+    }
+}
+
+void sha512_many(const uint8_t *const *msg, const size_t *len, size_t count, uint8_t *out)
+{
+#if defined(SHA_MB_SIMD) && defined(__x86_64__)
+    if (count > 1 && has_avx2()) {
+        mb_algo_t alg = { SHA512_LANES, 128, 16, 64, sha512_x4_avx2, sha512_reset, sha512_output };
+        v4u64 st[8];
+        mb_run(&alg, st, msg, len, count, false, out);
+        memset(st, 0, sizeof(st));
+        return;
+    }
+#endif
+    for (size_t i = 0; i < count; i++) {
+        sha512_Raw(msg[i], len[i], out + SHA512_DIGEST_LENGTH * i);
+    }
+}
@@ -0,0 +1,33 @@
+/*
+ * Copyright (c) 2018 Coinkite Inc.
+ *
+ * Licensed under GNU License
+ * see LICENSE file for details
+ *
+ *
+ * Multi-buffer SHA-256 / SHA-512: many independent messages hashed side by
+ * side, one per SIMD lane.
+ *
+ */
+
+#ifndef __SHA_MB_H__
+#define __SHA_MB_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// define SHA_MB_NO_SIMD to always hash one message at a time with trezor-crypto
+#ifndef SHA_MB_NO_SIMD
+#if (defined(__x86_64__) || defined(__aarch64__)) && (defined(__GNUC__) || defined(__clang__))
+#define SHA_MB_SIMD 1
+#endif
+#endif
+
+// Hash count messages (msg[i] of len[i] bytes); the digests are written back
+// to back into out, which must hold 32 (or 64) * count bytes. With twice,
+// each digest is SHA256(SHA256(msg)).
+void sha256_many(const uint8_t *const *msg, const size_t *len, size_t count, bool twice, uint8_t *out);
+void sha512_many(const uint8_t *const *msg, const size_t *len, size_t count, uint8_t *out);
+
+#endif